@@ -31,6 +31,7 @@
 #define NUM_PULSE_STEPS		8
 #define NUM_TRIANGLE_STEPS	32
 #define DMC_SAMPLE_ADDR_START	0xC000
+#define NUM_PULSE_CYCLES	2
 
 struct pulse_main {
 	uint8_t vol_env:4;
@@ -216,6 +217,8 @@ struct apu {
 	struct dmc dmc;
 	int seq_step;
 	int cycle;
+	uint64_t next_cycle;
+	int level;
 	int bus_id;
 	struct region main_region;
 	struct region ctrl_stat_region;
@@ -227,11 +230,21 @@ struct apu {
 
 static bool apu_init(struct controller_instance *instance);
 static void apu_reset(struct controller_instance *instance);
+static void apu_serialize(struct controller_instance *instance,
+	struct state *state);
+static void apu_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void apu_deinit(struct controller_instance *instance);
 static void apu_writeb(struct apu *apu, uint8_t b, address_t address);
 static uint8_t stat_readb(struct apu *apu, address_t address);
 static void ctrl_writeb(struct apu *apu, uint8_t b, address_t address);
 static void seq_writeb(struct apu *apu, uint8_t b, address_t address);
+static void apu_sync(struct apu *apu);
+static void apu_schedule(struct apu *apu);
+static int apu_get_next_event(struct apu *apu);
+static void apu_skip(struct apu *apu, int num_cycles);
+static void apu_step(struct apu *apu);
+static void apu_mix(struct apu *apu);
 static void apu_tick(struct apu *apu);
 static void seq_tick(struct apu *apu);
 static void length_counter_tick(struct apu *apu);
@@ -284,6 +297,9 @@ void apu_writeb(struct apu *apu, uint8_t b, address_t address)
 {
 	uint8_t id;
 
+	/* Catch up with channels */
+	apu_sync(apu);
+
 	/* Write requested register */
 	apu->r.raw[address] = b;
 
@@ -344,6 +360,10 @@ void apu_writeb(struct apu *apu, uint8_t b, address_t address)
 	default:
 		break;
 	}
+
+	/* Output DMC direct load and wait for next channel event */
+	apu_mix(apu);
+	apu_schedule(apu);
 }
 
 uint8_t stat_readb(struct apu *apu, address_t UNUSED(address))
@@ -362,6 +382,9 @@ uint8_t stat_readb(struct apu *apu, address_t UNUSED(address))
 
 void ctrl_writeb(struct apu *apu, uint8_t b, address_t UNUSED(address))
 {
+	/* Catch up with channels */
+	apu_sync(apu);
+
 	/* Write control register */
 	apu->r.ctrl.raw = b;
 
@@ -406,6 +429,9 @@ void ctrl_writeb(struct apu *apu, uint8_t b, address_t UNUSED(address))
 
 	/* Writing to this register clears the DMC interrupt flag. */
 	apu->r.stat.dmc_interrupt = 0;
+
+	/* Wait for next channel event */
+	apu_schedule(apu);
 }
 
 void seq_writeb(struct apu *apu, uint8_t b, address_t UNUSED(address))
@@ -414,7 +440,7 @@ void seq_writeb(struct apu *apu, uint8_t b, address_t UNUSED(address))
 	apu->r.seq.raw = b;
 
 	/* On a write the sequencer, the divider and sequencer are reset. */
-	apu->seq_clock.num_remaining_cycles = 0;
+	clock_schedule(&apu->seq_clock, 0);
 	apu->seq_step = 0;
 
 	/* Clear frame interrupt flag upon setting the interrupt inhibit flag */
@@ -658,23 +684,125 @@ void dmc_update(struct apu *apu)
 	apu->dmc.counter--;
 }
 
-void apu_tick(struct apu *apu)
+void apu_sync(struct apu *apu)
 {
-	float pulse1;
-	float pulse2;
-	float triangle;
-	float noise;
-	float dmc;
-	float pulse_out;
-	float tnd_out;
-	float output;
-	uint8_t buffer;
+	struct clock *clock = &apu->main_clock;
+	uint64_t current_cycle = clock_ctx->current_cycle;
+	uint64_t cycle = apu->next_cycle;
+	int num_cycles;
+
+	/* Leave if no APU cycle has elapsed since last update */
+	if (current_cycle < cycle)
+		return;
+
+	/* Skip APU cycles which elapsed before current tick (these hold no
+	channel event as the APU clock would have ticked otherwise) */
+	num_cycles = (current_cycle - cycle) / clock->div;
+	cycle += num_cycles * clock->div;
+	if ((cycle < current_cycle) || clock_elapsed(clock, cycle))
+		num_cycles++;
+	apu_skip(apu, num_cycles);
+}
+
+void apu_schedule(struct apu *apu)
+{
+	struct clock *clock = &apu->main_clock;
+	uint64_t cycle;
+
+	/* Tick APU clock once next channel event is due */
+	cycle = apu->next_cycle;
+	cycle += (apu_get_next_event(apu) - 1) * clock->div;
+	clock_schedule_at(clock, cycle);
+}
+
+int apu_get_next_event(struct apu *apu)
+{
+	struct pulse *pulse;
+	bool silenced;
+	int first;
+	int n;
+	int k;
+	int c;
+
+	/* DMC memory reader and interrupt line are serviced on every cycle,
+	whereas channel outputs only change once their counter expires */
+	if ((!apu->dmc.sample_buffer_full && (apu->dmc.byte_count != 0)) ||
+		apu->r.stat.dmc_interrupt)
+		return 1;
+	n = apu->dmc.counter + 1;
+
+	/* Triangle counter does not run while silenced at 0 */
+	silenced = apu->triangle.len_counter_silenced;
+	silenced |= apu->triangle.linear_counter_silenced;
+	k = apu->triangle.counter + 1;
+	if ((!silenced || (apu->triangle.value != 0)) && (k < n))
+		n = k;
+
+	/* Pulse and noise counters are clocked every second cycle only, and
+	are frozen while silenced (once their output is zeroed) */
+	first = NUM_PULSE_CYCLES - apu->cycle;
+	for (c = 1; c <= 2; c++) {
+		pulse = (c == 1) ? &apu->pulse1 : &apu->pulse2;
+		silenced = pulse->len_counter_silenced || pulse->sweep_silenced;
+		k = first + NUM_PULSE_CYCLES * pulse->counter;
+		if (silenced)
+			k = (pulse->value != 0) ? first : n;
+		if (k < n)
+			n = k;
+	}
+	k = first + NUM_PULSE_CYCLES * apu->noise.counter;
+	if (apu->noise.len_counter_silenced)
+		k = (apu->noise.value != 0) ? first : n;
+	if (k < n)
+		n = k;
+
+	return n;
+}
+
+void apu_skip(struct apu *apu, int num_cycles)
+{
+	struct pulse *pulse;
+	bool silenced;
+	int first;
+	int n;
+	int c;
+
+	/* Leave if there is nothing to skip */
+	if (num_cycles == 0)
+		return;
 
+	/* Get number of pulse/noise clocks within skipped cycles */
+	first = NUM_PULSE_CYCLES - apu->cycle;
+	n = 0;
+	if (num_cycles >= first)
+		n = (num_cycles - first) / NUM_PULSE_CYCLES + 1;
+
+	/* Advance running counters (none of them expiring here) */
+	silenced = apu->triangle.len_counter_silenced;
+	silenced |= apu->triangle.linear_counter_silenced;
+	if (!silenced || (apu->triangle.value != 0))
+		apu->triangle.counter -= num_cycles;
+	for (c = 1; c <= 2; c++) {
+		pulse = (c == 1) ? &apu->pulse1 : &apu->pulse2;
+		if (!pulse->len_counter_silenced && !pulse->sweep_silenced)
+			pulse->counter -= n;
+	}
+	if (!apu->noise.len_counter_silenced)
+		apu->noise.counter -= n;
+	apu->dmc.counter -= num_cycles;
+
+	/* Update cycle parity and next cycle */
+	apu->cycle = (apu->cycle + num_cycles) % NUM_PULSE_CYCLES;
+	apu->next_cycle += num_cycles * apu->main_clock.div;
+}
+
+void apu_step(struct apu *apu)
+{
 	/* The triangle channel's timer is clocked on every APU cycle, but the
 	pulse, noise, and DMC timers are clocked only on every second APU cycle
 	and thus produce only even periods. */
 	triangle_update(apu);
-	if (++apu->cycle == 2) {
+	if (++apu->cycle == NUM_PULSE_CYCLES) {
 		pulse_update(apu);
 		noise_update(apu);
 		apu->cycle = 0;
@@ -683,6 +811,22 @@ void apu_tick(struct apu *apu)
 	/* Update DMC channel */
 	dmc_update(apu);
 
+	/* Update next cycle */
+	apu->next_cycle += apu->main_clock.div;
+}
+
+void apu_mix(struct apu *apu)
+{
+	float pulse1;
+	float pulse2;
+	float triangle;
+	float noise;
+	float dmc;
+	float pulse_out;
+	float tnd_out;
+	float output;
+	int level;
+
 	/* Compute channel outputs */
 	pulse1 = apu->pulse1.value * apu->pulse1.volume;
 	pulse2 = apu->pulse2.value * apu->pulse2.volume;
@@ -699,12 +843,27 @@ void apu_tick(struct apu *apu)
 	tnd_out = 0.00851f * triangle + 0.00494f * noise + 0.00335f * dmc;
 	output = pulse_out + tnd_out;
 
-	/* Enqueue audio data */
-	buffer = output * UCHAR_MAX;
-	audio_enqueue(&buffer, 1);
+	/* Report amplitude change to band-limited synthesis */
+	level = output * INT16_MAX;
+	if (level != apu->level) {
+		audio_add_delta(level - apu->level);
+		apu->level = level;
+	}
+}
 
-	/* Always consume one cycle */
-	clock_consume(1);
+void apu_tick(struct apu *apu)
+{
+	struct clock *clock = &apu->main_clock;
+	int num_cycles;
+
+	/* Skip idle cycles since last update and run current one */
+	num_cycles = (clock_get_due(clock) - apu->next_cycle) / clock->div;
+	apu_skip(apu, num_cycles);
+	apu_step(apu);
+	apu_mix(apu);
+
+	/* Sleep until next channel event */
+	clock_consume(apu_get_next_event(apu));
 }
 
 void length_counter_tick(struct apu *apu)
@@ -956,6 +1115,9 @@ void seq_tick(struct apu *apu)
 	bool l;
 	bool e;
 
+	/* Catch up with channels */
+	apu_sync(apu);
+
 	/* Get current frame sequencer step */
 	s = apu->seq_step;
 
@@ -1017,6 +1179,10 @@ void seq_tick(struct apu *apu)
 		linear_counter_tick(apu);
 	}
 
+	/* Output volume changes and wait for next channel event */
+	apu_mix(apu);
+	apu_schedule(apu);
+
 	/* Always consume one cycle */
 	clock_consume(1);
 }
@@ -1095,7 +1261,7 @@ bool apu_init(struct controller_instance *instance)
 
 	/* Initialize audio frontend */
 	audio_specs.freq = apu->main_clock.rate;
-	audio_specs.format = AUDIO_FORMAT_U8;
+	audio_specs.format = AUDIO_FORMAT_DELTA;
 	audio_specs.channels = 1;
 	if (!audio_init(&audio_specs)) {
 		free(apu);
@@ -1118,6 +1284,7 @@ void apu_reset(struct controller_instance *instance)
 	apu->noise.shift_reg = 1;
 	apu->seq_step = 0;
 	apu->cycle = 0;
+	apu->next_cycle = 0;
 
 	/* Silence all channels */
 	apu->pulse1.len_counter_silenced = true;
@@ -1129,6 +1296,40 @@ void apu_reset(struct controller_instance *instance)
 	apu->noise.len_counter_silenced = true;
 }
 
+void apu_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct apu *apu = instance->priv_data;
+
+	/* Save APU state */
+	STATE_SAVE(state, apu->r);
+	STATE_SAVE(state, apu->pulse1);
+	STATE_SAVE(state, apu->pulse2);
+	STATE_SAVE(state, apu->triangle);
+	STATE_SAVE(state, apu->noise);
+	STATE_SAVE(state, apu->dmc);
+	STATE_SAVE(state, apu->seq_step);
+	STATE_SAVE(state, apu->cycle);
+	STATE_SAVE(state, apu->next_cycle);
+	STATE_SAVE(state, apu->level);
+}
+
+void apu_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct apu *apu = instance->priv_data;
+
+	/* Restore APU state */
+	STATE_LOAD(state, apu->r);
+	STATE_LOAD(state, apu->pulse1);
+	STATE_LOAD(state, apu->pulse2);
+	STATE_LOAD(state, apu->triangle);
+	STATE_LOAD(state, apu->noise);
+	STATE_LOAD(state, apu->dmc);
+	STATE_LOAD(state, apu->seq_step);
+	STATE_LOAD(state, apu->cycle);
+	STATE_LOAD(state, apu->next_cycle);
+	STATE_LOAD(state, apu->level);
+}
+
 void apu_deinit(struct controller_instance *instance)
 {
 	audio_deinit();
@@ -1138,6 +1339,8 @@ void apu_deinit(struct controller_instance *instance)
 CONTROLLER_START(apu)
 	.init = apu_init,
 	.reset = apu_reset,
+	.serialize = apu_serialize,
+	.deserialize = apu_deserialize,
 	.deinit = apu_deinit
 CONTROLLER_END
 
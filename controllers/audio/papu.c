@@ -229,6 +229,10 @@ struct papu {
 
 static bool papu_init(struct controller_instance *instance);
 static void papu_reset(struct controller_instance *instance);
+static void papu_serialize(struct controller_instance *instance,
+	struct state *state);
+static void papu_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void papu_deinit(struct controller_instance *instance);
 static uint8_t papu_readb(struct papu *papu, address_t address);
 static void papu_writeb(struct papu *papu, uint8_t b, address_t address);
@@ -798,7 +802,7 @@ void papu_tick(struct papu *papu)
 	float ch4_output;
 	float left;
 	float right;
-	uint8_t buffer[2];
+	uint8_t *buffer;
 
 	/* Update square channels, wave channel, and noise channel */
 	square1_update(papu);
@@ -835,10 +839,10 @@ void papu_tick(struct papu *papu)
 	right += ch4_output * papu->regs.nr51.snd4_so1;
 	right /= NUM_CHANNELS;
 
-	/* Enqueue audio data */
+	/* Write audio data */
+	buffer = audio_get_buffer(1);
 	buffer[0] = left * UCHAR_MAX;
 	buffer[1] = right * UCHAR_MAX;
-	audio_enqueue(buffer, 1);
 
 	/* Always consume one cycle */
 	clock_consume(1);
@@ -1094,6 +1098,34 @@ void papu_reset(struct controller_instance *instance)
 	papu->channel4.lfsr = 0x7FFF;
 }
 
+void papu_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct papu *papu = instance->priv_data;
+
+	/* Save PAPU state */
+	STATE_SAVE(state, papu->regs);
+	STATE_SAVE(state, papu->channel1);
+	STATE_SAVE(state, papu->channel2);
+	STATE_SAVE(state, papu->channel3);
+	STATE_SAVE(state, papu->channel4);
+	STATE_SAVE(state, papu->seq_step);
+	STATE_SAVE(state, papu->wave_ram);
+}
+
+void papu_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct papu *papu = instance->priv_data;
+
+	/* Restore PAPU state */
+	STATE_LOAD(state, papu->regs);
+	STATE_LOAD(state, papu->channel1);
+	STATE_LOAD(state, papu->channel2);
+	STATE_LOAD(state, papu->channel3);
+	STATE_LOAD(state, papu->channel4);
+	STATE_LOAD(state, papu->seq_step);
+	STATE_LOAD(state, papu->wave_ram);
+}
+
 void papu_deinit(struct controller_instance *instance)
 {
 	audio_deinit();
@@ -1103,6 +1135,8 @@ void papu_deinit(struct controller_instance *instance)
 CONTROLLER_START(papu)
 	.init = papu_init,
 	.reset = papu_reset,
+	.serialize = papu_serialize,
+	.deserialize = papu_deserialize,
 	.deinit = papu_deinit
 CONTROLLER_END
 
@@ -92,6 +92,10 @@ struct sn76489 {
 
 static bool sn76489_init(struct controller_instance *instance);
 static void sn76489_reset(struct controller_instance *instance);
+static void sn76489_serialize(struct controller_instance *instance,
+	struct state *state);
+static void sn76489_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void sn76489_deinit(struct controller_instance *instance);
 static void sn76489_write(struct sn76489 *sn76489, uint8_t b);
 static void handle_tone_channel(struct sn76489 *sn76489, int channel);
@@ -271,8 +275,8 @@ void mix(struct sn76489 *sn76489)
 		final_volume += vol / NUM_CHANNELS;
 	};
 
-	/* Enqueue mixer output */
-	audio_enqueue(&final_volume, 1);
+	/* Write mixer output */
+	*(uint8_t *)audio_get_buffer(1) = final_volume;
 }
 
 void sn76489_tick(struct sn76489 *sn76489)
@@ -358,6 +362,36 @@ void sn76489_reset(struct controller_instance *instance)
 	}
 }
 
+void sn76489_serialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sn76489 *sn76489 = instance->priv_data;
+
+	/* Save PSG state */
+	STATE_SAVE(state, sn76489->vol_regs);
+	STATE_SAVE(state, sn76489->tone_regs);
+	STATE_SAVE(state, sn76489->noise_reg);
+	STATE_SAVE(state, sn76489->channels);
+	STATE_SAVE(state, sn76489->lfsr);
+	STATE_SAVE(state, sn76489->current_reg_type);
+	STATE_SAVE(state, sn76489->current_channel);
+}
+
+void sn76489_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sn76489 *sn76489 = instance->priv_data;
+
+	/* Restore PSG state */
+	STATE_LOAD(state, sn76489->vol_regs);
+	STATE_LOAD(state, sn76489->tone_regs);
+	STATE_LOAD(state, sn76489->noise_reg);
+	STATE_LOAD(state, sn76489->channels);
+	STATE_LOAD(state, sn76489->lfsr);
+	STATE_LOAD(state, sn76489->current_reg_type);
+	STATE_LOAD(state, sn76489->current_channel);
+}
+
 void sn76489_deinit(struct controller_instance *instance)
 {
 	audio_deinit();
@@ -367,6 +401,8 @@ void sn76489_deinit(struct controller_instance *instance)
 CONTROLLER_START(sn76489)
 	.init = sn76489_init,
 	.reset = sn76489_reset,
+	.serialize = sn76489_serialize,
+	.deserialize = sn76489_deserialize,
 	.deinit = sn76489_deinit
 CONTROLLER_END
 
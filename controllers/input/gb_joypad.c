@@ -35,6 +35,10 @@ struct joypad {
 
 static bool joypad_init(struct controller_instance *instance);
 static void joypad_reset(struct controller_instance *instance);
+static void joypad_serialize(struct controller_instance *instance,
+	struct state *state);
+static void joypad_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void joypad_deinit(struct controller_instance *instance);
 static uint8_t joypad_readb(struct joypad *joypad, address_t address);
 static void joypad_writeb(struct joypad *joypad, uint8_t b, address_t address);
@@ -164,6 +168,23 @@ void joypad_reset(struct controller_instance *instance)
 		joypad->keys[i] = false;
 }
 
+void joypad_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct joypad *joypad = instance->priv_data;
+
+	/* Save joypad register */
+	STATE_SAVE(state, joypad->reg);
+}
+
+void joypad_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct joypad *joypad = instance->priv_data;
+
+	/* Restore joypad register */
+	STATE_LOAD(state, joypad->reg);
+}
+
 void joypad_deinit(struct controller_instance *instance)
 {
 	free(instance->priv_data);
@@ -172,6 +193,8 @@ void joypad_deinit(struct controller_instance *instance)
 CONTROLLER_START(gb_joypad)
 	.init = joypad_init,
 	.reset = joypad_reset,
+	.serialize = joypad_serialize,
+	.deserialize = joypad_deserialize,
 	.deinit = joypad_deinit
 CONTROLLER_END
 
@@ -44,6 +44,10 @@ struct nes_ctrl {
 
 static bool nes_ctrl_init(struct controller_instance *instance);
 static void nes_ctrl_reset(struct controller_instance *instance);
+static void nes_ctrl_serialize(struct controller_instance *instance,
+	struct state *state);
+static void nes_ctrl_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void nes_ctrl_deinit(struct controller_instance *instance);
 static void nes_ctrl_event(int id, enum input_type type, struct nes_ctrl *n);
 static uint8_t nes_ctrl_readb(struct nes_ctrl *nes_ctrl, address_t a);
@@ -199,6 +203,26 @@ void nes_ctrl_event(int id, enum input_type type, struct nes_ctrl *nes_ctrl)
 		nes_ctrl_reload(nes_ctrl);
 }
 
+void nes_ctrl_serialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct nes_ctrl *nes_ctrl = instance->priv_data;
+
+	/* Save controller latch and shift registers */
+	STATE_SAVE(state, nes_ctrl->input_reg);
+	STATE_SAVE(state, nes_ctrl->shift_regs);
+}
+
+void nes_ctrl_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct nes_ctrl *nes_ctrl = instance->priv_data;
+
+	/* Restore controller latch and shift registers */
+	STATE_LOAD(state, nes_ctrl->input_reg);
+	STATE_LOAD(state, nes_ctrl->shift_regs);
+}
+
 void nes_ctrl_deinit(struct controller_instance *instance)
 {
 	struct nes_ctrl *nes_ctrl = instance->priv_data;
@@ -209,6 +233,8 @@ void nes_ctrl_deinit(struct controller_instance *instance)
 CONTROLLER_START(nes_controller)
 	.init = nes_ctrl_init,
 	.reset = nes_ctrl_reset,
+	.serialize = nes_ctrl_serialize,
+	.deserialize = nes_ctrl_deserialize,
 	.deinit = nes_ctrl_deinit
 CONTROLLER_END
 
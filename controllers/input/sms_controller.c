@@ -49,6 +49,10 @@ struct sms_ctrl {
 
 static bool sms_ctrl_init(struct controller_instance *instance);
 static void sms_ctrl_reset(struct controller_instance *instance);
+static void sms_ctrl_serialize(struct controller_instance *instance,
+	struct state *state);
+static void sms_ctrl_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void sms_ctrl_deinit(struct controller_instance *instance);
 static void sms_ctrl_event(int id, enum input_type type, struct sms_ctrl *s);
 static void sms_ctrl_pause_event(int id, enum input_type t, struct sms_ctrl *s);
@@ -207,6 +211,24 @@ void sms_ctrl_reset(struct controller_instance *instance)
 	sms_ctrl->ab_port.p_b_down = 1;
 }
 
+void sms_ctrl_serialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sms_ctrl *sms_ctrl = instance->priv_data;
+
+	/* Save control port */
+	STATE_SAVE(state, sms_ctrl->ctl_port);
+}
+
+void sms_ctrl_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sms_ctrl *sms_ctrl = instance->priv_data;
+
+	/* Restore control port */
+	STATE_LOAD(state, sms_ctrl->ctl_port);
+}
+
 void sms_ctrl_deinit(struct controller_instance *instance)
 {
 	struct sms_ctrl *sms_ctrl = instance->priv_data;
@@ -216,6 +238,8 @@ void sms_ctrl_deinit(struct controller_instance *instance)
 CONTROLLER_START(sms_controller)
 	.init = sms_ctrl_init,
 	.reset = sms_ctrl_reset,
+	.serialize = sms_ctrl_serialize,
+	.deserialize = sms_ctrl_deserialize,
 	.deinit = sms_ctrl_deinit
 CONTROLLER_END
 
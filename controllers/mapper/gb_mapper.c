@@ -22,6 +22,10 @@ struct gb_mapper {
 
 static bool gb_mapper_init(struct controller_instance *instance);
 static void gb_mapper_reset(struct controller_instance *instance);
+static void gb_mapper_serialize(struct controller_instance *instance,
+	struct state *state);
+static void gb_mapper_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void gb_mapper_deinit(struct controller_instance *instance);
 static void lock_writeb(struct gb_mapper *gb_mapper, uint8_t b, address_t addr);
 static void print_header(struct cart_header *h);
@@ -266,6 +270,34 @@ void gb_mapper_reset(struct controller_instance *instance)
 	}
 }
 
+void gb_mapper_serialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct gb_mapper *gb_mapper = instance->priv_data;
+
+	/* Save boot ROM locked state */
+	STATE_SAVE(state, gb_mapper->bootrom_locked);
+}
+
+void gb_mapper_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct gb_mapper *gb_mapper = instance->priv_data;
+	bool bootrom_locked = gb_mapper->bootrom_locked;
+
+	/* Restore boot ROM locked state */
+	STATE_LOAD(state, bootrom_locked);
+	if (bootrom_locked == gb_mapper->bootrom_locked)
+		return;
+
+	/* Add/remove boot ROM region and update locked state */
+	if (bootrom_locked)
+		memory_region_remove(&gb_mapper->bootrom_region);
+	else
+		memory_region_add(&gb_mapper->bootrom_region);
+	gb_mapper->bootrom_locked = bootrom_locked;
+}
+
 void gb_mapper_deinit(struct controller_instance *instance)
 {
 	struct gb_mapper *gb_mapper = instance->priv_data;
@@ -282,6 +314,8 @@ void gb_mapper_deinit(struct controller_instance *instance)
 CONTROLLER_START(gb_mapper)
 	.init = gb_mapper_init,
 	.reset = gb_mapper_reset,
+	.serialize = gb_mapper_serialize,
+	.deserialize = gb_mapper_deserialize,
 	.deinit = gb_mapper_deinit
 CONTROLLER_END
 
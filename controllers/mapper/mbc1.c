@@ -41,6 +41,10 @@ struct mbc1 {
 
 static bool mbc1_init(struct controller_instance *instance);
 static void mbc1_reset(struct controller_instance *instance);
+static void mbc1_serialize(struct controller_instance *instance,
+	struct state *state);
+static void mbc1_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void mbc1_deinit(struct controller_instance *instance);
 static uint8_t rom1_readb(struct mbc1 *mbc1, address_t address);
 static uint8_t extram_readb(struct mbc1 *mbc1, address_t address);
@@ -281,6 +285,36 @@ void mbc1_reset(struct controller_instance *instance)
 	mbc1->mode_sel = ROM_SELECT_MODE;
 }
 
+void mbc1_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct mbc1 *mbc1 = instance->priv_data;
+
+	/* Save mapper registers */
+	STATE_SAVE(state, mbc1->rom_num_low);
+	STATE_SAVE(state, mbc1->rom_num_high);
+	STATE_SAVE(state, mbc1->ram_enabled);
+	STATE_SAVE(state, mbc1->mode_sel);
+
+	/* Save external RAM */
+	if (mbc1->ram_size != 0)
+		state_save(state, mbc1->ram, mbc1->ram_size);
+}
+
+void mbc1_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct mbc1 *mbc1 = instance->priv_data;
+
+	/* Restore mapper registers */
+	STATE_LOAD(state, mbc1->rom_num_low);
+	STATE_LOAD(state, mbc1->rom_num_high);
+	STATE_LOAD(state, mbc1->ram_enabled);
+	STATE_LOAD(state, mbc1->mode_sel);
+
+	/* Restore external RAM */
+	if (mbc1->ram_size != 0)
+		state_load(state, mbc1->ram, mbc1->ram_size);
+}
+
 void mbc1_deinit(struct controller_instance *instance)
 {
 	struct mbc1 *mbc1 = instance->priv_data;
@@ -299,6 +333,8 @@ void mbc1_deinit(struct controller_instance *instance)
 CONTROLLER_START(mbc1)
 	.init = mbc1_init,
 	.reset = mbc1_reset,
+	.serialize = mbc1_serialize,
+	.deserialize = mbc1_deserialize,
 	.deinit = mbc1_deinit
 CONTROLLER_END
 
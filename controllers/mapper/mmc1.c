@@ -4,6 +4,7 @@
 #include <controller.h>
 #include <cpu.h>
 #include <env.h>
+#include <event.h>
 #include <file.h>
 #include <memory.h>
 #include <util.h>
@@ -61,6 +62,7 @@ struct mmc1 {
 	uint8_t *chr_rom;
 	int prg_rom_size;
 	int chr_rom_size;
+	int prg_ram_size;
 	struct region prg_rom_region;
 	struct region chr_region;
 	struct region load_region;
@@ -70,6 +72,10 @@ struct mmc1 {
 
 static bool mmc1_init(struct controller_instance *instance);
 static void mmc1_reset(struct controller_instance *instance);
+static void mmc1_serialize(struct controller_instance *instance,
+	struct state *state);
+static void mmc1_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void mmc1_deinit(struct controller_instance *instance);
 static void mirror_address(struct mmc1 *mmc1, address_t *address);
 static void remap_prg_rom(struct mmc1 *mmc1, address_t *address);
@@ -276,6 +282,10 @@ void load_writeb(struct mmc1 *mmc1, uint8_t b, address_t address)
 	a = address;
 	reg = bitops_getw(&a, 13, 2);
 
+	/* Notify PPU before CHR banks or mirroring get updated */
+	if (reg != 3)
+		event_fire("ppu_bus_switch");
+
 	/* Write selected register as follows:
 	- Control	$8000-$9FFF
 	- CHR bank 0	$A000-$BFFF
@@ -336,7 +346,8 @@ bool mmc1_init(struct controller_instance *instance)
 	memory_region_add(&mmc1->prg_rom_region);
 
 	/* Allocate PRG RAM */
-	mmc1->prg_ram = calloc(PRG_RAM_SIZE(cart_header), sizeof(uint8_t));
+	mmc1->prg_ram_size = PRG_RAM_SIZE(cart_header);
+	mmc1->prg_ram = calloc(mmc1->prg_ram_size, sizeof(uint8_t));
 
 	/* Allocate CHR RAM if needed */
 	if (cart_header->chr_rom_size == 0)
@@ -426,6 +437,51 @@ void mmc1_reset(struct controller_instance *instance)
 	mmc1->shift_reg_step = 0;
 }
 
+void mmc1_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct mmc1 *mmc1 = instance->priv_data;
+	uint8_t chr_bank_0 = mmc1->chr_bank_0;
+	uint8_t chr_bank_1 = mmc1->chr_bank_1;
+	uint8_t shift_reg = mmc1->shift_reg;
+
+	/* Save mapper registers */
+	STATE_SAVE(state, mmc1->control);
+	STATE_SAVE(state, mmc1->prg_bank);
+	STATE_SAVE(state, mmc1->shift_reg_step);
+	STATE_SAVE(state, chr_bank_0);
+	STATE_SAVE(state, chr_bank_1);
+	STATE_SAVE(state, shift_reg);
+
+	/* Save PRG RAM and CHR RAM */
+	state_save(state, mmc1->prg_ram, mmc1->prg_ram_size);
+	if (mmc1->chr_ram)
+		state_save(state, mmc1->chr_ram, CHR_RAM_SIZE);
+}
+
+void mmc1_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct mmc1 *mmc1 = instance->priv_data;
+	uint8_t chr_bank_0 = mmc1->chr_bank_0;
+	uint8_t chr_bank_1 = mmc1->chr_bank_1;
+	uint8_t shift_reg = mmc1->shift_reg;
+
+	/* Restore mapper registers */
+	STATE_LOAD(state, mmc1->control);
+	STATE_LOAD(state, mmc1->prg_bank);
+	STATE_LOAD(state, mmc1->shift_reg_step);
+	STATE_LOAD(state, chr_bank_0);
+	STATE_LOAD(state, chr_bank_1);
+	STATE_LOAD(state, shift_reg);
+	mmc1->chr_bank_0 = chr_bank_0;
+	mmc1->chr_bank_1 = chr_bank_1;
+	mmc1->shift_reg = shift_reg;
+
+	/* Restore PRG RAM and CHR RAM */
+	state_load(state, mmc1->prg_ram, mmc1->prg_ram_size);
+	if (mmc1->chr_ram)
+		state_load(state, mmc1->chr_ram, CHR_RAM_SIZE);
+}
+
 void mmc1_deinit(struct controller_instance *instance)
 {
 	struct mmc1 *mmc1 = instance->priv_data;
@@ -440,6 +496,8 @@ void mmc1_deinit(struct controller_instance *instance)
 CONTROLLER_START(mmc1)
 	.init = mmc1_init,
 	.reset = mmc1_reset,
+	.serialize = mmc1_serialize,
+	.deserialize = mmc1_deserialize,
 	.deinit = mmc1_deinit
 CONTROLLER_END
 
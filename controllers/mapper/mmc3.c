@@ -4,6 +4,7 @@
 #include <controller.h>
 #include <cpu.h>
 #include <env.h>
+#include <event.h>
 #include <file.h>
 #include <memory.h>
 #include <util.h>
@@ -19,6 +20,7 @@
 #define IRQ_DISABLE_ENABLE_END		0x7FFF
 
 #define NUM_BANK_REGISTERS		8
+#define NUM_CHR_BANK_REGISTERS		6
 #define NUM_PRG_ROM_BANKS		4
 #define NUM_CHR_ROM_BANKS		8
 #define PRG_ROM_BANK_SIZE		KB(8)
@@ -59,6 +61,7 @@ struct mmc3 {
 	uint8_t *chr_rom;
 	int prg_rom_size;
 	int chr_rom_size;
+	int prg_ram_size;
 	struct resource bank_sel_data_area;
 	struct resource mirror_protect_area;
 	struct resource irq_latch_reload_area;
@@ -76,6 +79,10 @@ struct mmc3 {
 
 static bool mmc3_init(struct controller_instance *instance);
 static void mmc3_reset(struct controller_instance *instance);
+static void mmc3_serialize(struct controller_instance *instance,
+	struct state *state);
+static void mmc3_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void mmc3_deinit(struct controller_instance *instance);
 static void mirror_address(struct mmc3 *mmc3, address_t *address);
 static void remap_prg_rom(struct mmc3 *mmc3, address_t *address);
@@ -324,9 +331,17 @@ void bank_sel_data_writeb(struct mmc3 *mmc3, uint8_t b, address_t address)
 
 	/* Handle appropriate register */
 	if (bank_select) {
+		/* Notify PPU if CHR banks get inverted */
+		if ((mmc3->bank_sel.raw ^ b) & BIT(7))
+			event_fire("ppu_bus_switch");
+
 		/* Save bank select register */
 		mmc3->bank_sel.raw = b;
 	} else {
+		/* Notify PPU if a CHR bank gets updated */
+		if (mmc3->bank_sel.reg < NUM_CHR_BANK_REGISTERS)
+			event_fire("ppu_bus_switch");
+
 		/* Update bank number based on bank select register */
 		mmc3->regs[mmc3->bank_sel.reg] = b;
 	}
@@ -342,6 +357,9 @@ void mirror_protect_writeb(struct mmc3 *mmc3, uint8_t b, address_t address)
 
 	/* Handle appropriate register */
 	if (mirror) {
+		/* Notify PPU before nametables get remapped */
+		event_fire("ppu_bus_switch");
+
 		/* Update nametable mirroring (0: vertical; 1: horizontal) */
 		mirroring.raw = b;
 		mmc3->horizontal_mirroring = mirroring.nametable_mirroring;
@@ -438,7 +456,8 @@ bool mmc3_init(struct controller_instance *instance)
 	prg_rom_bus_id = res->data.mem.bus_id;
 
 	/* Allocate PRG RAM */
-	mmc3->prg_ram = calloc(PRG_RAM_SIZE(cart_header), sizeof(uint8_t));
+	mmc3->prg_ram_size = PRG_RAM_SIZE(cart_header);
+	mmc3->prg_ram = calloc(mmc3->prg_ram_size, sizeof(uint8_t));
 
 	/* Add CHR ROM region */
 	res = resource_get("chr",
@@ -565,6 +584,47 @@ void mmc3_reset(struct controller_instance *instance)
 	mmc3->irq_enable = false;
 	mmc3->irq_active = false;
 	mmc3->horizontal_mirroring = false;
+
+	/* Scanline counter needs to see PPU bus accesses as they occur */
+	event_fire("ppu_bus_snoop");
+}
+
+void mmc3_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct mmc3 *mmc3 = instance->priv_data;
+
+	/* Save mapper registers */
+	STATE_SAVE(state, mmc3->regs);
+	STATE_SAVE(state, mmc3->bank_sel);
+	STATE_SAVE(state, mmc3->scanline_counter);
+	STATE_SAVE(state, mmc3->scanline_counter_latch);
+	STATE_SAVE(state, mmc3->scanline_counter_reload);
+	STATE_SAVE(state, mmc3->a12_state);
+	STATE_SAVE(state, mmc3->irq_enable);
+	STATE_SAVE(state, mmc3->irq_active);
+	STATE_SAVE(state, mmc3->horizontal_mirroring);
+
+	/* Save PRG RAM */
+	state_save(state, mmc3->prg_ram, mmc3->prg_ram_size);
+}
+
+void mmc3_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct mmc3 *mmc3 = instance->priv_data;
+
+	/* Restore mapper registers */
+	STATE_LOAD(state, mmc3->regs);
+	STATE_LOAD(state, mmc3->bank_sel);
+	STATE_LOAD(state, mmc3->scanline_counter);
+	STATE_LOAD(state, mmc3->scanline_counter_latch);
+	STATE_LOAD(state, mmc3->scanline_counter_reload);
+	STATE_LOAD(state, mmc3->a12_state);
+	STATE_LOAD(state, mmc3->irq_enable);
+	STATE_LOAD(state, mmc3->irq_active);
+	STATE_LOAD(state, mmc3->horizontal_mirroring);
+
+	/* Restore PRG RAM */
+	state_load(state, mmc3->prg_ram, mmc3->prg_ram_size);
 }
 
 void mmc3_deinit(struct controller_instance *instance)
@@ -579,6 +639,8 @@ void mmc3_deinit(struct controller_instance *instance)
 CONTROLLER_START(mmc3)
 	.init = mmc3_init,
 	.reset = mmc3_reset,
+	.serialize = mmc3_serialize,
+	.deserialize = mmc3_deserialize,
 	.deinit = mmc3_deinit
 CONTROLLER_END
 
@@ -12,6 +12,8 @@ struct nrom {
 	int prg_rom_size;
 	int chr_rom_size;
 	bool vertical_mirroring;
+	struct resource prg_rom_area;
+	struct resource prg_rom_mirror;
 	struct region vram_region;
 	struct region prg_rom_region;
 	struct region chr_rom_region;
@@ -24,8 +26,6 @@ static uint16_t vram_readw(struct nrom *nrom, address_t address);
 static void vram_writeb(struct nrom *nrom, uint8_t b, address_t address);
 static void vram_writew(struct nrom *nrom, uint16_t w, address_t address);
 static void mirror_address(struct nrom *nrom, address_t *address);
-static uint8_t prg_rom_readb(struct nrom *nrom, address_t address);
-static uint16_t prg_rom_readw(struct nrom *nrom, address_t address);
 
 static struct mops vram_mops = {
 	.readb = (readb_t)vram_readb,
@@ -34,11 +34,6 @@ static struct mops vram_mops = {
 	.writew = (writew_t)vram_writew
 };
 
-static struct mops prg_rom_mops = {
-	.readb = (readb_t)prg_rom_readb,
-	.readw = (readw_t)prg_rom_readw
-};
-
 uint8_t vram_readb(struct nrom *nrom, address_t address)
 {
 	mirror_address(nrom, &address);
@@ -84,25 +79,6 @@ void mirror_address(struct nrom *nrom, address_t *address)
 	}
 }
 
-uint8_t prg_rom_readb(struct nrom *nrom, address_t address)
-{
-	/* Handle NROM-128 mirroring */
-	address %= nrom->prg_rom_size;
-
-	return *(nrom->prg_rom + address);
-}
-
-uint16_t prg_rom_readw(struct nrom *nrom, address_t address)
-{
-	uint8_t *mem;
-
-	/* Handle NROM-128 mirroring */
-	address %= nrom->prg_rom_size;
-
-	mem = nrom->prg_rom + address;
-	return (*(mem + 1) << 8) | *mem;
-}
-
 bool nrom_init(struct controller_instance *instance)
 {
 	struct nrom *nrom;
@@ -142,14 +118,30 @@ bool nrom_init(struct controller_instance *instance)
 	nrom->prg_rom = file_map(PATH_DATA, path, PRG_ROM_OFFSET(cart_header),
 		nrom->prg_rom_size);
 
-	/* Fill and add PRG ROM region */
+	/* Get PRG ROM area */
 	area = resource_get("prg_rom",
 		RESOURCE_MEM,
 		instance->resources,
 		instance->num_resources);
+
+	/* Handle NROM-128 mirroring by splitting area if needed, leaving PRG
+	ROM as plain ROM (directly accessed by the memory sub-system) */
+	if (nrom->prg_rom_size < (int)MEM_SIZE(area)) {
+		nrom->prg_rom_mirror = *area;
+		nrom->prg_rom_mirror.data.mem.start = area->data.mem.start +
+			nrom->prg_rom_size;
+		nrom->prg_rom_area = *area;
+		nrom->prg_rom_area.data.mem.end =
+			nrom->prg_rom_mirror.data.mem.start - 1;
+		nrom->prg_rom_area.children = &nrom->prg_rom_mirror;
+		nrom->prg_rom_area.num_children = 1;
+		area = &nrom->prg_rom_area;
+	}
+
+	/* Fill and add PRG ROM region */
 	nrom->prg_rom_region.area = area;
-	nrom->prg_rom_region.mops = &prg_rom_mops;
-	nrom->prg_rom_region.data = nrom;
+	nrom->prg_rom_region.mops = &rom_mops;
+	nrom->prg_rom_region.data = nrom->prg_rom;
 	memory_region_add(&nrom->prg_rom_region);
 
 	/* Allocate and fill CHR ROM data */
@@ -23,6 +23,10 @@ struct sega_mapper {
 
 static bool sega_mapper_init(struct controller_instance *instance);
 static void sega_mapper_reset(struct controller_instance *instance);
+static void sega_mapper_serialize(struct controller_instance *instance,
+	struct state *state);
+static void sega_mapper_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void sega_mapper_deinit(struct controller_instance *instance);
 static uint8_t sega_rom_readb(struct sega_mapper *mapper, address_t a);
 static void rom_sel_writeb(struct sega_mapper *mapper,  uint8_t b, address_t a);
@@ -133,6 +137,24 @@ void sega_mapper_reset(struct controller_instance *instance)
 		sega_mapper->rom_banks[i] = i;
 }
 
+void sega_mapper_serialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sega_mapper *sega_mapper = instance->priv_data;
+
+	/* Save ROM bank numbers */
+	STATE_SAVE(state, sega_mapper->rom_banks);
+}
+
+void sega_mapper_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sega_mapper *sega_mapper = instance->priv_data;
+
+	/* Restore ROM bank numbers */
+	STATE_LOAD(state, sega_mapper->rom_banks);
+}
+
 void sega_mapper_deinit(struct controller_instance *instance)
 {
 	struct sega_mapper *sega_mapper = instance->priv_data;
@@ -145,6 +167,8 @@ void sega_mapper_deinit(struct controller_instance *instance)
 CONTROLLER_START(sega_mapper)
 	.init = sega_mapper_init,
 	.reset = sega_mapper_reset,
+	.serialize = sega_mapper_serialize,
+	.deserialize = sega_mapper_deserialize,
 	.deinit = sega_mapper_deinit
 CONTROLLER_END
 
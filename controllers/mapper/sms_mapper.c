@@ -52,6 +52,10 @@ struct sms_mapper {
 
 static bool sms_mapper_init(struct controller_instance *instance);
 static void sms_mapper_reset(struct controller_instance *instance);
+static void sms_mapper_serialize(struct controller_instance *instance,
+	struct state *state);
+static void sms_mapper_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void sms_mapper_deinit(struct controller_instance *instance);
 static void print_header(char *cart_path);
 static void add_mapper(struct controller_instance *instance, char *cart_path);
@@ -213,6 +217,26 @@ void sms_mapper_reset(struct controller_instance *instance)
 	memory_region_add(&sms_mapper->bios_region);
 }
 
+void sms_mapper_serialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sms_mapper *sms_mapper = instance->priv_data;
+
+	/* Save slot control register */
+	STATE_SAVE(state, sms_mapper->slot_control);
+}
+
+void sms_mapper_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct sms_mapper *sms_mapper = instance->priv_data;
+	union slot_control slot_control = sms_mapper->slot_control;
+
+	/* Restore slot control register (updating mapped slots) */
+	STATE_LOAD(state, slot_control);
+	ctrl_writeb(sms_mapper, slot_control.raw);
+}
+
 void sms_mapper_deinit(struct controller_instance *instance)
 {
 	struct sms_mapper *sms_mapper = instance->priv_data;
@@ -227,6 +251,8 @@ void sms_mapper_deinit(struct controller_instance *instance)
 CONTROLLER_START(sms_mapper)
 	.init = sms_mapper_init,
 	.reset = sms_mapper_reset,
+	.serialize = sms_mapper_serialize,
+	.deserialize = sms_mapper_deserialize,
 	.deinit = sms_mapper_deinit
 CONTROLLER_END
 
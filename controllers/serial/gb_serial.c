@@ -37,6 +37,10 @@ struct serial {
 
 static bool serial_init(struct controller_instance *instance);
 static void serial_reset(struct controller_instance *instance);
+static void serial_serialize(struct controller_instance *instance,
+	struct state *state);
+static void serial_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void serial_deinit(struct controller_instance *instance);
 static uint8_t serial_readb(struct serial *serial, address_t address);
 static void serial_writeb(struct serial *serial, uint8_t b, address_t address);
@@ -69,8 +73,9 @@ void serial_writeb(struct serial *serial, uint8_t b, address_t address)
 		serial->sc = sc;
 
 		/* Enable/disable clock based on transfer state and type */
-		serial->clock.enabled = serial->sc.transfer_start_flag &&
-			(serial->sc.shift_clock == INTERNAL_CLOCK);
+		clock_set_enabled(&serial->clock,
+			serial->sc.transfer_start_flag &&
+			(serial->sc.shift_clock == INTERNAL_CLOCK));
 		break;
 	}
 }
@@ -88,7 +93,7 @@ void serial_tick(struct serial *serial)
 
 	/* Consume one clock cycle and disable clock */
 	clock_consume(1);
-	serial->clock.enabled = false;
+	clock_set_enabled(&serial->clock, false);
 }
 
 bool serial_init(struct controller_instance *instance)
@@ -144,6 +149,23 @@ void serial_reset(struct controller_instance *instance)
 	serial->clock.enabled = false;
 }
 
+void serial_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct serial *serial = instance->priv_data;
+
+	/* Save serial registers */
+	STATE_SAVE(state, serial->regs);
+}
+
+void serial_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct serial *serial = instance->priv_data;
+
+	/* Restore serial registers */
+	STATE_LOAD(state, serial->regs);
+}
+
 void serial_deinit(struct controller_instance *instance)
 {
 	free(instance->priv_data);
@@ -152,6 +174,8 @@ void serial_deinit(struct controller_instance *instance)
 CONTROLLER_START(gb_serial)
 	.init = serial_init,
 	.reset = serial_reset,
+	.serialize = serial_serialize,
+	.deserialize = serial_deserialize,
 	.deinit = serial_deinit
 CONTROLLER_END
 
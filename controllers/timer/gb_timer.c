@@ -44,6 +44,10 @@ struct timer {
 
 static bool timer_init(struct controller_instance *instance);
 static void timer_reset(struct controller_instance *instance);
+static void timer_serialize(struct controller_instance *instance,
+	struct state *state);
+static void timer_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void timer_deinit(struct controller_instance *instance);
 static uint8_t timer_readb(struct timer *timer, address_t address);
 static void timer_writeb(struct timer *timer, uint8_t b, address_t address);
@@ -91,7 +95,7 @@ void timer_writeb(struct timer *timer, uint8_t b, address_t address)
 		timer->tac.value = tac.value;
 
 		/* Enable/disable TIMA clock */
-		timer->tima_clock.enabled = timer->tac.timer_enable;
+		clock_set_enabled(&timer->tima_clock, timer->tac.timer_enable);
 		break;
 	}
 }
@@ -185,6 +189,23 @@ void timer_reset(struct controller_instance *instance)
 	timer->tima_clock.enabled = false;
 }
 
+void timer_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct timer *timer = instance->priv_data;
+
+	/* Save timer registers */
+	STATE_SAVE(state, timer->regs);
+}
+
+void timer_deserialize(struct controller_instance *instance,
+	struct state *state)
+{
+	struct timer *timer = instance->priv_data;
+
+	/* Restore timer registers */
+	STATE_LOAD(state, timer->regs);
+}
+
 void timer_deinit(struct controller_instance *instance)
 {
 	free(instance->priv_data);
@@ -193,6 +214,8 @@ void timer_deinit(struct controller_instance *instance)
 CONTROLLER_START(gb_timer)
 	.init = timer_init,
 	.reset = timer_reset,
+	.serialize = timer_serialize,
+	.deserialize = timer_deserialize,
 	.deinit = timer_deinit
 CONTROLLER_END
 
@@ -4,6 +4,7 @@
 #include <clock.h>
 #include <controller.h>
 #include <cpu.h>
+#include <log.h>
 #include <memory.h>
 #include <util.h>
 #include <video.h>
@@ -30,6 +31,7 @@
 #define NUM_LINES		154
 #define NUM_CYCLES_PER_LINE	456
 #define OAM_ADDRESS		0xFE00
+#define VRAM_ADDRESS		0x8000
 #define DMA_TRANSFER_SIZE	160
 #define TILE_MAP_ADDRESS_1	0x9800
 #define TILE_MAP_ADDRESS_2	0x9C00
@@ -45,6 +47,11 @@
 #define SPRITE_TILE_MASK	0xFE
 #define SPRITE_OFFSET_X		8
 #define SPRITE_OFFSET_Y		16
+#define NUM_SHADES		4
+#define NUM_SPREAD_VALUES	256
+
+/* Decoded tile rows hold 8 2-bit pixels (leftmost pixel in top bits) */
+#define ROW_PIXEL(row, i)	(((row) >> (14 - 2 * (i))) & 0x03)
 
 /* LCDC events (sorted by priority) */
 #define EVENT_SET_COINCIDENCE	BIT(0)
@@ -122,6 +129,9 @@ struct lcdc {
 	int vblank_scanline[NUM_CYCLES_PER_LINE];
 	int idle_scanline[NUM_CYCLES_PER_LINE];
 	bool line_mask[LCD_WIDTH];
+	uint16_t spread[NUM_SPREAD_VALUES];
+	uint8_t *vram;
+	uint8_t *oam;
 	int bus_id;
 	struct region region;
 	struct clock clock;
@@ -133,14 +143,21 @@ typedef void (*lcdc_event_t)(struct lcdc *lcdc);
 
 static bool lcdc_init(struct controller_instance *instance);
 static void lcdc_reset(struct controller_instance *instance);
+static void lcdc_serialize(struct controller_instance *instance,
+	struct state *state);
+static void lcdc_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void lcdc_deinit(struct controller_instance *instance);
 static void lcdc_tick(struct lcdc *lcdc);
 static void lcdc_update_counters(struct lcdc *lcdc);
 static void lcdc_set_events(struct lcdc *lcdc);
 static uint8_t lcdc_readb(struct lcdc *lcdc, address_t address);
 static void lcdc_writeb(struct lcdc *lcdc, uint8_t b, address_t address);
+static void lcdc_build_spread(struct lcdc *lcdc);
+static uint16_t lcdc_fetch_row(struct lcdc *lcdc, uint16_t address);
 static void lcdc_draw_line(struct lcdc *lcdc, bool background);
 static void lcdc_draw_sprite_line(struct lcdc *lcdc, struct sprite *sprite);
+static void lcdc_draw_scanline(struct lcdc *lcdc);
 static int compare_sprites(const void *s1, const void *s2);
 static void lcdc_set_coincidence(struct lcdc *lcdc);
 static void lcdc_mode_0(struct lcdc *lcdc);
@@ -199,24 +216,48 @@ void lcdc_writeb(struct lcdc *lcdc, uint8_t b, address_t address)
 	}
 }
 
+void lcdc_build_spread(struct lcdc *lcdc)
+{
+	uint16_t w;
+	int b;
+
+	/* Move each bit of a bitplane byte to the low bit of a 2-bit pixel
+	(interleaving both bitplanes then only takes two lookups) */
+	for (b = 0; b < NUM_SPREAD_VALUES; b++) {
+		w = b;
+		w = (w | (w << 4)) & 0x0F0F;
+		w = (w | (w << 2)) & 0x3333;
+		w = (w | (w << 1)) & 0x5555;
+		lcdc->spread[b] = w;
+	}
+}
+
+uint16_t lcdc_fetch_row(struct lcdc *lcdc, uint16_t address)
+{
+	uint8_t *data = &lcdc->vram[address - VRAM_ADDRESS];
+
+	/* Decode both bitplanes of tile row into packed pixels */
+	return lcdc->spread[data[0]] | (lcdc->spread[data[1]] << 1);
+}
+
 void lcdc_draw_line(struct lcdc *lcdc, bool background)
 {
 	bool map_sel;
 	int16_t x_off;
 	int16_t y_off;
 	uint16_t tile_index_base;
-	uint16_t tile_index_addr;
 	uint16_t tile_data_base;
 	uint16_t tile_data_addr;
+	uint8_t *tile_map;
 	uint8_t tile_index;
-	uint8_t tile_data[2];
-	uint8_t bits[2];
+	uint16_t row;
 	uint8_t palette_index;
 	uint8_t x;
 	uint8_t start_x;
-	uint8_t sh;
-	uint8_t shade;
-	struct color color;
+	uint8_t col;
+	uint8_t i;
+	uint8_t shades[NUM_SHADES];
+	uint8_t *line = video_get_line(lcdc->v);
 
 	/* Return if window line does not need to be drawn */
 	if (!background && (lcdc->wy > lcdc->ly))
@@ -235,10 +276,11 @@ void lcdc_draw_line(struct lcdc *lcdc, bool background)
 	map_sel = background ? lcdc->ctrl.bg_tile_map_display_select :
 		lcdc->ctrl.window_tile_map_display_select;
 
-	/* Set tile index base depending on map selection and current line */
+	/* Set tile map row depending on map selection and current line */
 	tile_index_base = map_sel ? TILE_MAP_ADDRESS_2 : TILE_MAP_ADDRESS_1;
 	tile_index_base += ((uint8_t)(lcdc->ly + y_off) / TILE_HEIGHT) *
 		NUM_TILES_PER_LINE;
+	tile_map = &lcdc->vram[tile_index_base - VRAM_ADDRESS];
 
 	/* Set tile data base depending on data selection and current line */
 	tile_data_base = lcdc->ctrl.bg_and_window_tile_data_select ?
@@ -246,14 +288,18 @@ void lcdc_draw_line(struct lcdc *lcdc, bool background)
 	tile_data_base += ((lcdc->ly + y_off) % TILE_HEIGHT) *
 		(TILE_SIZE / TILE_WIDTH);
 
-	/* Draw line */
-	for (x = start_x; x < LCD_WIDTH; x++) {
-		/* Set tile index address according to current column */
-		tile_index_addr = tile_index_base;
-		tile_index_addr += (uint8_t)(x + x_off) / TILE_WIDTH;
+	/* Resolve palette shades (used as frame buffer color indices) */
+	for (palette_index = 0; palette_index < NUM_SHADES; palette_index++)
+		shades[palette_index] = bitops_getb(&lcdc->bgp,
+			palette_index * 2,
+			2);
 
-		/* Get tile index from memory */
-		tile_index = memory_readb(lcdc->bus_id, tile_index_addr);
+	/* Draw line tile by tile (starting within first tile) */
+	x = start_x;
+	col = x + x_off;
+	while (x < LCD_WIDTH) {
+		/* Get tile index from tile map */
+		tile_index = tile_map[col / TILE_WIDTH];
 
 		/* Set tile data address according to current tile index and
 		data selection bit (first tile map indices are signed) */
@@ -261,28 +307,22 @@ void lcdc_draw_line(struct lcdc *lcdc, bool background)
 		tile_data_addr += lcdc->ctrl.bg_and_window_tile_data_select ?
 			tile_index * TILE_SIZE : (int8_t)tile_index * TILE_SIZE;
 
-		/* Get tile data from memory */
-		tile_data[0] = memory_readb(lcdc->bus_id, tile_data_addr);
-		tile_data[1] = memory_readb(lcdc->bus_id, tile_data_addr + 1);
+		/* Decode tile row */
+		row = lcdc_fetch_row(lcdc, tile_data_addr);
 
-		/* Set data shift based on current column */
-		sh = TILE_WIDTH - ((uint8_t)(x + x_off) % TILE_WIDTH) - 1;
+		/* Draw tile pixels until end of tile or line */
+		for (i = col % TILE_WIDTH;
+			(i < TILE_WIDTH) && (x < LCD_WIDTH);
+			i++, x++, col++) {
+			palette_index = ROW_PIXEL(row, i);
 
-		/* Get appropriate data bits and compute palette index */
-		bits[0] = bitops_getb(&tile_data[0], sh, 1);
-		bits[1] = bitops_getb(&tile_data[1], sh, 1);
-		palette_index = bits[0] | (bits[1] << 1);
+			/* Update background line mask if needed */
+			if (background)
+				lcdc->line_mask[x] = (palette_index != 0);
 
-		/* Update background line mask if needed */
-		if (background)
-			lcdc->line_mask[x] = (palette_index != 0);
-
-		/* Compute color based on palette index and draw pixel */
-		shade = bitops_getb(&lcdc->bgp, palette_index * 2, 2);
-		color.r = R(shade);
-		color.g = G(shade);
-		color.b = B(shade);
-		video_set_pixel(x, lcdc->v, color);
+			/* Draw pixel based on palette index */
+			line[x] = shades[palette_index];
+		}
 	}
 }
 
@@ -292,17 +332,14 @@ void lcdc_draw_sprite_line(struct lcdc *lcdc, struct sprite *sprite)
 	uint8_t tile_a_index;
 	uint8_t tile_b_index;
 	uint16_t tile_data_addr;
-	uint8_t tile_data[2];
-	uint8_t bits[2];
+	uint16_t row;
 	uint8_t palette_index;
 	uint8_t obp;
 	int16_t screen_x;
 	uint8_t x;
 	uint8_t y;
-	uint8_t sh;
-	uint8_t shade;
 	bool flip;
-	struct color color;
+	uint8_t *line = video_get_line(lcdc->v);
 
 	/* Set tile index */
 	tile_index = sprite->pattern_number;
@@ -333,9 +370,8 @@ void lcdc_draw_sprite_line(struct lcdc *lcdc, struct sprite *sprite)
 	tile_data_addr = TILE_DATA_ADDRESS_2 + tile_index * TILE_SIZE;
 	tile_data_addr += (y % TILE_HEIGHT) * (TILE_SIZE / TILE_WIDTH);
 
-	/* Get tile data from memory */
-	tile_data[0] = memory_readb(lcdc->bus_id, tile_data_addr);
-	tile_data[1] = memory_readb(lcdc->bus_id, tile_data_addr + 1);
+	/* Decode tile row */
+	row = lcdc_fetch_row(lcdc, tile_data_addr);
 
 	/* Set palette based on sprite palette number */
 	obp = sprite->flags.palette_number ? lcdc->obp1 : lcdc->obp0;
@@ -354,24 +390,15 @@ void lcdc_draw_sprite_line(struct lcdc *lcdc, struct sprite *sprite)
 		if (sprite->flags.priority && lcdc->line_mask[screen_x])
 			continue;
 
-		/* Set data shift based on current column */
-		sh = TILE_WIDTH - (x % TILE_WIDTH) - 1;
-
-		/* Get appropriate data bits and compute palette index */
-		bits[0] = bitops_getb(&tile_data[0], sh, 1);
-		bits[1] = bitops_getb(&tile_data[1], sh, 1);
-		palette_index = bits[0] | (bits[1] << 1);
+		/* Get palette index from decoded row */
+		palette_index = ROW_PIXEL(row, x);
 
 		/* Skip pixel if transparent */
 		if (palette_index == 0)
 			continue;
 
-		/* Compute color based on palette index and draw pixel */
-		shade = bitops_getb(&obp, palette_index * 2, 2);
-		color.r = R(shade);
-		color.g = G(shade);
-		color.b = B(shade);
-		video_set_pixel(screen_x, lcdc->v, color);
+		/* Draw pixel based on palette shade */
+		line[screen_x] = bitops_getb(&obp, palette_index * 2, 2);
 	}
 }
 
@@ -409,20 +436,16 @@ void lcdc_set_coincidence(struct lcdc *lcdc)
 		cpu_interrupt(lcdc->lcdc_irq);
 }
 
-void lcdc_mode_0(struct lcdc *lcdc)
+void lcdc_draw_scanline(struct lcdc *lcdc)
 {
 	struct sprite sprites[NUM_SPRITES];
 	struct sprite *sprite;
 	int num_sprites = 0;
-	int bus_id = lcdc->bus_id;
-	uint16_t addr;
+	uint8_t *oam = lcdc->oam;
 	uint8_t height;
 	int16_t y;
 	int i;
 
-	/* Update mode */
-	lcdc->stat.mode_flag = 0;
-
 	/* Reset background line mask and draw background if needed */
 	memset(lcdc->line_mask, 0, LCD_WIDTH * sizeof(bool));
 	if (lcdc->ctrl.bg_display_enable)
@@ -434,17 +457,14 @@ void lcdc_mode_0(struct lcdc *lcdc)
 
 	/* Draw sprites if needed */
 	if (lcdc->ctrl.obj_display_enable) {
-		/* Set first sprite address (OAM base address)*/
-		addr = OAM_ADDRESS;
-
 		/* Fill sprites */
 		for (i = 0; i < NUM_SPRITES; i++) {
-			/* Set sprite pointer and address */
+			/* Set sprite pointer and copy attributes from OAM */
 			sprite = &sprites[num_sprites];
-			sprite->y_pos = memory_readb(bus_id, addr++);
-			sprite->x_pos = memory_readb(bus_id, addr++);
-			sprite->pattern_number = memory_readb(bus_id, addr++);
-			sprite->flags.value = memory_readb(bus_id, addr++);
+			sprite->y_pos = *oam++;
+			sprite->x_pos = *oam++;
+			sprite->pattern_number = *oam++;
+			sprite->flags.value = *oam++;
 
 			/* Compute sprite height based on object size */
 			height = (lcdc->ctrl.obj_size + 1) * TILE_HEIGHT;
@@ -469,6 +489,16 @@ void lcdc_mode_0(struct lcdc *lcdc)
 		for (i = 0; i < num_sprites; i++)
 			lcdc_draw_sprite_line(lcdc, &sprites[i]);
 	}
+}
+
+void lcdc_mode_0(struct lcdc *lcdc)
+{
+	/* Update mode */
+	lcdc->stat.mode_flag = 0;
+
+	/* Draw line unless frame is not presented */
+	if (!video_get_skip())
+		lcdc_draw_scanline(lcdc);
 
 	/* Fire interrupt if needed */
 	if (lcdc->stat.mode_0_hblank_interrupt)
@@ -488,7 +518,6 @@ void lcdc_mode_1(struct lcdc *lcdc)
 		cpu_interrupt(lcdc->lcdc_irq);
 
 	/* Update screen contents */
-	video_unlock();
 	video_update();
 }
 
@@ -500,10 +529,6 @@ void lcdc_mode_2(struct lcdc *lcdc)
 	/* Fire interrupt if needed */
 	if (lcdc->stat.mode_2_oam_interrupt)
 		cpu_interrupt(lcdc->lcdc_irq);
-
-	/* Lock screen at first line */
-	if (lcdc->ly == 0)
-		video_lock();
 }
 
 void lcdc_mode_3(struct lcdc *lcdc)
@@ -589,18 +614,38 @@ bool lcdc_init(struct controller_instance *instance)
 	struct lcdc *lcdc;
 	struct video_specs video_specs;
 	struct resource *res;
+	struct color color;
+	uint8_t shade;
 
 	/* Initialize video frontend */
 	video_specs.width = LCD_WIDTH;
 	video_specs.height = LCD_HEIGHT;
 	video_specs.fps = LCD_REFRESH_RATE;
+	video_specs.num_colors = NUM_SHADES;
 	if (!video_init(&video_specs))
 		return false;
 
+	/* Map shades to native colors (shades are used as color indices) */
+	for (shade = 0; shade < NUM_SHADES; shade++) {
+		color.r = R(shade);
+		color.g = G(shade);
+		color.b = B(shade);
+		video_set_color(shade, color);
+	}
+
 	/* Allocate LCDC structure */
 	instance->priv_data = calloc(1, sizeof(struct lcdc));
 	lcdc = instance->priv_data;
 
+	/* Get VRAM and OAM host memory (machine memory is mapped by now) */
+	lcdc->vram = memory_get_host(instance->bus_id, VRAM_ADDRESS);
+	lcdc->oam = memory_get_host(instance->bus_id, OAM_ADDRESS);
+	if (!lcdc->vram || !lcdc->oam) {
+		LOG_E("Could not get VRAM and OAM host memory!\n");
+		free(lcdc);
+		return false;
+	}
+
 	/* Add LCDC memory region */
 	res = resource_get("mem",
 		RESOURCE_MEM,
@@ -638,8 +683,9 @@ bool lcdc_init(struct controller_instance *instance)
 		instance->num_resources);
 	lcdc->lcdc_irq = res->data.irq;
 
-	/* Prepare frame events */
+	/* Prepare frame events and tile row decode table */
 	lcdc_set_events(lcdc);
+	lcdc_build_spread(lcdc);
 
 	return true;
 }
@@ -659,6 +705,28 @@ void lcdc_reset(struct controller_instance *instance)
 	lcdc->clock.enabled = true;
 }
 
+void lcdc_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct lcdc *lcdc = instance->priv_data;
+
+	/* Save LCDC state */
+	STATE_SAVE(state, lcdc->regs);
+	STATE_SAVE(state, lcdc->h);
+	STATE_SAVE(state, lcdc->v);
+	STATE_SAVE(state, lcdc->line_mask);
+}
+
+void lcdc_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct lcdc *lcdc = instance->priv_data;
+
+	/* Restore LCDC state */
+	STATE_LOAD(state, lcdc->regs);
+	STATE_LOAD(state, lcdc->h);
+	STATE_LOAD(state, lcdc->v);
+	STATE_LOAD(state, lcdc->line_mask);
+}
+
 void lcdc_deinit(struct controller_instance *instance)
 {
 	free(instance->priv_data);
@@ -667,6 +735,8 @@ void lcdc_deinit(struct controller_instance *instance)
 CONTROLLER_START(lcdc)
 	.init = lcdc_init,
 	.reset = lcdc_reset,
+	.serialize = lcdc_serialize,
+	.deserialize = lcdc_deserialize,
 	.deinit = lcdc_deinit
 CONTROLLER_END
 
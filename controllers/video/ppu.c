@@ -6,6 +6,7 @@
 #include <clock.h>
 #include <controller.h>
 #include <cpu.h>
+#include <event.h>
 #include <memory.h>
 #include <resource.h>
 #include <video.h>
@@ -39,11 +40,19 @@
 #define BG_PALETTE_START	0x3F00
 #define SPRITE_PALETTE_START	0x3F10
 #define TILE_SIZE		16
+#define CHR_SIZE		0x2000
+#define NUM_CHR_ROWS		(CHR_SIZE / 2)
 #define NUM_PALETTE_ENTRIES	4
 #define NUM_CHROMA_VALUES	16
 #define NUM_LUMA_VALUES		4
+#define NUM_COLORS		64
+#define NUM_EMPHASIS_VALUES	8
+#define GREYSCALE_MASK		0x30
+#define EMPHASIS_ATTENUATION	209
 #define NUM_SPRITES		64
 #define NUM_SPRITES_PER_LINE	8
+#define LINE_RENDER_START	1
+#define LINE_RENDER_END		257
 
 /* PPU events sorted by priority */
 #define EVENT_OUTPUT		BIT(0)
@@ -64,6 +73,27 @@
 #define EVENT_SPRITE_EVAL	BIT(15)
 #define EVENT_FETCH_SPRITE	BIT(16)
 
+/* Events handled by line renderer (from start to end of line rendering) */
+#define LINE_EVENTS \
+	(EVENT_OUTPUT | EVENT_SHIFT_BG | EVENT_SHIFT_SPR | EVENT_RELOAD_BG | \
+	EVENT_FETCH_NT | EVENT_FETCH_AT | EVENT_FETCH_LOW_BG | \
+	EVENT_FETCH_HIGH_BG | EVENT_LOOPY_INC_HORI_V | \
+	EVENT_LOOPY_INC_VERT_V | EVENT_SEC_OAM_CLEAR | EVENT_SPRITE_EVAL)
+
+/* Line renderer pixels (2-bit color, 2-bit palette, and sprite flags) */
+#define PIXEL_COLOR(p)		((p) & 0x03)
+#define PIXEL_PALETTE(p)	(((p) >> 2) & 0x03)
+#define PIXEL_BEHIND_BG		BIT(4)
+#define PIXEL_SPRITE_0		BIT(5)
+
+/* Decoded tile rows (2-bit pixels packed from left to right, MSB first) */
+#define ROW_PIXEL(row, i)	(((row) >> (14 - 2 * (i))) & 0x03)
+#define ROW_LOW_PLANE		0x5555
+#define CHR_ROW(address)	(((address) / TILE_SIZE) * TILE_HEIGHT + \
+					((address) % TILE_HEIGHT))
+#define CHR_A12(address)	(((address) & BIT(12)) != 0)
+#define CHR_A12_UNKNOWN		-1
+
 union ppu_ctrl {
 	uint8_t value;
 	struct {
@@ -163,15 +193,13 @@ union ppu_sprite {
 struct ppu_render_data {
 	uint8_t nt;
 	uint8_t at:2;
-	uint8_t bg_low;
-	uint8_t bg_high;
-	uint16_t shift_bg_low;
-	uint16_t shift_bg_high;
+	uint16_t bg_addr;
+	uint16_t bg_row;
+	uint32_t shift_bg;
 	uint8_t attr_latch:2;
 	uint8_t shift_at_low;
 	uint8_t shift_at_high;
-	uint8_t shift_spr_low[NUM_SPRITES_PER_LINE];
-	uint8_t shift_spr_high[NUM_SPRITES_PER_LINE];
+	uint16_t shift_spr[NUM_SPRITES_PER_LINE];
 	uint8_t spr_attr_latches[NUM_SPRITES_PER_LINE];
 	uint8_t x_counters[NUM_SPRITES_PER_LINE];
 };
@@ -192,6 +220,9 @@ struct ppu {
 	int sprite_counter;
 	bool spr_0_evaluated;
 	bool spr_0_fetched;
+	bool line_deferred;
+	bool bus_snooped;
+	int chr_a12;
 	int *events[NUM_SCANLINES];
 	int visible_line[NUM_DOTS];
 	int vblank_line[NUM_DOTS];
@@ -202,6 +233,9 @@ struct ppu {
 	uint8_t oam[OAM_SIZE];
 	uint8_t sec_oam[SEC_OAM_SIZE];
 	uint8_t palette[PALETTE_SIZE];
+	uint8_t colors[PALETTE_SIZE];
+	uint16_t chr_cache[NUM_CHR_ROWS];
+	bool chr_cached[NUM_CHR_ROWS];
 	int bus_id;
 	int irq;
 	struct region region;
@@ -212,15 +246,34 @@ typedef void (*ppu_event_t)(struct ppu *ppu);
 
 static bool ppu_init(struct controller_instance *instance);
 static void ppu_reset(struct controller_instance *instance);
+static void ppu_serialize(struct controller_instance *instance,
+	struct state *state);
+static void ppu_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void ppu_deinit(struct controller_instance *instance);
 static void ppu_tick(struct ppu *ppu);
+static void ppu_fire_events(struct ppu *ppu, int event_mask);
+static bool ppu_can_defer(struct ppu *ppu);
+static void ppu_sync(struct ppu *ppu);
+static void ppu_snoop(struct ppu *ppu);
+static void ppu_bus_switch(struct ppu *ppu);
+static uint16_t ppu_spread(uint8_t b);
+static uint16_t ppu_flip_row(uint16_t row);
+static uint8_t ppu_read_chr(struct ppu *ppu, address_t address);
+static void ppu_snoop_chr(struct ppu *ppu, address_t address);
+static uint16_t ppu_fetch_row(struct ppu *ppu, address_t address);
+static void ppu_render_bg(struct ppu *ppu, uint8_t *pixels);
+static void ppu_render_spr(struct ppu *ppu, uint8_t *pixels);
+static void ppu_render_line(struct ppu *ppu);
 static void ppu_update_counters(struct ppu *ppu);
 static void ppu_set_events(struct ppu *ppu);
 static void ppu_build_pre_render_line(struct ppu *ppu);
 static void ppu_build_visible_line(struct ppu *ppu);
 static void ppu_build_vblank_line(struct ppu *ppu);
-static uint8_t palette_readb(uint8_t *ram, address_t address);
-static void palette_writeb(uint8_t *ram, uint8_t b, address_t address);
+static void ppu_update_colors(struct ppu *ppu);
+static void ppu_set_colors();
+static uint8_t palette_readb(struct ppu *ppu, address_t address);
+static void palette_writeb(struct ppu *ppu, uint8_t b, address_t address);
 static uint8_t ppu_readb(struct ppu *ppu, address_t address);
 static void ppu_writeb(struct ppu *ppu, uint8_t b, address_t address);
 static void ppu_output(struct ppu *ppu);
@@ -314,7 +367,49 @@ static struct color ppu_palette[NUM_LUMA_VALUES][NUM_CHROMA_VALUES] = {
 	}
 };
 
-uint8_t palette_readb(uint8_t *ram, address_t address)
+void ppu_update_colors(struct ppu *ppu)
+{
+	uint8_t mask;
+	uint8_t address;
+
+	/* Greyscale mode only keeps luma bits of palette entries */
+	mask = ppu->mask.greyscale ? GREYSCALE_MASK : NUM_COLORS - 1;
+
+	/* Resolve frame buffer color index of each palette address */
+	for (address = 0; address < PALETTE_SIZE; address++)
+		ppu->colors[address] = palette_readb(ppu, address) & mask;
+}
+
+void ppu_set_colors()
+{
+	union ppu_palette_entry entry;
+	struct color color;
+	int emphasis;
+	int index;
+
+	/* Fill palette LUT with every emphasis variant of each color (each
+	emphasis bit attenuates the two other channels) */
+	for (emphasis = 0; emphasis < NUM_EMPHASIS_VALUES; emphasis++)
+		for (index = 0; index < NUM_COLORS; index++) {
+			entry.value = index;
+			color = ppu_palette[entry.luma][entry.chroma];
+			if (emphasis & BIT(0)) {
+				color.g = color.g * EMPHASIS_ATTENUATION >> 8;
+				color.b = color.b * EMPHASIS_ATTENUATION >> 8;
+			}
+			if (emphasis & BIT(1)) {
+				color.r = color.r * EMPHASIS_ATTENUATION >> 8;
+				color.b = color.b * EMPHASIS_ATTENUATION >> 8;
+			}
+			if (emphasis & BIT(2)) {
+				color.r = color.r * EMPHASIS_ATTENUATION >> 8;
+				color.g = color.g * EMPHASIS_ATTENUATION >> 8;
+			}
+			video_set_color(emphasis * NUM_COLORS + index, color);
+		}
+}
+
+uint8_t palette_readb(struct ppu *ppu, address_t address)
 {
 	/* Addresses 0x3F10, 0x3F14, 0x3F18, 0x3F1C are mirrors of
 	0x3F00, 0x3F04, 0x3F08, 0x3F0C */
@@ -330,10 +425,10 @@ uint8_t palette_readb(uint8_t *ram, address_t address)
 	}
 
 	/* Read palette entry */
-	return ram[address];
+	return ppu->palette[address];
 }
 
-void palette_writeb(uint8_t *ram, uint8_t b, address_t address)
+void palette_writeb(struct ppu *ppu, uint8_t b, address_t address)
 {
 	/* Addresses 0x3F10, 0x3F14, 0x3F18, 0x3F1C are mirrors of
 	0x3F00, 0x3F04, 0x3F08, 0x3F0C */
@@ -348,14 +443,19 @@ void palette_writeb(uint8_t *ram, uint8_t b, address_t address)
 		break;
 	}
 
-	/* Read palette entry */
-	ram[address] = b;
+	/* Write palette entry and update color indices */
+	ppu->palette[address] = b;
+	ppu_update_colors(ppu);
 }
 
 uint8_t ppu_readb(struct ppu *ppu, address_t address)
 {
+	address_t vram_address;
 	uint8_t b;
 
+	/* Catch up with deferred line before accessing registers */
+	ppu_sync(ppu);
+
 	switch (address) {
 	case PPUSTATUS:
 		/* w: = 0 */
@@ -369,8 +469,10 @@ uint8_t ppu_readb(struct ppu *ppu, address_t address)
 	case PPUDATA:
 		/* Read from VRAM incrementing address accordingly */
 		b = ppu->vram_buffer;
-		ppu->vram_buffer = memory_readb(ppu->bus_id,
-			ppu->vram_addr.value);
+		vram_address = ppu->vram_addr.value;
+		ppu->vram_buffer = (vram_address < CHR_SIZE) ?
+			ppu_read_chr(ppu, vram_address) :
+			memory_readb(ppu->bus_id, vram_address);
 		ppu->vram_addr.value += ppu->ctrl.vram_addr_increment ? 32 : 1;
 		if (ppu->vram_addr.value >= BG_PALETTE_START)
 			b = ppu->vram_buffer;
@@ -382,8 +484,12 @@ uint8_t ppu_readb(struct ppu *ppu, address_t address)
 
 void ppu_writeb(struct ppu *ppu, uint8_t b, address_t address)
 {
+	address_t vram_address;
 	uint16_t t;
 
+	/* Catch up with deferred line before accessing registers */
+	ppu_sync(ppu);
+
 	switch (address) {
 	case PPUCTRL:
 		/* Write register */
@@ -394,8 +500,9 @@ void ppu_writeb(struct ppu *ppu, uint8_t b, address_t address)
 		ppu->temp_vram_addr.v_nametable = bitops_getb(&b, 1, 1);
 		break;
 	case PPUMASK:
-		/* Write register */
+		/* Write register and update color indices (greyscale) */
 		ppu->mask.value = b;
+		ppu_update_colors(ppu);
 		break;
 	case OAMADDR:
 		/* Write register */
@@ -451,8 +558,12 @@ void ppu_writeb(struct ppu *ppu, uint8_t b, address_t address)
 		}
 		break;
 	case PPUDATA:
-		/* Write to VRAM incrementing address accordingly */
-		memory_writeb(ppu->bus_id, b, ppu->vram_addr.value);
+		/* Write to VRAM incrementing address accordingly (dropping any
+		decoded tile row CHR RAM writes might affect) */
+		vram_address = ppu->vram_addr.value;
+		memory_writeb(ppu->bus_id, b, vram_address);
+		if (vram_address < CHR_SIZE)
+			ppu->chr_cached[CHR_ROW(vram_address)] = false;
 		ppu->vram_addr.value += ppu->ctrl.vram_addr_increment ? 32 : 1;
 		break;
 	default:
@@ -464,8 +575,7 @@ void ppu_output(struct ppu *ppu)
 {
 	struct ppu_render_data *r = &ppu->render_data;
 	union ppu_sprite_attributes attributes;
-	union ppu_palette_entry entry;
-	uint16_t address;
+	uint8_t address;
 	bool bg_priority;
 	bool clipped;
 	bool hit;
@@ -493,9 +603,7 @@ void ppu_output(struct ppu *ppu)
 		bg_palette = l | (h << 1);
 
 		/* Get pattern color */
-		l = bitops_getw(&r->shift_bg_low, 15 - ppu->fine_x_scroll, 1);
-		h = bitops_getw(&r->shift_bg_high, 15 - ppu->fine_x_scroll, 1);
-		bg_color = l | (h << 1);
+		bg_color = ROW_PIXEL(r->shift_bg >> 16, ppu->fine_x_scroll);
 	}
 
 	/* Check if sprite clipping is enabled and must be discarded */
@@ -509,9 +617,7 @@ void ppu_output(struct ppu *ppu)
 				continue;
 
 			/* Get pattern color */
-			l = bitops_getb(&r->shift_spr_low[i], 7, 1);
-			h = bitops_getb(&r->shift_spr_high[i], 7, 1);
-			color = l | (h << 1);
+			color = ROW_PIXEL(r->shift_spr[i], 0);
 
 			/* Skip if pixel is transparent */
 			if (color == 0)
@@ -537,6 +643,10 @@ void ppu_output(struct ppu *ppu)
 			break;
 		}
 
+	/* Leave already if frame is not presented */
+	if (video_get_skip())
+		return;
+
 	/* Handle priority (background or sprite) */
 	bg_priority = true;
 	if ((bg_color == 0) && (sprite_color != 0))
@@ -549,13 +659,13 @@ void ppu_output(struct ppu *ppu)
 	palette = bg_priority ? bg_palette : attributes.palette;
 
 	/* Compute palette entry (color 0 always points to first palette) */
-	address = bg_priority ? BG_PALETTE_START : SPRITE_PALETTE_START;
+	address = bg_priority ? 0 : SPRITE_PALETTE_START - BG_PALETTE_START;
 	if (color != 0)
 		address += NUM_PALETTE_ENTRIES * palette + color;
 
-	/* Set pixel based on palette entry */
-	entry.value = memory_readb(ppu->bus_id, address);
-	video_set_pixel(x, ppu->v, ppu_palette[entry.luma][entry.chroma]);
+	/* Set pixel and line emphasis based on palette entry */
+	video_get_line(ppu->v)[x] = ppu->colors[address];
+	video_set_line_palette(ppu->v, ppu->mask.color_emphasis * NUM_COLORS);
 }
 
 void ppu_shift_bg(struct ppu *ppu)
@@ -568,8 +678,7 @@ void ppu_shift_bg(struct ppu *ppu)
 		return;
 
 	/* Shift background and palette shift registers */
-	r->shift_bg_low <<= 1;
-	r->shift_bg_high <<= 1;
+	r->shift_bg <<= 2;
 	r->shift_at_low <<= 1;
 	r->shift_at_high <<= 1;
 
@@ -590,10 +699,8 @@ void ppu_shift_spr(struct ppu *ppu)
 
 	/* Shift sprite tile registers if needed */
 	for (i = 0; i < NUM_SPRITES_PER_LINE; i++)
-		if (r->x_counters[i] == 0) {
-			r->shift_spr_low[i] <<= 1;
-			r->shift_spr_high[i] <<= 1;
-		}
+		if (r->x_counters[i] == 0)
+			r->shift_spr[i] <<= 2;
 
 	/* Decrement X counters if needed */
 	for (i = 0; i < NUM_SPRITES_PER_LINE; i++)
@@ -609,9 +716,8 @@ void ppu_reload_bg(struct ppu *ppu)
 	if (!ppu->mask.bg_visibility)
 		return;
 
-	/* Load bitmap data into shift registers (lower 8 bits) */
-	bitops_setw(&r->shift_bg_low, 0, 8, r->bg_low);
-	bitops_setw(&r->shift_bg_high, 0, 8, r->bg_high);
+	/* Load tile row into shift register (lower 8 pixels) */
+	r->shift_bg = (r->shift_bg & 0xFFFF0000) | r->bg_row;
 
 	/* Load attribute latch */
 	r->attr_latch = r->at;
@@ -674,6 +780,7 @@ void ppu_fetch_low_bg(struct ppu *ppu)
 {
 	address_t address;
 	struct ppu_render_data *r = &ppu->render_data;
+	uint16_t row;
 
 	/* Return already if BG rendering is not enabled */
 	if (!ppu->mask.bg_visibility)
@@ -684,14 +791,19 @@ void ppu_fetch_low_bg(struct ppu *ppu)
 		PATTERN_TABLE_0_START : PATTERN_TABLE_1_START;
 	address += r->nt * TILE_SIZE + ppu->vram_addr.fine_y_scroll;
 
-	/* Read low BG tile byte */
-	r->bg_low = memory_readb(ppu->bus_id, address);
+	/* Get low BG tile byte from decoded row (both bitplanes being fetched
+	at once, but high byte only being latched by next fetch) */
+	row = ppu_fetch_row(ppu, address);
+	r->bg_row = (r->bg_row & ~ROW_LOW_PLANE) | (row & ROW_LOW_PLANE);
+	r->bg_addr = address;
 }
 
 void ppu_fetch_high_bg(struct ppu *ppu)
 {
 	address_t address;
 	struct ppu_render_data *r = &ppu->render_data;
+	uint16_t row;
+	uint8_t high;
 
 	/* Return already if rendering is not enabled */
 	if (!ppu->mask.bg_visibility)
@@ -702,8 +814,19 @@ void ppu_fetch_high_bg(struct ppu *ppu)
 		PATTERN_TABLE_0_START : PATTERN_TABLE_1_START;
 	address += r->nt * TILE_SIZE + ppu->vram_addr.fine_y_scroll + 8;
 
-	/* Read high BG tile byte */
-	r->bg_high = memory_readb(ppu->bus_id, address);
+	/* Only read high BG tile byte if row changed since low byte fetch */
+	if ((r->bg_addr != address - 8) ||
+		!ppu->chr_cached[CHR_ROW(address)]) {
+		high = ppu_read_chr(ppu, address);
+		r->bg_row &= ROW_LOW_PLANE;
+		r->bg_row |= ppu_spread(high) << 1;
+		return;
+	}
+
+	/* Latch high BG tile byte from decoded row (letting mapper snoop) */
+	ppu_snoop_chr(ppu, address);
+	row = ppu->chr_cache[CHR_ROW(address)];
+	r->bg_row = (r->bg_row & ROW_LOW_PLANE) | (row & ~ROW_LOW_PLANE);
 }
 
 void ppu_vblank_set(struct ppu *ppu)
@@ -714,7 +837,6 @@ void ppu_vblank_set(struct ppu *ppu)
 		cpu_interrupt(ppu->irq);
 
 	/* Update screen contents */
-	video_unlock();
 	video_update();
 }
 
@@ -724,7 +846,6 @@ void ppu_vblank_clear(struct ppu *ppu)
 	ppu->status.vblank_flag = 0;
 	ppu->status.sprite_overflow = 0;
 	ppu->status.sprite_0_hit = 0;
-	video_lock();
 }
 
 void ppu_loopy_inc_hori_v(struct ppu *ppu)
@@ -872,8 +993,7 @@ void ppu_fetch_sprite(struct ppu *ppu)
 	uint16_t address;
 	bool transparent;
 	int index;
-	uint8_t low;
-	uint8_t high;
+	uint16_t row;
 	uint8_t tile_number;
 	uint8_t y;
 	int height;
@@ -930,28 +1050,23 @@ void ppu_fetch_sprite(struct ppu *ppu)
 	address += !sprite->attributes.v_flip ?
 		y % TILE_HEIGHT : (TILE_HEIGHT - (y % TILE_HEIGHT) - 1);
 
-	/* Fetch tile data */
-	low = memory_readb(ppu->bus_id, address);
-	high = memory_readb(ppu->bus_id, address + 8);
+	/* Fetch tile row */
+	row = ppu_fetch_row(ppu, address);
 
-	/* Reverse data on horizontal flip */
-	if (sprite->attributes.h_flip) {
-		low = bitops_reverse(low, 8);
-		high = bitops_reverse(high, 8);
-	}
+	/* Reverse row on horizontal flip */
+	if (sprite->attributes.h_flip)
+		row = ppu_flip_row(row);
 
 	/* Dummy fetches are replaced by transparent data */
 	transparent = (sprite->y == 0xFF);
 	transparent |= ((ppu->v < sprite->y) || (ppu->v >= sprite->y + height));
 	if (transparent) {
-		ppu->render_data.shift_spr_low[index] = 0;
-		ppu->render_data.shift_spr_high[index] = 0;
+		ppu->render_data.shift_spr[index] = 0;
 		return;
 	}
 
-	/* Set tile data into shift registers */
-	ppu->render_data.shift_spr_low[index] = low;
-	ppu->render_data.shift_spr_high[index] = high;
+	/* Set tile row into shift register */
+	ppu->render_data.shift_spr[index] = row;
 }
 
 void ppu_build_pre_render_line(struct ppu *ppu)
@@ -1250,20 +1365,320 @@ void ppu_update_counters(struct ppu *ppu)
 		ppu->h++;
 }
 
-void ppu_tick(struct ppu *ppu)
+void ppu_fire_events(struct ppu *ppu, int event_mask)
 {
-	int event_mask;
 	int pos;
-	int num_cycles = 0;
-
-	/* Get event mask for current cycle */
-	event_mask = ppu->events[ppu->v][ppu->h];
 
 	/* Loop through all events and fire them */
 	while ((pos = bitops_ffs(event_mask))) {
 		ppu_events[pos - 1](ppu);
 		event_mask &= ~BIT(pos - 1);
 	}
+}
+
+void ppu_render_bg(struct ppu *ppu, uint8_t *pixels)
+{
+	struct ppu_render_data *r = &ppu->render_data;
+	uint8_t palette;
+	uint16_t row = 0;
+	uint8_t at = 0;
+	uint8_t l;
+	uint8_t h;
+	int tile;
+	int i;
+
+	/* Unpack both tiles left in shift register by previous line (second
+	tile using latched palette index) */
+	for (i = 0; i < TILE_WIDTH; i++) {
+		l = bitops_getb(&r->shift_at_low, 7 - i, 1);
+		h = bitops_getb(&r->shift_at_high, 7 - i, 1);
+		palette = l | (h << 1);
+		pixels[i] = ROW_PIXEL(r->shift_bg >> 16, i) | (palette << 2);
+		pixels[TILE_WIDTH + i] = ROW_PIXEL(r->shift_bg, i) |
+			(r->attr_latch << 2);
+	}
+
+	/* Fetch and unpack line tiles (accessing memory as dot renderer) */
+	for (tile = 0; tile < SCREEN_WIDTH / TILE_WIDTH; tile++) {
+		/* Keep previous tile data (needed by shift registers) */
+		row = r->bg_row;
+		at = r->at;
+
+		/* Fetch tile and move to next one */
+		ppu_fetch_nt(ppu);
+		ppu_fetch_at(ppu);
+		ppu_fetch_low_bg(ppu);
+		ppu_fetch_high_bg(ppu);
+		ppu_loopy_inc_hori_v(ppu);
+
+		/* Unpack tile pixels (last tile is only shown by next line) */
+		if (tile == SCREEN_WIDTH / TILE_WIDTH - 1)
+			break;
+		for (i = 0; i < TILE_WIDTH; i++)
+			pixels[(tile + 2) * TILE_WIDTH + i] =
+				ROW_PIXEL(r->bg_row, i) | (r->at << 2);
+	}
+
+	/* Move to next line */
+	ppu_loopy_inc_vert_v(ppu);
+
+	/* Leave shift registers as dot renderer would (last tile being
+	reloaded once the previous one got shifted in) */
+	r->shift_bg = ((uint32_t)row << 16) | r->bg_row;
+	r->shift_at_low = (at & BIT(0)) ? 0xFF : 0x00;
+	r->shift_at_high = (at & BIT(1)) ? 0xFF : 0x00;
+	r->attr_latch = r->at;
+}
+
+void ppu_render_spr(struct ppu *ppu, uint8_t *pixels)
+{
+	struct ppu_render_data *r = &ppu->render_data;
+	union ppu_sprite_attributes attributes;
+	uint8_t color;
+	uint8_t flags;
+	int shift;
+	int x;
+	int i;
+	int j;
+
+	/* Draw sprites from last to first (first opaque pixel has priority) */
+	memset(pixels, 0, SCREEN_WIDTH);
+	for (i = NUM_SPRITES_PER_LINE - 1; i >= 0; i--) {
+		/* Get sprite position and pixel flags */
+		attributes.value = r->spr_attr_latches[i];
+		x = r->x_counters[i];
+		flags = attributes.palette << 2;
+		if (attributes.priority)
+			flags |= PIXEL_BEHIND_BG;
+		if (i == 0)
+			flags |= PIXEL_SPRITE_0;
+
+		/* Draw opaque pixels */
+		for (j = 0; (j < TILE_WIDTH) && (x + j < SCREEN_WIDTH); j++) {
+			color = ROW_PIXEL(r->shift_spr[i], j);
+			if (color != 0)
+				pixels[x + j] = color | flags;
+		}
+
+		/* Leave shift registers and X counter as dot renderer would */
+		shift = SCREEN_WIDTH - x;
+		if (shift < TILE_WIDTH)
+			r->shift_spr[i] <<= 2 * shift;
+		else
+			r->shift_spr[i] = 0;
+		r->x_counters[i] = 0;
+	}
+}
+
+void ppu_render_line(struct ppu *ppu)
+{
+	uint8_t bg_pixels[TILE_WIDTH + SCREEN_WIDTH];
+	uint8_t spr_pixels[SCREEN_WIDTH];
+	uint8_t fine_x = ppu->fine_x_scroll;
+	uint8_t *line;
+	bool bg_priority;
+	bool skip;
+	int bg_start;
+	int spr_start;
+	uint8_t bg;
+	uint8_t spr;
+	uint8_t pixel;
+	uint8_t address;
+	int x;
+
+	/* Evaluate sprites for next line */
+	ppu_sec_oam_clear(ppu);
+	ppu_sprite_eval(ppu);
+
+	/* Render background and sprites */
+	if (ppu->mask.bg_visibility)
+		ppu_render_bg(ppu, bg_pixels);
+	if (ppu->mask.sprite_visibility)
+		ppu_render_spr(ppu, spr_pixels);
+
+	/* Select line emphasis if frame is presented */
+	skip = video_get_skip();
+	if (!skip)
+		video_set_line_palette(ppu->v,
+			ppu->mask.color_emphasis * NUM_COLORS);
+	line = video_get_line(ppu->v);
+
+	/* Get first visible pixels (based on rendering and clipping) */
+	bg_start = ppu->mask.bg_show_left_col ? 0 : TILE_WIDTH;
+	if (!ppu->mask.bg_visibility)
+		bg_start = SCREEN_WIDTH;
+	spr_start = ppu->mask.sprite_show_left_col ? 0 : TILE_WIDTH;
+	if (!ppu->mask.sprite_visibility)
+		spr_start = SCREEN_WIDTH;
+
+	/* Mix pixels (following ppu_output logic) */
+	for (x = 0; x < SCREEN_WIDTH; x++) {
+		/* Get background and sprite pixels */
+		bg = (x >= bg_start) ? bg_pixels[x + fine_x] : 0;
+		spr = (x >= spr_start) ? spr_pixels[x] : 0;
+
+		/* Set sprite 0 hit flag if needed */
+		if ((spr & PIXEL_SPRITE_0) && ppu->spr_0_fetched &&
+			(x != SCREEN_WIDTH - 1) && (PIXEL_COLOR(bg) != 0))
+			ppu->status.sprite_0_hit = 1;
+
+		/* Skip mixing if frame is not presented */
+		if (skip)
+			continue;
+
+		/* Handle priority (background or sprite) */
+		bg_priority = (PIXEL_COLOR(spr) == 0);
+		if ((PIXEL_COLOR(bg) != 0) && (spr & PIXEL_BEHIND_BG))
+			bg_priority = true;
+		pixel = bg_priority ? bg : spr;
+
+		/* Compute palette entry (color 0 points to first palette) */
+		address = 0;
+		if (!bg_priority)
+			address = SPRITE_PALETTE_START - BG_PALETTE_START;
+		if (PIXEL_COLOR(pixel) != 0)
+			address += NUM_PALETTE_ENTRIES * PIXEL_PALETTE(pixel) +
+				PIXEL_COLOR(pixel);
+		line[x] = ppu->colors[address];
+	}
+}
+
+bool ppu_can_defer(struct ppu *ppu)
+{
+	/* Only defer visible lines from their first rendering dot */
+	if (ppu->line_deferred ||
+		(ppu->events[ppu->v] != ppu->visible_line) ||
+		(ppu->h != LINE_RENDER_START))
+		return false;
+
+	/* Mappers snooping the PPU bus need to see background fetches raising
+	A12 when they actually occur */
+	return !ppu->bus_snooped ||
+		!ppu->mask.bg_visibility ||
+		!ppu->ctrl.bg_pattern_table_addr;
+}
+
+void ppu_sync(struct ppu *ppu)
+{
+	uint64_t cycle;
+
+	/* Return already if no line is deferred */
+	if (!ppu->line_deferred)
+		return;
+
+	/* Fire events of all dots which were due before current tick (line
+	end being due on next PPU tick) */
+	cycle = clock_get_due(&ppu->clock);
+	cycle -= (LINE_RENDER_END - ppu->h) * ppu->clock.div;
+	while ((ppu->h < LINE_RENDER_END) &&
+		clock_elapsed(&ppu->clock, cycle)) {
+		ppu_fire_events(ppu, ppu->events[ppu->v][ppu->h]);
+		ppu->h++;
+		cycle += ppu->clock.div;
+	}
+
+	/* Fall back to dot renderer for the rest of the line */
+	ppu->line_deferred = false;
+	clock_schedule_at(&ppu->clock, cycle);
+}
+
+void ppu_snoop(struct ppu *ppu)
+{
+	/* Mapper watches PPU bus accesses as they occur */
+	ppu->bus_snooped = true;
+}
+
+void ppu_bus_switch(struct ppu *ppu)
+{
+	/* Catch up with deferred line using previous banks */
+	ppu_sync(ppu);
+
+	/* Drop all decoded tile rows as CHR banks might have changed */
+	memset(ppu->chr_cached, 0, sizeof(ppu->chr_cached));
+}
+
+uint16_t ppu_spread(uint8_t b)
+{
+	uint16_t w = b;
+
+	/* Move each bit of a bitplane byte to the low bit of a 2-bit pixel */
+	w = (w | (w << 4)) & 0x0F0F;
+	w = (w | (w << 2)) & 0x3333;
+	w = (w | (w << 1)) & 0x5555;
+	return w;
+}
+
+uint16_t ppu_flip_row(uint16_t row)
+{
+	/* Reverse pixel order (swapping bytes, nibbles, and pixel pairs) */
+	row = (row >> 8) | (row << 8);
+	row = ((row & 0xF0F0) >> 4) | ((row & 0x0F0F) << 4);
+	row = ((row & 0xCCCC) >> 2) | ((row & 0x3333) << 2);
+	return row;
+}
+
+uint8_t ppu_read_chr(struct ppu *ppu, address_t address)
+{
+	/* Keep track of A12 level last seen by mapper */
+	ppu->chr_a12 = CHR_A12(address);
+	return memory_readb(ppu->bus_id, address);
+}
+
+void ppu_snoop_chr(struct ppu *ppu, address_t address)
+{
+	/* Snooping mappers only react to A12 changes (as the MMC3 scanline
+	counter does), so skipped reads only need to occur when A12 changes */
+	if (ppu->bus_snooped && (ppu->chr_a12 != CHR_A12(address)))
+		ppu_read_chr(ppu, address);
+}
+
+uint16_t ppu_fetch_row(struct ppu *ppu, address_t address)
+{
+	uint16_t *row = &ppu->chr_cache[CHR_ROW(address)];
+	bool *cached = &ppu->chr_cached[CHR_ROW(address)];
+	uint8_t low;
+	uint8_t high;
+
+	/* Return decoded row at once if cached (letting mapper snoop) */
+	if (*cached) {
+		ppu_snoop_chr(ppu, address);
+		return *row;
+	}
+
+	/* Read both bitplanes and interleave them into packed pixels */
+	low = ppu_read_chr(ppu, address);
+	high = ppu_read_chr(ppu, address + 8);
+	*row = ppu_spread(low) | (ppu_spread(high) << 1);
+	*cached = true;
+	return *row;
+}
+
+void ppu_tick(struct ppu *ppu)
+{
+	int event_mask;
+	int num_cycles = 0;
+
+	/* Defer visible line until its last dot, hoping it can be rendered in
+	a single pass (register accesses and bank switches sync it otherwise) */
+	if (ppu_can_defer(ppu)) {
+		ppu->line_deferred = true;
+		clock_consume(LINE_RENDER_END - LINE_RENDER_START);
+		return;
+	}
+
+	/* Get event mask for current cycle, rendering deferred line at once
+	(keeping events of its last dot which line renderer does not handle) */
+	if (ppu->line_deferred) {
+		ppu_render_line(ppu);
+		ppu->line_deferred = false;
+		ppu->h = LINE_RENDER_END;
+		event_mask = ppu->events[ppu->v][ppu->h] & ~LINE_EVENTS;
+	} else {
+		event_mask = ppu->events[ppu->v][ppu->h];
+	}
+
+	/* Fire events */
+	ppu_fire_events(ppu, event_mask);
 
 	/* Update h/v counters until next event is found */
 	do {
@@ -1286,9 +1701,13 @@ bool ppu_init(struct controller_instance *instance)
 	video_specs.width = SCREEN_WIDTH;
 	video_specs.height = SCREEN_HEIGHT;
 	video_specs.fps = SCREEN_REFRESH_RATE;
+	video_specs.num_colors = NUM_EMPHASIS_VALUES * NUM_COLORS;
 	if (!video_init(&video_specs))
 		return false;
 
+	/* Fill palette LUT */
+	ppu_set_colors();
+
 	/* Allocate PPU structure */
 	instance->priv_data = calloc(1, sizeof(struct ppu));
 	ppu = instance->priv_data;
@@ -1310,7 +1729,7 @@ bool ppu_init(struct controller_instance *instance)
 		instance->num_resources);
 	ppu->palette_region.area = res;
 	ppu->palette_region.mops = &palette_mops;
-	ppu->palette_region.data = ppu->palette;
+	ppu->palette_region.data = ppu;
 	memory_region_add(&ppu->palette_region);
 
 	/* Save bus ID for later use */
@@ -1333,6 +1752,11 @@ bool ppu_init(struct controller_instance *instance)
 	ppu->clock.tick = (clock_tick_t)ppu_tick;
 	clock_add(&ppu->clock);
 
+	/* Catch up with deferred line and drop decoded tile rows on mapper
+	bank switches, and keep track of mappers snooping the PPU bus */
+	event_add("ppu_bus_switch", (event_callback_t)ppu_bus_switch, ppu);
+	event_add("ppu_bus_snoop", (event_callback_t)ppu_snoop, ppu);
+
 	/* Prepare frame events */
 	ppu_set_events(ppu);
 
@@ -1352,11 +1776,81 @@ void ppu_reset(struct controller_instance *instance)
 	ppu->h = 0;
 	ppu->v = 261;
 	ppu->sprite_counter = 0;
+	ppu->line_deferred = false;
+	ppu_update_colors(ppu);
+
+	/* Start with empty tile cache and unknown A12 level */
+	memset(ppu->chr_cached, 0, sizeof(ppu->chr_cached));
+	ppu->chr_a12 = CHR_A12_UNKNOWN;
 
 	/* Enable clock */
 	ppu->clock.enabled = true;
 }
 
+void ppu_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct ppu *ppu = instance->priv_data;
+	uint8_t fine_x_scroll = ppu->fine_x_scroll;
+
+	/* Save PPU state */
+	STATE_SAVE(state, ppu->ctrl);
+	STATE_SAVE(state, ppu->mask);
+	STATE_SAVE(state, ppu->status);
+	STATE_SAVE(state, ppu->oam_addr);
+	STATE_SAVE(state, ppu->vram_addr);
+	STATE_SAVE(state, ppu->temp_vram_addr);
+	STATE_SAVE(state, ppu->write_toggle);
+	STATE_SAVE(state, ppu->vram_buffer);
+	STATE_SAVE(state, ppu->odd_frame);
+	STATE_SAVE(state, ppu->h);
+	STATE_SAVE(state, ppu->v);
+	STATE_SAVE(state, ppu->sprite_counter);
+	STATE_SAVE(state, ppu->spr_0_evaluated);
+	STATE_SAVE(state, ppu->spr_0_fetched);
+	STATE_SAVE(state, ppu->line_deferred);
+	STATE_SAVE(state, ppu->render_data);
+	STATE_SAVE(state, ppu->oam);
+	STATE_SAVE(state, ppu->sec_oam);
+	STATE_SAVE(state, ppu->palette);
+	STATE_SAVE(state, fine_x_scroll);
+}
+
+void ppu_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct ppu *ppu = instance->priv_data;
+	uint8_t fine_x_scroll = ppu->fine_x_scroll;
+
+	/* Restore PPU state */
+	STATE_LOAD(state, ppu->ctrl);
+	STATE_LOAD(state, ppu->mask);
+	STATE_LOAD(state, ppu->status);
+	STATE_LOAD(state, ppu->oam_addr);
+	STATE_LOAD(state, ppu->vram_addr);
+	STATE_LOAD(state, ppu->temp_vram_addr);
+	STATE_LOAD(state, ppu->write_toggle);
+	STATE_LOAD(state, ppu->vram_buffer);
+	STATE_LOAD(state, ppu->odd_frame);
+	STATE_LOAD(state, ppu->h);
+	STATE_LOAD(state, ppu->v);
+	STATE_LOAD(state, ppu->sprite_counter);
+	STATE_LOAD(state, ppu->spr_0_evaluated);
+	STATE_LOAD(state, ppu->spr_0_fetched);
+	STATE_LOAD(state, ppu->line_deferred);
+	STATE_LOAD(state, ppu->render_data);
+	STATE_LOAD(state, ppu->oam);
+	STATE_LOAD(state, ppu->sec_oam);
+	STATE_LOAD(state, ppu->palette);
+	STATE_LOAD(state, fine_x_scroll);
+	ppu->fine_x_scroll = fine_x_scroll;
+
+	/* Update color indices from restored palette and mask */
+	ppu_update_colors(ppu);
+
+	/* Drop tile cache (restored banks or CHR RAM might differ) */
+	memset(ppu->chr_cached, 0, sizeof(ppu->chr_cached));
+	ppu->chr_a12 = CHR_A12_UNKNOWN;
+}
+
 void ppu_deinit(struct controller_instance *instance)
 {
 	video_deinit();
@@ -1366,6 +1860,8 @@ void ppu_deinit(struct controller_instance *instance)
 CONTROLLER_START(ppu)
 	.init = ppu_init,
 	.reset = ppu_reset,
+	.serialize = ppu_serialize,
+	.deserialize = ppu_deserialize,
 	.deinit = ppu_deinit
 CONTROLLER_END
 
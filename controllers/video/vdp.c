@@ -55,6 +55,13 @@
 #define NUM_BIT_PLANES			4
 #define SPRITE_PALETTE_OFFSET		16
 #define HORI_SCROLL_LOCK_HEIGHT		16
+#define NUM_COLORS			64
+#define ROW_SIZE			(TILE_SIZE / TILE_HEIGHT)
+#define NUM_ROWS_CACHED			(VRAM_SIZE / ROW_SIZE)
+#define NUM_SPREAD_VALUES		256
+
+/* Decoded pattern rows hold 8 4-bit pixels (leftmost pixel in top bits) */
+#define ROW_PIXEL(row, i)		(((row) >> (28 - 4 * (i))) & 0x0F)
 
 struct mode_ctrl_1 {
 	uint8_t synch_enable:1;
@@ -186,6 +193,11 @@ struct vdp {
 	struct clock clock;
 	uint8_t vram[VRAM_SIZE];
 	uint8_t cram[CRAM_SIZE];
+	uint32_t spread[NUM_SPREAD_VALUES];
+	uint32_t rows[NUM_ROWS_CACHED];
+	uint8_t line_sprites[SCREEN_HEIGHT][NUM_SPRITES];
+	uint8_t num_line_sprites[SCREEN_HEIGHT];
+	bool sprites_dirty;
 	int bus_id;
 	int irq;
 	struct port_region region;
@@ -194,7 +206,16 @@ struct vdp {
 
 static bool vdp_init(struct controller_instance *instance);
 static void vdp_tick(struct vdp *vdp);
+static void vdp_serialize(struct controller_instance *instance,
+	struct state *state);
+static void vdp_deserialize(struct controller_instance *instance,
+	struct state *state);
 static void vdp_deinit(struct controller_instance *instance);
+static void vdp_build_spread(struct vdp *vdp);
+static void vdp_decode_row(struct vdp *vdp, uint16_t address);
+static void vdp_decode_all(struct vdp *vdp);
+static uint16_t vdp_get_sprite_attr_table(struct vdp *vdp);
+static void vdp_sort_sprites(struct vdp *vdp);
 static void vdp_draw_line_bg(struct vdp *vdp);
 static void vdp_draw_line_sprites(struct vdp *vdp);
 static uint8_t vdp_read(struct vdp *vdp, port_t port);
@@ -260,6 +281,11 @@ void ctrl_write(struct vdp *vdp, uint8_t b)
 	case 2:
 		/* This value signifies a VDP register write */
 		vdp->regs.raw[cmd_word.reg] = cmd_word.data;
+
+		/* Sort sprites again if their height or table changes */
+		if ((cmd_word.reg == MODE_CTRL_2) ||
+			(cmd_word.reg == SPRITE_ATTR_TABLE_BASE))
+			vdp->sprites_dirty = true;
 		break;
 	default:
 		break;
@@ -281,6 +307,9 @@ uint8_t data_read(struct vdp *vdp)
 
 void data_write(struct vdp *vdp, uint8_t b)
 {
+	uint16_t address;
+	uint16_t sprite_attr_table_addr;
+
 	/* Depending on the code register, data written to the data port is sent
 	to either VRAM or CRAM. After each write, the address register is
 	incremented by one, and will wrap past $3FFF. */
@@ -288,7 +317,17 @@ void data_write(struct vdp *vdp, uint8_t b)
 	case 0:
 	case 1:
 	case 2:
-		vdp->vram[vdp->address++ & (VRAM_SIZE - 1)] = b;
+		address = vdp->address++ & (VRAM_SIZE - 1);
+		vdp->vram[address] = b;
+
+		/* Update decoded pattern row */
+		vdp_decode_row(vdp, address);
+
+		/* Sort sprites again if a Y coordinate changes */
+		sprite_attr_table_addr = vdp_get_sprite_attr_table(vdp);
+		if ((address >= sprite_attr_table_addr) &&
+			(address < sprite_attr_table_addr + NUM_SPRITES))
+			vdp->sprites_dirty = true;
 		break;
 	case 3:
 		vdp->cram[vdp->address++ & (CRAM_SIZE - 1)] = b;
@@ -336,24 +375,113 @@ uint8_t scanline_read(struct vdp *vdp, port_t UNUSED(port))
 	return vdp->v_counter;
 }
 
+void vdp_build_spread(struct vdp *vdp)
+{
+	uint32_t l;
+	int b;
+
+	/* Move each bit of a bitplane byte to the low bit of a 4-bit pixel
+	(interleaving all bitplanes then only takes four lookups) */
+	for (b = 0; b < NUM_SPREAD_VALUES; b++) {
+		l = b;
+		l = (l | (l << 12)) & 0x000F000F;
+		l = (l | (l << 6)) & 0x03030303;
+		l = (l | (l << 3)) & 0x11111111;
+		vdp->spread[b] = l;
+	}
+}
+
+void vdp_decode_row(struct vdp *vdp, uint16_t address)
+{
+	uint8_t *data;
+	uint32_t row;
+	int i;
+
+	/* Decode all bitplanes of pattern row containing address */
+	address &= ~(ROW_SIZE - 1);
+	data = &vdp->vram[address];
+	row = 0;
+	for (i = 0; i < NUM_BIT_PLANES; i++)
+		row |= vdp->spread[data[i]] << i;
+	vdp->rows[address / ROW_SIZE] = row;
+}
+
+void vdp_decode_all(struct vdp *vdp)
+{
+	uint16_t address;
+
+	/* Decode whole VRAM and sort sprites again */
+	for (address = 0; address < VRAM_SIZE; address += ROW_SIZE)
+		vdp_decode_row(vdp, address);
+	vdp->sprites_dirty = true;
+}
+
+uint16_t vdp_get_sprite_attr_table(struct vdp *vdp)
+{
+	uint16_t sprite_attr_table_addr = 0;
+
+	/* Set sprite attribute table address */
+	bitops_setw(&sprite_attr_table_addr,
+		8,
+		6,
+		vdp->regs.sprite_attr_table_base_addr.addr);
+	return sprite_attr_table_addr;
+}
+
+void vdp_sort_sprites(struct vdp *vdp)
+{
+	uint16_t sprite_attr_table_addr;
+	uint16_t spr_y;
+	uint16_t y;
+	uint8_t h;
+	int sprite;
+
+	/* Reset line buckets */
+	memset(vdp->num_line_sprites, 0, sizeof(vdp->num_line_sprites));
+	vdp->sprites_dirty = false;
+
+	/* Get sprite attribute table address */
+	sprite_attr_table_addr = vdp_get_sprite_attr_table(vdp);
+
+	/* Set sprite height (double it if needed) */
+	h = SPRITE_HEIGHT;
+	if (vdp->regs.mode_ctrl_2.large_sprites)
+		h += SPRITE_HEIGHT;
+
+	/* Add each sprite to the buckets of lines it intersects (in sprite
+	order). If the Y coordinate is set to 0xD0, then the sprite in question
+	and all remaining sprites of the 64 available will not be drawn. This
+	only works in the 192-line display mode, in the 224 and 240-line modes
+	a Y coordinate of 0xD0 has no special meaning. */
+	for (sprite = 0; sprite < NUM_SPRITES; sprite++) {
+		spr_y = vdp->vram[sprite_attr_table_addr + sprite];
+		if (spr_y == 0xD0)
+			break;
+
+		/* The Y coordinate is treated as being plus one, so a value of
+		zero would place a sprite on scanline 1. */
+		for (y = spr_y + 1; (y < spr_y + 1 + h) && (y < SCREEN_HEIGHT);
+			y++)
+			vdp->line_sprites[y][vdp->num_line_sprites[y]++] =
+				sprite;
+	}
+}
+
 void vdp_draw_line_bg(struct vdp *vdp)
 {
 	union vdp_addr vdp_addr;
-	struct color color;
 	union bg_tile tile;
 	uint16_t tile_data_addr;
 	uint16_t x;
 	uint8_t final_x;
 	uint16_t final_y;
-	uint8_t tile_data;
 	uint8_t palette_index;
 	uint8_t col;
 	uint8_t row;
 	uint8_t x_off;
 	uint8_t y_off;
 	uint8_t bit;
-	uint8_t v;
-	int i;
+	uint8_t *line = video_get_line(vdp->v_counter);
 
 	/* Find final Y coordinate based on vertical scroll */
 	final_y = vdp->v_counter + vdp->regs.bg_y_scroll;
@@ -376,21 +504,15 @@ void vdp_draw_line_bg(struct vdp *vdp)
 	for (x = 0; x < SCREEN_WIDTH; x++) {
 		/* Handle display blanking */
 		if (!vdp->regs.mode_ctrl_2.enable_display) {
-			color.r = 0;
-			color.g = 0;
-			color.b = 0;
-			video_set_pixel(x, vdp->v_counter, color);
+			line[x] = 0;
 			continue;
 		}
 
 		/* Mask column 0 with overscan color if needed */
 		if (vdp->regs.mode_ctrl_1.mask_col_0 && (x < TILE_WIDTH)) {
 			palette_index = vdp->regs.overscan_color.color;
-			v = vdp->cram[palette_index + SPRITE_PALETTE_OFFSET];
-			color.r = RED(v);
-			color.g = GREEN(v);
-			color.b = BLUE(v);
-			video_set_pixel(x, vdp->v_counter, color);
+			palette_index += SPRITE_PALETTE_OFFSET;
+			line[x] = vdp->cram[palette_index] & (NUM_COLORS - 1);
 			continue;
 		}
 
@@ -414,9 +536,9 @@ void vdp_draw_line_bg(struct vdp *vdp)
 		tile.high = vdp->vram[vdp_addr.raw + 1];
 
 		/* Set X offset based on X coordinate and horizontal flip */
-		x_off = TILE_WIDTH - 1 - (final_x % TILE_WIDTH);
+		x_off = final_x % TILE_WIDTH;
 		if (tile.h_flip)
-			x_off = (final_x % TILE_WIDTH);
+			x_off = TILE_WIDTH - 1 - x_off;
 
 		/* Set Y offset based on X coordinate and vertical flip */
 		y_off = final_y % TILE_HEIGHT;
@@ -427,13 +549,9 @@ void vdp_draw_line_bg(struct vdp *vdp)
 		tile_data_addr = tile.pattern_index * TILE_SIZE;
 		tile_data_addr += y_off * (TILE_SIZE / TILE_WIDTH);
 
-		/* Compute palette index from bit planes */
-		palette_index = 0;
-		for (i = 0; i < NUM_BIT_PLANES; i++) {
-			tile_data = vdp->vram[tile_data_addr++];
-			bit = (tile_data >> x_off) & 1;
-			bitops_setb(&palette_index, i, 1, bit);
-		}
+		/* Get palette index from decoded pattern row */
+		palette_index = ROW_PIXEL(vdp->rows[tile_data_addr / ROW_SIZE],
+			x_off);
 
 		/* Save priority based on tile information and palette index */
 		vdp->priority[x] = tile.priority && (palette_index != 0);
@@ -443,12 +561,8 @@ void vdp_draw_line_bg(struct vdp *vdp)
 		if (tile.palette_sel)
 			palette_index += SPRITE_PALETTE_OFFSET;
 
-		/* Compute color based on palette index and draw pixel */
-		v = vdp->cram[palette_index];
-		color.r = RED(v);
-		color.g = GREEN(v);
-		color.b = BLUE(v);
-		video_set_pixel(x, vdp->v_counter, color);
+		/* Draw pixel (CRAM entries are used as color indices) */
+		line[x] = vdp->cram[palette_index] & (NUM_COLORS - 1);
 	}
 }
 
@@ -461,64 +575,39 @@ void vdp_draw_line_sprites(struct vdp *vdp)
 	uint16_t spr_x;
 	uint16_t spr_y;
 	int16_t final_x;
+	uint32_t row;
 	uint8_t palette_index;
-	uint8_t tile_data;
 	uint8_t tile_x;
-	uint8_t x_off;
 	uint8_t y_off;
-	uint8_t bit;
-	uint8_t h;
-	uint8_t v;
 	bool sprite_collision;
 	int num_sprites;
-	int sprite_count;
 	int sprite;
 	int i;
-	struct color color;
+	uint8_t *line = video_get_line(vdp->v_counter);
 
 	/* Return already if display is disabled */
 	if (!vdp->regs.mode_ctrl_2.enable_display)
 		return;
 
-	/* Set sprite attribute table address */
-	sprite_attr_table_addr = 0;
-	bitops_setw(&sprite_attr_table_addr,
-		8,
-		6,
-		vdp->regs.sprite_attr_table_base_addr.addr);
+	/* Sort sprites into line buckets again if needed */
+	if (vdp->sprites_dirty)
+		vdp_sort_sprites(vdp);
 
-	/* Set sprite height (double it if needed) */
-	h = SPRITE_HEIGHT;
-	if (vdp->regs.mode_ctrl_2.large_sprites)
-		h += SPRITE_HEIGHT;
+	/* Get sprite attribute table address */
+	sprite_attr_table_addr = vdp_get_sprite_attr_table(vdp);
 
-	/* If the Y coordinate is set to 0xD0, then the sprite in question and
-	all remaining sprites of the 64 available will not be drawn. This only
-	works in the 192-line display mode, in the 224 and 240-line modes a Y
-	coordinate of 0xD0 has no special meaning. */
-	num_sprites = NUM_SPRITES;
-	for (sprite = 0; sprite < NUM_SPRITES; sprite++)
-		if (vdp->vram[sprite_attr_table_addr + sprite] == 0xD0) {
-			num_sprites = sprite;
-			break;
-		}
+	/* Set overflow bit if needed */
+	num_sprites = vdp->num_line_sprites[vdp->v_counter];
+	if (num_sprites >= SPRITE_OVERFLOW)
+		vdp->status.sprite_overflow = 1;
 
-	/* Draw sprites in reverse order */
+	/* Draw sprites intersecting scanline in reverse order */
 	sprite_collision = false;
-	sprite_count = 0;
-	for (sprite = num_sprites - 1; sprite >= 0; sprite--) {
-		/* The Y coordinate is treated as being plus one, so a value of
-		zero would place a sprite on scanline 1. */
-		sprite_attr_addr = sprite_attr_table_addr + sprite;
-		spr_y = vdp->vram[sprite_attr_addr] + 1;
+	for (i = num_sprites - 1; i >= 0; i--) {
+		sprite = vdp->line_sprites[vdp->v_counter][i];
 
-		/* Skip sprite if scanline does not intersect with it */
-		if ((vdp->v_counter < spr_y) || (vdp->v_counter >= (spr_y + h)))
-			continue;
-
-		/* Increment sprite count and set overflow bit if needed */
-		if (++sprite_count == SPRITE_OVERFLOW)
-			vdp->status.sprite_overflow = 1;
+		/* The Y coordinate is treated as being plus one */
+		spr_y = vdp->vram[sprite_attr_table_addr + sprite] + 1;
 
 		/* Get sprite X coordinate */
 		sprite_attr_addr = sprite_attr_table_addr;
@@ -567,6 +656,9 @@ void vdp_draw_line_sprites(struct vdp *vdp)
 		tile_data_addr = pattern_index * TILE_SIZE;
 		tile_data_addr += y_off * (TILE_SIZE / TILE_WIDTH);
 
+		/* Get decoded pattern row */
+		row = vdp->rows[tile_data_addr / ROW_SIZE];
+
 		/* Draw sprite tile */
 		for (tile_x = 0; tile_x < TILE_WIDTH; tile_x++) {
 			/* Compute final sprite pixel X coordinate */
@@ -589,16 +681,8 @@ void vdp_draw_line_sprites(struct vdp *vdp)
 			if (vdp->priority[final_x])
 				continue;
 
-			/* Get X offset within tile data */
-			x_off = TILE_WIDTH - 1 - tile_x;
-
-			/* Compute palette index from bit planes */
-			palette_index = 0;
-			for (i = 0; i < NUM_BIT_PLANES; i++) {
-				tile_data = vdp->vram[tile_data_addr + i];
-				bit = (tile_data >> x_off) & 1;
-				bitops_setb(&palette_index, i, 1, bit);
-			}
+			/* Get palette index from decoded pattern row */
+			palette_index = ROW_PIXEL(row, tile_x);
 
 			/* Skip if index is 0 (indicating transparency) */
 			if (palette_index == 0)
@@ -608,11 +692,8 @@ void vdp_draw_line_sprites(struct vdp *vdp)
 			palette_index += SPRITE_PALETTE_OFFSET;
 
 			/* Draw sprite pixel */
-			v = vdp->cram[palette_index];
-			color.r = RED(v);
-			color.g = GREEN(v);
-			color.b = BLUE(v);
-			video_set_pixel(final_x, vdp->v_counter, color);
+			line[final_x] = vdp->cram[palette_index] &
+				(NUM_COLORS - 1);
 
 			/* Set collision flag if needed */
 			if (vdp->collision[final_x])
@@ -632,10 +713,8 @@ void vdp_tick(struct vdp *vdp)
 {
 	/* Draw current line if within bounds */
 	if (vdp->v_counter < SCREEN_HEIGHT) {
-		video_lock();
 		vdp_draw_line_bg(vdp);
 		vdp_draw_line_sprites(vdp);
-		video_unlock();
 	}
 
 	/* Handle line counter */
@@ -680,7 +759,9 @@ bool vdp_init(struct controller_instance *instance)
 	struct vdp *vdp;
 	struct video_specs video_specs;
 	struct resource *res;
+	struct color color;
 	float fps;
+	int v;
 
 	/* Allocate VDP structure */
 	instance->priv_data = calloc(1, sizeof(struct vdp));
@@ -726,6 +807,9 @@ bool vdp_init(struct controller_instance *instance)
 	vdp->clock.tick = (clock_tick_t)vdp_tick;
 	clock_add(&vdp->clock);
 
+	/* Build pattern row decode table */
+	vdp_build_spread(vdp);
+
 	/* Calculate desired FPS */
 	fps = (float)vdp->clock.rate / (NUM_COLUMNS * NUM_ROWS * 2);
 
@@ -733,11 +817,20 @@ bool vdp_init(struct controller_instance *instance)
 	video_specs.width = SCREEN_WIDTH;
 	video_specs.height = SCREEN_HEIGHT;
 	video_specs.fps = fps;
+	video_specs.num_colors = NUM_COLORS;
 	if (!video_init(&video_specs)) {
 		free(vdp);
 		return false;
 	}
 
+	/* Map CRAM colors to native colors */
+	for (v = 0; v < NUM_COLORS; v++) {
+		color.r = RED(v);
+		color.g = GREEN(v);
+		color.b = BLUE(v);
+		video_set_color(v, color);
+	}
+
 	return true;
 }
 
@@ -756,11 +849,65 @@ void vdp_reset(struct controller_instance *instance)
 	vdp->line_counter = 0xFF;
 	vdp->bg_x_scroll = 0;
 	vdp->bg_y_scroll = 0;
+	vdp_decode_all(vdp);
 
 	/* Enable clock */
 	vdp->clock.enabled = true;
 }
 
+void vdp_serialize(struct controller_instance *instance, struct state *state)
+{
+	struct vdp *vdp = instance->priv_data;
+	uint8_t code = vdp->code;
+	uint16_t address = vdp->address;
+
+	/* Save VDP state */
+	STATE_SAVE(state, vdp->regs);
+	STATE_SAVE(state, vdp->status);
+	STATE_SAVE(state, vdp->read_buffer);
+	STATE_SAVE(state, vdp->cmd_byte);
+	STATE_SAVE(state, vdp->cmd_first_write);
+	STATE_SAVE(state, vdp->v_counter);
+	STATE_SAVE(state, vdp->bg_x_scroll);
+	STATE_SAVE(state, vdp->bg_y_scroll);
+	STATE_SAVE(state, vdp->line_counter);
+	STATE_SAVE(state, vdp->priority);
+	STATE_SAVE(state, vdp->collision);
+	STATE_SAVE(state, vdp->vram);
+	STATE_SAVE(state, vdp->cram);
+	STATE_SAVE(state, code);
+	STATE_SAVE(state, address);
+}
+
+void vdp_deserialize(struct controller_instance *instance, struct state *state)
+{
+	struct vdp *vdp = instance->priv_data;
+	uint8_t code = vdp->code;
+	uint16_t address = vdp->address;
+
+	/* Restore VDP state */
+	STATE_LOAD(state, vdp->regs);
+	STATE_LOAD(state, vdp->status);
+	STATE_LOAD(state, vdp->read_buffer);
+	STATE_LOAD(state, vdp->cmd_byte);
+	STATE_LOAD(state, vdp->cmd_first_write);
+	STATE_LOAD(state, vdp->v_counter);
+	STATE_LOAD(state, vdp->bg_x_scroll);
+	STATE_LOAD(state, vdp->bg_y_scroll);
+	STATE_LOAD(state, vdp->line_counter);
+	STATE_LOAD(state, vdp->priority);
+	STATE_LOAD(state, vdp->collision);
+	STATE_LOAD(state, vdp->vram);
+	STATE_LOAD(state, vdp->cram);
+	STATE_LOAD(state, code);
+	STATE_LOAD(state, address);
+	vdp->code = code;
+	vdp->address = address;
+
+	/* Rebuild decoded pattern rows and sprite line buckets */
+	vdp_decode_all(vdp);
+}
+
 void vdp_deinit(struct controller_instance *instance)
 {
 	video_deinit();
@@ -770,6 +917,8 @@ void vdp_deinit(struct controller_instance *instance)
 CONTROLLER_START(vdp)
 	.init = vdp_init,
 	.reset = vdp_reset,
+	.serialize = vdp_serialize,
+	.deserialize = vdp_deserialize,
 	.deinit = vdp_deinit
 CONTROLLER_END
 
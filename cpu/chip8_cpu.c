@@ -67,15 +67,20 @@ struct chip8 {
 	float audio_time;
 	struct input_config input_config;
 	bool keys[NUM_KEYS];
+	bool screen[SCREEN_HEIGHT][SCREEN_WIDTH];
 };
 
 static bool chip8_init(struct cpu_instance *instance);
 static void chip8_reset(struct cpu_instance *instance);
+static void chip8_serialize(struct cpu_instance *instance,
+	struct state *state);
+static void chip8_deserialize(struct cpu_instance *instance,
+	struct state *state);
 static void chip8_deinit(struct cpu_instance *instance);
 static void chip8_tick(struct chip8 *chip8);
 static void chip8_gen_audio(struct chip8 *chip8);
 static void chip8_update_counters(struct chip8 *chip8);
-static void chip8_draw(clock_data_t *data);
+static void chip8_draw(struct chip8 *chip8);
 static void chip8_event(int id, enum input_type type, struct chip8 *chip8);
 static inline void CLS(struct chip8 *chip8);
 static inline void RET(struct chip8 *chip8);
@@ -154,16 +159,9 @@ static struct input_desc input_descs[] = {
 #endif
 };
 
-void CLS(struct chip8 *UNUSED(chip8))
+void CLS(struct chip8 *chip8)
 {
-	uint8_t x, y;
-	struct color black = { 0, 0, 0 };
-
-	video_lock();
-	for (x = 0; x < SCREEN_WIDTH; x++)
-		for (y = 0; y < SCREEN_HEIGHT; y++)
-			video_set_pixel(x, y, black);
-	video_unlock();
+	memset(chip8->screen, 0, sizeof(chip8->screen));
 }
 
 void RET(struct chip8 *chip8)
@@ -294,9 +292,6 @@ void RND_Vx_byte(struct chip8 *chip8)
 void DRW_Vx_Vy_nibble(struct chip8 *chip8)
 {
 	uint8_t i, j, x, y, b, src, VF = 0;
-	struct color black = { 0, 0, 0 };
-	struct color white = { 255, 255, 255 };
-	struct color c;
 	bool pixel;
 
 	for (i = 0; i < chip8->opcode.n; i++) {
@@ -305,9 +300,8 @@ void DRW_Vx_Vy_nibble(struct chip8 *chip8)
 		for (j = 0; j < NUM_PIXELS_PER_BYTE; j++) {
 			x = (chip8->V[chip8->opcode.x] + j) % SCREEN_WIDTH;
 			src = b >> (NUM_PIXELS_PER_BYTE - j - 1) & 0x01;
-			c = video_get_pixel(x, y);
-			pixel = (c.r == white.r) ^ src;
-			video_set_pixel(x, y, pixel ? white : black);
+			pixel = chip8->screen[y][x] ^ src;
+			chip8->screen[y][x] = pixel;
 			if (src && !pixel)
 				VF = 1;
 		}
@@ -600,8 +594,18 @@ void chip8_update_counters(struct chip8 *chip8)
 	clock_consume(1);
 }
 
-void chip8_draw(clock_data_t *UNUSED(data))
+void chip8_draw(struct chip8 *chip8)
 {
+	uint8_t *line;
+	int x;
+	int y;
+
+	/* Draw screen contents and update display */
+	for (y = 0; y < SCREEN_HEIGHT; y++) {
+		line = video_get_line(y);
+		for (x = 0; x < SCREEN_WIDTH; x++)
+			line[x] = chip8->screen[y][x];
+	}
 	video_update();
 
 	/* Report cycle consumption */
@@ -619,6 +623,8 @@ bool chip8_init(struct cpu_instance *instance)
 	struct audio_specs audio_specs;
 	struct video_specs video_specs;
 	struct input_config *input_config;
+	struct color black = { 0, 0, 0 };
+	struct color white = { 255, 255, 255 };
 
 	/* Allocate chip8 structure and set private data */
 	chip8 = calloc(1, sizeof(struct chip8));
@@ -637,12 +643,17 @@ bool chip8_init(struct cpu_instance *instance)
 	video_specs.width = SCREEN_WIDTH;
 	video_specs.height = SCREEN_HEIGHT;
 	video_specs.fps = DRAW_CLOCK_RATE;
+	video_specs.num_colors = 2;
 	if (!video_init(&video_specs)) {
 		free(chip8);
 		audio_deinit();
 		return false;
 	}
 
+	/* Screen pixels are used as palette indices */
+	video_set_color(0, black);
+	video_set_color(1, white);
+
 	/* Initialize input configuration */
 	input_config = &chip8->input_config;
 	input_config->name = instance->cpu_name;
@@ -673,7 +684,8 @@ bool chip8_init(struct cpu_instance *instance)
 
 	/* Add draw clock */
 	chip8->draw_clock.rate = DRAW_CLOCK_RATE;
-	chip8->draw_clock.tick = chip8_draw;
+	chip8->draw_clock.data = chip8;
+	chip8->draw_clock.tick = (clock_tick_t)chip8_draw;
 	clock_add(&chip8->draw_clock);
 
 	return true;
@@ -682,9 +694,6 @@ bool chip8_init(struct cpu_instance *instance)
 void chip8_reset(struct cpu_instance *instance)
 {
 	struct chip8 *chip8 = instance->priv_data;
-	struct color black = { 0, 0, 0 };
-	int x;
-	int y;
 
 	/* Initialize registers */
 	memset(chip8->V, 0, NUM_REGISTERS);
@@ -695,9 +704,7 @@ void chip8_reset(struct cpu_instance *instance)
 	chip8->ST = 0;
 
 	/* Initialize screen */
-	for (y = 0; y < SCREEN_HEIGHT; y++)
-		for (x = 0; x < SCREEN_WIDTH; x++)
-			video_set_pixel(x, y, black);
+	memset(chip8->screen, 0, sizeof(chip8->screen));
 
 	/* Initialize input data */
 	memset(chip8->keys, 0, NUM_KEYS * sizeof(bool));
@@ -711,6 +718,40 @@ void chip8_reset(struct cpu_instance *instance)
 	chip8->draw_clock.enabled = true;
 }
 
+void chip8_serialize(struct cpu_instance *instance, struct state *state)
+{
+	struct chip8 *chip8 = instance->priv_data;
+
+	/* Save processor state and screen contents */
+	STATE_SAVE(state, chip8->V);
+	STATE_SAVE(state, chip8->I);
+	STATE_SAVE(state, chip8->PC);
+	STATE_SAVE(state, chip8->SP);
+	STATE_SAVE(state, chip8->DT);
+	STATE_SAVE(state, chip8->ST);
+	STATE_SAVE(state, chip8->opcode);
+	STATE_SAVE(state, chip8->stack);
+	STATE_SAVE(state, chip8->audio_time);
+	STATE_SAVE(state, chip8->screen);
+}
+
+void chip8_deserialize(struct cpu_instance *instance, struct state *state)
+{
+	struct chip8 *chip8 = instance->priv_data;
+
+	/* Restore processor state and screen contents */
+	STATE_LOAD(state, chip8->V);
+	STATE_LOAD(state, chip8->I);
+	STATE_LOAD(state, chip8->PC);
+	STATE_LOAD(state, chip8->SP);
+	STATE_LOAD(state, chip8->DT);
+	STATE_LOAD(state, chip8->ST);
+	STATE_LOAD(state, chip8->opcode);
+	STATE_LOAD(state, chip8->stack);
+	STATE_LOAD(state, chip8->audio_time);
+	STATE_LOAD(state, chip8->screen);
+}
+
 void chip8_deinit(struct cpu_instance *instance)
 {
 	struct chip8 *chip8 = instance->priv_data;
@@ -724,6 +765,8 @@ void chip8_deinit(struct cpu_instance *instance)
 CPU_START(chip8)
 	.init = chip8_init,
 	.reset = chip8_reset,
+	.serialize = chip8_serialize,
+	.deserialize = chip8_deserialize,
 	.deinit = chip8_deinit
 CPU_END
 
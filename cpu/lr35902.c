@@ -59,6 +59,10 @@ struct lr35902 {
 static bool lr35902_init(struct cpu_instance *instance);
 static void lr35902_reset(struct cpu_instance *instance);
 static void lr35902_interrupt(struct cpu_instance *instance, int irq);
+static void lr35902_serialize(struct cpu_instance *instance,
+	struct state *state);
+static void lr35902_deserialize(struct cpu_instance *instance,
+	struct state *state);
 static void lr35902_deinit(struct cpu_instance *instance);
 static bool lr35902_handle_interrupts(struct lr35902 *cpu);
 static void lr35902_tick(struct lr35902 *cpu);
@@ -2889,6 +2893,40 @@ void lr35902_interrupt(struct cpu_instance *instance, int irq)
 	cpu->IF |= BIT(irq);
 }
 
+void lr35902_serialize(struct cpu_instance *instance, struct state *state)
+{
+	struct lr35902 *cpu = instance->priv_data;
+
+	/* Save processor state */
+	STATE_SAVE(state, cpu->AF);
+	STATE_SAVE(state, cpu->BC);
+	STATE_SAVE(state, cpu->DE);
+	STATE_SAVE(state, cpu->HL);
+	STATE_SAVE(state, cpu->PC);
+	STATE_SAVE(state, cpu->SP);
+	STATE_SAVE(state, cpu->IME);
+	STATE_SAVE(state, cpu->IF);
+	STATE_SAVE(state, cpu->IE);
+	STATE_SAVE(state, cpu->halted);
+}
+
+void lr35902_deserialize(struct cpu_instance *instance, struct state *state)
+{
+	struct lr35902 *cpu = instance->priv_data;
+
+	/* Restore processor state */
+	STATE_LOAD(state, cpu->AF);
+	STATE_LOAD(state, cpu->BC);
+	STATE_LOAD(state, cpu->DE);
+	STATE_LOAD(state, cpu->HL);
+	STATE_LOAD(state, cpu->PC);
+	STATE_LOAD(state, cpu->SP);
+	STATE_LOAD(state, cpu->IME);
+	STATE_LOAD(state, cpu->IF);
+	STATE_LOAD(state, cpu->IE);
+	STATE_LOAD(state, cpu->halted);
+}
+
 void lr35902_deinit(struct cpu_instance *instance)
 {
 	struct lr35902 *cpu = instance->priv_data;
@@ -2899,6 +2937,8 @@ CPU_START(lr35902)
 	.init = lr35902_init,
 	.reset = lr35902_reset,
 	.interrupt = lr35902_interrupt,
+	.serialize = lr35902_serialize,
+	.deserialize = lr35902_deserialize,
 	.deinit = lr35902_deinit
 CPU_END
 
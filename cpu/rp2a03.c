@@ -44,6 +44,10 @@ struct rp2a03 {
 static bool rp2a03_init(struct cpu_instance *instance);
 static void rp2a03_reset(struct cpu_instance *instance);
 static void rp2a03_interrupt(struct cpu_instance *instance, int irq);
+static void rp2a03_serialize(struct cpu_instance *instance,
+	struct state *state);
+static void rp2a03_deserialize(struct cpu_instance *instance,
+	struct state *state);
 static void rp2a03_deinit(struct cpu_instance *instance);
 static void rp2a03_tick(struct rp2a03 *rp2a03);
 static inline void ADC_A(struct rp2a03 *rp2a03);
@@ -2318,6 +2322,36 @@ void rp2a03_interrupt(struct cpu_instance *instance, int irq)
 	}
 }
 
+void rp2a03_serialize(struct cpu_instance *instance, struct state *state)
+{
+	struct rp2a03 *rp2a03 = instance->priv_data;
+
+	/* Save processor state */
+	STATE_SAVE(state, rp2a03->A);
+	STATE_SAVE(state, rp2a03->X);
+	STATE_SAVE(state, rp2a03->Y);
+	STATE_SAVE(state, rp2a03->PC);
+	STATE_SAVE(state, rp2a03->S);
+	STATE_SAVE(state, rp2a03->P);
+	STATE_SAVE(state, rp2a03->interrupted);
+	STATE_SAVE(state, rp2a03->interrupt);
+}
+
+void rp2a03_deserialize(struct cpu_instance *instance, struct state *state)
+{
+	struct rp2a03 *rp2a03 = instance->priv_data;
+
+	/* Restore processor state */
+	STATE_LOAD(state, rp2a03->A);
+	STATE_LOAD(state, rp2a03->X);
+	STATE_LOAD(state, rp2a03->Y);
+	STATE_LOAD(state, rp2a03->PC);
+	STATE_LOAD(state, rp2a03->S);
+	STATE_LOAD(state, rp2a03->P);
+	STATE_LOAD(state, rp2a03->interrupted);
+	STATE_LOAD(state, rp2a03->interrupt);
+}
+
 void rp2a03_deinit(struct cpu_instance *instance)
 {
 	struct rp2a03 *rp2a03 = instance->priv_data;
@@ -2328,6 +2362,8 @@ CPU_START(rp2a03)
 	.init = rp2a03_init,
 	.reset = rp2a03_reset,
 	.interrupt = rp2a03_interrupt,
+	.serialize = rp2a03_serialize,
+	.deserialize = rp2a03_deserialize,
 	.deinit = rp2a03_deinit
 CPU_END
 
@@ -83,6 +83,8 @@ struct z80 {
 static bool z80_init(struct cpu_instance *instance);
 static void z80_reset(struct cpu_instance *instance);
 static void z80_interrupt(struct cpu_instance *instance, int irq);
+static void z80_serialize(struct cpu_instance *instance, struct state *state);
+static void z80_deserialize(struct cpu_instance *instance, struct state *state);
 static void z80_deinit(struct cpu_instance *instance);
 static bool z80_handle_irq(struct z80 *cpu);
 static bool z80_handle_nmi(struct z80 *cpu);
@@ -4221,6 +4223,62 @@ void z80_interrupt(struct cpu_instance *instance, int irq)
 		cpu->nmi_pending = true;
 }
 
+void z80_serialize(struct cpu_instance *instance, struct state *state)
+{
+	struct z80 *cpu = instance->priv_data;
+
+	/* Save processor state */
+	STATE_SAVE(state, cpu->AF);
+	STATE_SAVE(state, cpu->A2F2);
+	STATE_SAVE(state, cpu->BC);
+	STATE_SAVE(state, cpu->B2C2);
+	STATE_SAVE(state, cpu->DE);
+	STATE_SAVE(state, cpu->D2E2);
+	STATE_SAVE(state, cpu->HL);
+	STATE_SAVE(state, cpu->H2L2);
+	STATE_SAVE(state, cpu->IX);
+	STATE_SAVE(state, cpu->IY);
+	STATE_SAVE(state, cpu->PC);
+	STATE_SAVE(state, cpu->SP);
+	STATE_SAVE(state, cpu->I);
+	STATE_SAVE(state, cpu->R);
+	STATE_SAVE(state, cpu->IFF1);
+	STATE_SAVE(state, cpu->IFF2);
+	STATE_SAVE(state, cpu->irq_delay);
+	STATE_SAVE(state, cpu->interrupt_mode);
+	STATE_SAVE(state, cpu->irq_pending);
+	STATE_SAVE(state, cpu->nmi_pending);
+	STATE_SAVE(state, cpu->halted);
+}
+
+void z80_deserialize(struct cpu_instance *instance, struct state *state)
+{
+	struct z80 *cpu = instance->priv_data;
+
+	/* Restore processor state */
+	STATE_LOAD(state, cpu->AF);
+	STATE_LOAD(state, cpu->A2F2);
+	STATE_LOAD(state, cpu->BC);
+	STATE_LOAD(state, cpu->B2C2);
+	STATE_LOAD(state, cpu->DE);
+	STATE_LOAD(state, cpu->D2E2);
+	STATE_LOAD(state, cpu->HL);
+	STATE_LOAD(state, cpu->H2L2);
+	STATE_LOAD(state, cpu->IX);
+	STATE_LOAD(state, cpu->IY);
+	STATE_LOAD(state, cpu->PC);
+	STATE_LOAD(state, cpu->SP);
+	STATE_LOAD(state, cpu->I);
+	STATE_LOAD(state, cpu->R);
+	STATE_LOAD(state, cpu->IFF1);
+	STATE_LOAD(state, cpu->IFF2);
+	STATE_LOAD(state, cpu->irq_delay);
+	STATE_LOAD(state, cpu->interrupt_mode);
+	STATE_LOAD(state, cpu->irq_pending);
+	STATE_LOAD(state, cpu->nmi_pending);
+	STATE_LOAD(state, cpu->halted);
+}
+
 void z80_deinit(struct cpu_instance *instance)
 {
 	struct z80 *cpu = instance->priv_data;
@@ -4231,6 +4289,8 @@ CPU_START(z80)
 	.init = z80_init,
 	.reset = z80_reset,
 	.interrupt = z80_interrupt,
+	.serialize = z80_serialize,
+	.deserialize = z80_deserialize,
 	.deinit = z80_deinit
 CPU_END
 
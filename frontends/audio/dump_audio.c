@@ -0,0 +1,136 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <audio.h>
+#include <cmdline.h>
+#include <log.h>
+#include <util.h>
+
+#define DEFAULT_PATH		"emux.wav"
+#define NUM_CHANNELS		2
+#define BITS_PER_SAMPLE		16
+#define FRAME_SIZE		(NUM_CHANNELS * sizeof(int16_t))
+#define HEADER_SIZE		44
+#define UNKNOWN_SIZE		0xFFFFFFFF
+#define STREAM_BUFFER_SIZE	(1 << 16)
+
+/* Samples are streamed to a file or pipe as a 16-bit stereo WAV file, whose
+sizes are only filled once done (and left unknown if file is not seekable) */
+struct dump_data {
+	FILE *file;
+	char *stream_buffer;
+	int sampling_rate;
+	uint32_t num_frames;
+};
+
+static void dump_write_le(FILE *file, uint32_t value, int size);
+static void dump_write_header(struct dump_data *data, uint32_t data_size);
+static bool dump_init(struct audio_frontend *fe, int sampling_rate);
+static void dump_enqueue(struct audio_frontend *fe, int16_t *buffer,
+	int count);
+static void dump_deinit(struct audio_frontend *fe);
+
+/* Command-line parameter */
+static char *dump_path = DEFAULT_PATH;
+PARAM(dump_path, string, "dump-audio", NULL, "Sets audio dump path (WAV)")
+
+void dump_write_le(FILE *file, uint32_t value, int size)
+{
+	int i;
+
+	/* Write value as little-endian bytes */
+	for (i = 0; i < size; i++)
+		fputc((value >> (8 * i)) & 0xFF, file);
+}
+
+void dump_write_header(struct dump_data *data, uint32_t data_size)
+{
+	FILE *f = data->file;
+	uint32_t riff_size;
+
+	/* Get RIFF chunk size (keeping unknown size as is) */
+	riff_size = data_size;
+	if (data_size != UNKNOWN_SIZE)
+		riff_size += HEADER_SIZE - 8;
+
+	/* Write RIFF, format (16-bit PCM), and data chunk headers */
+	fputs("RIFF", f);
+	dump_write_le(f, riff_size, 4);
+	fputs("WAVEfmt ", f);
+	dump_write_le(f, 16, 4);
+	dump_write_le(f, 1, 2);
+	dump_write_le(f, NUM_CHANNELS, 2);
+	dump_write_le(f, data->sampling_rate, 4);
+	dump_write_le(f, data->sampling_rate * FRAME_SIZE, 4);
+	dump_write_le(f, FRAME_SIZE, 2);
+	dump_write_le(f, BITS_PER_SAMPLE, 2);
+	fputs("data", f);
+	dump_write_le(f, data_size, 4);
+}
+
+bool dump_init(struct audio_frontend *fe, int sampling_rate)
+{
+	struct dump_data *data;
+	FILE *file;
+
+	/* Open dump file (which may be a named pipe) */
+	file = fopen(dump_path, "wb");
+	if (!file) {
+		LOG_E("Could not open audio dump file \"%s\"!\n", dump_path);
+		return false;
+	}
+
+	/* Create private data */
+	data = calloc(1, sizeof(struct dump_data));
+	data->file = file;
+	data->sampling_rate = sampling_rate;
+	data->num_frames = 0;
+	fe->priv_data = data;
+
+	/* Write samples through a buffer to limit system calls */
+	data->stream_buffer = malloc(STREAM_BUFFER_SIZE);
+	setvbuf(file, data->stream_buffer, _IOFBF, STREAM_BUFFER_SIZE);
+
+	/* Write header with sizes left unknown for now */
+	dump_write_header(data, UNKNOWN_SIZE);
+	return true;
+}
+
+void dump_enqueue(struct audio_frontend *fe, int16_t *buffer, int count)
+{
+	struct dump_data *data = fe->priv_data;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	int i;
+
+	/* Write samples as little-endian values */
+	for (i = 0; i < count * NUM_CHANNELS; i++)
+		dump_write_le(data->file, (uint16_t)buffer[i], 2);
+#else
+	/* Write samples as is */
+	fwrite(buffer, FRAME_SIZE, count, data->file);
+#endif
+	data->num_frames += count;
+}
+
+void dump_deinit(struct audio_frontend *fe)
+{
+	struct dump_data *data = fe->priv_data;
+
+	/* Fill sizes in header if file can be rewound */
+	if (fseek(data->file, 0, SEEK_SET) == 0)
+		dump_write_header(data, data->num_frames * FRAME_SIZE);
+
+	/* Flush remaining samples and close file */
+	fclose(data->file);
+
+	free(data->stream_buffer);
+	free(data);
+}
+
+AUDIO_START(dump)
+	.init = dump_init,
+	.enqueue = dump_enqueue,
+	.deinit = dump_deinit
+AUDIO_END
+
@@ -1,20 +1,34 @@
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include <audio.h>
 #include <libretro.h>
 #include <util.h>
 
+#define NUM_CHANNELS		2
+#define FRAME_SIZE		(NUM_CHANNELS * sizeof(int16_t))
+#define MIN_FRAME_RATE		50
+
+/* Samples are accumulated over a whole frame and pushed to the host frontend
+at once when retro_run() returns */
 struct retro_data {
 	int sampling_rate;
 	retro_audio_sample_t audio_cb;
+	retro_audio_sample_batch_t audio_batch_cb;
+	int16_t *buffer;
+	int size;
+	int count;
 	bool enabled;
 };
 
 void retro_audio_fill_timing(struct retro_system_timing *timing);
+void retro_audio_flush();
 
 static bool ret_init(struct audio_frontend *fe, int sampling_rate);
-static void ret_enqueue(struct audio_frontend *fe, int16_t left, int16_t right);
+static void ret_enqueue(struct audio_frontend *fe, int16_t *buffer, int count);
 static void ret_start(struct audio_frontend *fe);
 static void ret_stop(struct audio_frontend *fe);
+static void ret_deinit(struct audio_frontend *fe);
 
 static struct retro_data retro_data;
 
@@ -24,8 +38,10 @@ void retro_set_audio_sample(retro_audio_sample_t cb)
 	retro_data.audio_cb = cb;
 }
 
-void retro_set_audio_sample_batch(retro_audio_sample_batch_t UNUSED(cb))
+void retro_set_audio_sample_batch(retro_audio_sample_batch_t cb)
 {
+	/* Save audio sample batch callback */
+	retro_data.audio_batch_cb = cb;
 }
 
 void retro_audio_fill_timing(struct retro_system_timing *timing)
@@ -34,18 +50,59 @@ void retro_audio_fill_timing(struct retro_system_timing *timing)
 	timing->sample_rate = retro_data.sampling_rate;
 }
 
+void retro_audio_flush()
+{
+	int16_t *buffer = retro_data.buffer;
+	int count = retro_data.count;
+	size_t n;
+	int i;
+
+	/* Push samples accumulated during frame (in one batch, unless host
+	frontend only consumes part of it or lacks batch support) */
+	if (retro_data.audio_batch_cb) {
+		while (count > 0) {
+			n = retro_data.audio_batch_cb(buffer, count);
+			if (n == 0)
+				break;
+			buffer += n * NUM_CHANNELS;
+			count -= n;
+		}
+	} else if (retro_data.audio_cb) {
+		for (i = 0; i < count; i++)
+			retro_data.audio_cb(buffer[2 * i], buffer[2 * i + 1]);
+	}
+
+	/* Empty buffer */
+	retro_data.count = 0;
+}
+
 bool ret_init(struct audio_frontend *UNUSED(fe), int sampling_rate)
 {
 	/* Set audio properties */
 	retro_data.sampling_rate = sampling_rate;
 	retro_data.enabled = false;
+
+	/* Allocate buffer (initially holding a frame at lowest frame rate) */
+	retro_data.size = sampling_rate / MIN_FRAME_RATE;
+	retro_data.count = 0;
+	retro_data.buffer = malloc(retro_data.size * FRAME_SIZE);
 	return true;
 }
 
-void ret_enqueue(struct audio_frontend *UNUSED(fe), int16_t left, int16_t right)
+void ret_enqueue(struct audio_frontend *UNUSED(fe), int16_t *buffer, int count)
 {
-	/* Push sample */
-	retro_data.audio_cb(left, right);
+	/* Grow buffer if frame turns out to hold more samples */
+	if (retro_data.count + count > retro_data.size) {
+		while (retro_data.count + count > retro_data.size)
+			retro_data.size *= 2;
+		retro_data.buffer = realloc(retro_data.buffer,
+			retro_data.size * FRAME_SIZE);
+	}
+
+	/* Append samples to buffer */
+	memcpy(&retro_data.buffer[retro_data.count * NUM_CHANNELS], buffer,
+		count * FRAME_SIZE);
+	retro_data.count += count;
 }
 
 void ret_start(struct audio_frontend *UNUSED(fe))
@@ -60,10 +117,19 @@ void ret_stop(struct audio_frontend *UNUSED(fe))
 	retro_data.enabled = false;
 }
 
+void ret_deinit(struct audio_frontend *UNUSED(fe))
+{
+	/* Free buffer */
+	free(retro_data.buffer);
+	retro_data.buffer = NULL;
+	retro_data.size = 0;
+	retro_data.count = 0;
+}
+
 AUDIO_START(retro)
 	.init = ret_init,
 	.enqueue = ret_enqueue,
 	.start = ret_start,
 	.stop = ret_stop,
+	.deinit = ret_deinit
 AUDIO_END
-
@@ -3,35 +3,57 @@
 #include <string.h>
 #include <SDL.h>
 #include <audio.h>
+#include <cmdline.h>
 #include <log.h>
 #include <util.h>
 
-#define LATENCY_MS_MAX	100
-#define NUM_BUFFERS	4
+#define DEFAULT_LATENCY_MS	64
+#define MIN_LATENCY_MS		10
+#define MIN_DEVICE_SAMPLES	256
+#define NUM_CHANNELS		2
+#define FRAME_SIZE		(NUM_CHANNELS * sizeof(int16_t))
 
 typedef void (*sdl_callback)(void *userdata, Uint8 *stream, int len);
 
+/* Single-producer/single-consumer ring of stereo frames: the emulation thread
+only moves head and the audio thread only moves tail, both running freely (the
+ring size being a power of two) so that no lock is ever needed */
 struct audio_data {
-	uint8_t *buffer;
-	int buffer_size;
-	int head;
-	int tail;
-	int count;
+	int16_t *buffer;
+	unsigned int size;
+	unsigned int target;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int num_underruns;
+	unsigned int num_overruns;
 };
 
 static bool sdl_init(struct audio_frontend *fe, int sampling_rate);
-static void sdl_enqueue(struct audio_frontend *fe, int16_t left, int16_t right);
+static void sdl_enqueue(struct audio_frontend *fe, int16_t *buffer, int count);
 static void sdl_dequeue(struct audio_data *data, void *buffer, int len);
+static float sdl_get_fill(struct audio_frontend *fe);
 static void sdl_start(struct audio_frontend *fe);
 static void sdl_stop(struct audio_frontend *fe);
 static void sdl_deinit(struct audio_frontend *fe);
 
+/* Command-line parameter */
+static int latency = DEFAULT_LATENCY_MS;
+PARAM(latency, int, "audio-latency", NULL, "Sets audio latency (in ms)")
+
 bool sdl_init(struct audio_frontend *fe, int sampling_rate)
 {
 	struct audio_data *audio_data;
 	SDL_AudioSpec desired;
+	int num_frames;
 	int samples;
 
+	/* Validate latency */
+	if (latency < MIN_LATENCY_MS) {
+		LOG_W("Audio latency below %u ms not supported.\n",
+			MIN_LATENCY_MS);
+		latency = DEFAULT_LATENCY_MS;
+	}
+
 	/* Initialize audio sub-system */
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		LOG_E("Error initializing SDL audio: %s\n", SDL_GetError());
@@ -42,25 +64,17 @@ bool sdl_init(struct audio_frontend *fe, int sampling_rate)
 	audio_data = calloc(1, sizeof(struct audio_data));
 	fe->priv_data = audio_data;
 
-	/* Set number of samples based on desired output frequency */
-	switch (sampling_rate) {
-	case 11025:
-		samples = 512;
-		break;
-	case 22050:
-		samples = 1024;
-		break;
-	case 44100:
-	case 48000:
-	default:
-		samples = 2048;
-		break;
-	}
+	/* Get number of frames matching desired latency and set number of
+	device samples to largest power of two within half of it */
+	num_frames = sampling_rate * latency / 1000;
+	samples = MIN_DEVICE_SAMPLES;
+	while (samples * 4 <= num_frames)
+		samples *= 2;
 
 	/* Set audio specs (16-bit signed, stereo) */
 	desired.freq = sampling_rate;
 	desired.format = AUDIO_S16;
-	desired.channels = 2;
+	desired.channels = NUM_CHANNELS;
 	desired.samples = samples;
 	desired.callback = (sdl_callback)sdl_dequeue;
 	desired.userdata = audio_data;
@@ -73,85 +87,99 @@ bool sdl_init(struct audio_frontend *fe, int sampling_rate)
 		return false;
 	}
 
-	/* Compute buffer size (based on desired specs and latency) */
-	audio_data->buffer_size = sampling_rate;
-	audio_data->buffer_size *= 2 * sizeof(int16_t);
-	audio_data->buffer_size *= LATENCY_MS_MAX / 1000.0f;
-	audio_data->buffer_size *= NUM_BUFFERS;
-	LOG_D("Computed audio buffer size: %ub\n", audio_data->buffer_size);
+	/* Size ring as the smallest power of two holding twice the latency */
+	audio_data->size = 1;
+	while (audio_data->size < 2 * (unsigned int)num_frames)
+		audio_data->size *= 2;
+	LOG_D("Computed audio ring size: %u frames\n", audio_data->size);
 
-	/* Initialize audio data */
-	audio_data->buffer = calloc(audio_data->buffer_size, sizeof(uint8_t));
+	/* Initialize audio data (aiming at queuing desired latency) */
+	audio_data->buffer = calloc(audio_data->size, FRAME_SIZE);
+	audio_data->target = num_frames;
 	audio_data->head = 0;
 	audio_data->tail = 0;
-	audio_data->count = 0;
+	audio_data->num_underruns = 0;
+	audio_data->num_overruns = 0;
 
 	return true;
 }
 
-void sdl_enqueue(struct audio_frontend *fe, int16_t left, int16_t right)
+void sdl_enqueue(struct audio_frontend *fe, int16_t *buffer, int count)
 {
 	struct audio_data *data = fe->priv_data;
-	int16_t *buffer = (int16_t *)data->buffer;
-
-	/* Lock access */
-	SDL_LockAudio();
-
-	/* Handle overrun */
-	if (data->count == data->buffer_size)
-		LOG_D("Audio overrun!\n");
-
-	/* Copy data */
-	buffer[data->head / sizeof(int16_t)] = left;
-	buffer[(data->head + sizeof(int16_t)) / sizeof(int16_t)] = right;
-
-	/* Update head */
-	data->head += 2 * sizeof(int16_t);
-	if (data->head == data->buffer_size)
-		data->head = 0;
-
-	/* Update count */
-	data->count += 2 * sizeof(int16_t);
+	unsigned int head = data->head;
+	unsigned int tail;
+	unsigned int space;
+	unsigned int pos;
+	unsigned int n;
+
+	/* Get free space (tail being moved by audio thread) */
+	tail = __atomic_load_n(&data->tail, __ATOMIC_ACQUIRE);
+	space = data->size - (head - tail);
+
+	/* Handle overrun (dropping frames which do not fit) */
+	if ((unsigned int)count > space) {
+		data->num_overruns++;
+		count = space;
+	}
 
-	/* Unlock access */
-	SDL_UnlockAudio();
+	/* Copy frames (in two parts if ring wraps) */
+	pos = head & (data->size - 1);
+	n = data->size - pos;
+	if (n > (unsigned int)count)
+		n = count;
+	memcpy(&data->buffer[pos * NUM_CHANNELS], buffer, n * FRAME_SIZE);
+	memcpy(data->buffer, &buffer[n * NUM_CHANNELS],
+		(count - n) * FRAME_SIZE);
+
+	/* Publish frames to audio thread */
+	__atomic_store_n(&data->head, head + count, __ATOMIC_RELEASE);
 }
 
 void sdl_dequeue(struct audio_data *data, void *buffer, int len)
 {
-	uint8_t *buf = buffer;
-	int len1 = len;
-	int len2 = 0;
-
-	/* Lock access */
-	SDL_LockAudio();
-
-	/* Empty buffer first */
-	SDL_memset(buffer, 0, len);
-
-	/* Handle underrun */
-	if (data->count < len) {
-		LOG_D("Audio underrun!\n");
-		len = data->count;
-		len1 = len;
+	int16_t *buf = buffer;
+	unsigned int tail = data->tail;
+	unsigned int head;
+	unsigned int count;
+	unsigned int avail;
+	unsigned int pos;
+	unsigned int n;
+
+	/* Get available frames (head being moved by emulation thread) */
+	head = __atomic_load_n(&data->head, __ATOMIC_ACQUIRE);
+	avail = head - tail;
+	count = len / FRAME_SIZE;
+
+	/* Handle underrun (filling missing frames with silence) */
+	if (count > avail) {
+		data->num_underruns++;
+		memset(&buf[avail * NUM_CHANNELS], 0,
+			(count - avail) * FRAME_SIZE);
+		count = avail;
 	}
 
-	/* Handle wrapping */
-	if (data->tail + len > data->buffer_size) {
-		len1 = data->buffer_size - data->tail;
-		len2 = len - len1;
-	}
+	/* Copy frames (in two parts if ring wraps) */
+	pos = tail & (data->size - 1);
+	n = data->size - pos;
+	if (n > count)
+		n = count;
+	memcpy(buf, &data->buffer[pos * NUM_CHANNELS], n * FRAME_SIZE);
+	memcpy(&buf[n * NUM_CHANNELS], data->buffer, (count - n) * FRAME_SIZE);
 
-	/* Copy buffer */
-	memcpy(buf, &data->buffer[data->tail], len1);
-	memcpy(&buf[len1], data->buffer, len2);
+	/* Hand space back to emulation thread */
+	__atomic_store_n(&data->tail, tail + count, __ATOMIC_RELEASE);
+}
 
-	/* Move tail and update count */
-	data->tail = (data->tail + len) % data->buffer_size;
-	data->count -= len;
+float sdl_get_fill(struct audio_frontend *fe)
+{
+	struct audio_data *data = fe->priv_data;
+	unsigned int tail;
 
-	/* Unlock access */
-	SDL_UnlockAudio();
+	/* Compare queued frames with target (tail being moved by audio
+	thread) */
+	tail = __atomic_load_n(&data->tail, __ATOMIC_ACQUIRE);
+	return (float)(data->head - tail) / data->target;
 }
 
 void sdl_start(struct audio_frontend *UNUSED(fe))
@@ -167,15 +195,25 @@ void sdl_stop(struct audio_frontend *UNUSED(fe))
 void sdl_deinit(struct audio_frontend *fe)
 {
 	struct audio_data *audio_data = fe->priv_data;
-	free(audio_data->buffer);
-	free(audio_data);
+
+	/* Close device first so that audio thread is done with ring */
 	SDL_CloseAudio();
 	SDL_QuitSubSystem(SDL_INIT_AUDIO);
+
+	/* Report underruns and overruns if any */
+	if ((audio_data->num_underruns > 0) || (audio_data->num_overruns > 0))
+		LOG_I("Audio underruns: %u, overruns: %u.\n",
+			audio_data->num_underruns,
+			audio_data->num_overruns);
+
+	free(audio_data->buffer);
+	free(audio_data);
 }
 
 AUDIO_START(sdl)
 	.init = sdl_init,
 	.enqueue = sdl_enqueue,
+	.get_fill = sdl_get_fill,
 	.start = sdl_start,
 	.stop = sdl_stop,
 	.deinit = sdl_deinit
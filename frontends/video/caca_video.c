@@ -12,11 +12,8 @@
 
 #define BPP 32
 #define R_MASK	0x00FF0000
-#define R_SHIFT	16
 #define G_MASK	0x0000FF00
-#define G_SHIFT	8
 #define B_MASK	0x000000FF
-#define B_SHIFT	0
 #define A_MASK	0x00000000
 
 struct caca_data {
@@ -24,15 +21,12 @@ struct caca_data {
 	int width;
 	int height;
 	int scale;
-	uint32_t *pixels;
 	caca_dither_t *dither;
 };
 
 static window_t *caca_init(struct video_frontend *fe, struct video_specs *vs);
-static void caca_update(struct video_frontend *fe);
+static void caca_update(struct video_frontend *fe, uint32_t *pixels);
 static window_t *caca_set_size(struct video_frontend *fe, int w, int h);
-static struct color caca_get_p(struct video_frontend *fe, int x, int y);
-static void caca_set_p(struct video_frontend *fe, int x, int y, struct color c);
 static void caca_deinit(struct video_frontend *fe);
 
 window_t *caca_init(struct video_frontend *fe, struct video_specs *vs)
@@ -65,9 +59,6 @@ window_t *caca_init(struct video_frontend *fe, struct video_specs *vs)
 	data->scale = s;
 	fe->priv_data = data;
 
-	/* Initialize pixels */
-	data->pixels = calloc(w * h, sizeof(uint32_t));
-
 	/* Initialize dither */
 	pitch = (BPP / 8) * w;
 	data->dither = caca_create_dither(BPP, w, h, pitch, R_MASK, G_MASK,
@@ -76,7 +67,7 @@ window_t *caca_init(struct video_frontend *fe, struct video_specs *vs)
 	return dp;
 }
 
-void caca_update(struct video_frontend *fe)
+void caca_update(struct video_frontend *fe, uint32_t *pixels)
 {
 	struct caca_data *data = fe->priv_data;
 	caca_display_t *dp = data->dp;
@@ -84,7 +75,7 @@ void caca_update(struct video_frontend *fe)
 
 	/* Dither pixels and fill canvas */
 	caca_dither_bitmap(cv, 0, 0, caca_get_canvas_width(cv),
-		caca_get_canvas_height(cv), data->dither, data->pixels);
+		caca_get_canvas_height(cv), data->dither, pixels);
 
 	caca_refresh_display(dp);
 }
@@ -100,7 +91,6 @@ window_t *caca_set_size(struct video_frontend *fe, int w, int h)
 	caca_free_dither(data->dither);
 	caca_free_canvas(caca_get_canvas(data->dp));
 	caca_free_display(data->dp);
-	free(data->pixels);
 
 	/* Re-create canvas and display */
 	cv = caca_create_canvas(w * s / CHAR_WIDTH, h * s / CHAR_HEIGHT);
@@ -108,9 +98,6 @@ window_t *caca_set_size(struct video_frontend *fe, int w, int h)
 	caca_set_display_title(data->dp, "emux");
 	caca_refresh_display(data->dp);
 
-	/* Re-initialize pixels */
-	data->pixels = calloc(w * h, sizeof(uint32_t));
-
 	/* Re-initialize dither */
 	pitch = (BPP / 8) * w;
 	data->dither = caca_create_dither(BPP, w, h, pitch, R_MASK, G_MASK,
@@ -123,27 +110,6 @@ window_t *caca_set_size(struct video_frontend *fe, int w, int h)
 	return data->dp;
 }
 
-struct color caca_get_p(struct video_frontend *fe, int x, int y)
-{
-	struct caca_data *data = fe->priv_data;
-	uint32_t pixel = data->pixels[x + y * data->width];
-	struct color c;
-	c.r = (pixel & R_MASK) >> R_SHIFT;
-	c.g = (pixel & G_MASK) >> G_SHIFT;
-	c.b = (pixel & B_MASK) >> B_SHIFT;
-	return c;
-}
-
-void caca_set_p(struct video_frontend *fe, int x, int y, struct color c)
-{
-	struct caca_data *data = fe->priv_data;
-	uint32_t pixel = 0;
-	pixel |= c.r << R_SHIFT;
-	pixel |= c.g << G_SHIFT;
-	pixel |= c.b << B_SHIFT;
-	data->pixels[x + y * data->width] = pixel;
-}
-
 void caca_deinit(struct video_frontend *fe)
 {
 	struct caca_data *data = fe->priv_data;
@@ -152,7 +118,6 @@ void caca_deinit(struct video_frontend *fe)
 	caca_free_dither(data->dither);
 	caca_free_canvas(caca_get_canvas(dp));
 	caca_free_display(dp);
-	free(data->pixels);
 	free(data);
 }
 
@@ -161,8 +126,6 @@ VIDEO_START(caca)
 	.init = caca_init,
 	.update = caca_update,
 	.set_size = caca_set_size,
-	.get_p = caca_get_p,
-	.set_p = caca_set_p,
 	.deinit = caca_deinit
 VIDEO_END
 
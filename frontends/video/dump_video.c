@@ -0,0 +1,186 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmdline.h>
+#include <log.h>
+#include <util.h>
+#include <video.h>
+
+#define DEFAULT_PATH		"emux.y4m"
+#define Y4M_EXTENSION		".y4m"
+#define FPS_DENOMINATOR		1000
+#define STREAM_BUFFER_SIZE	(1 << 20)
+
+enum dump_format {
+	DUMP_FORMAT_PPM,
+	DUMP_FORMAT_Y4M
+};
+
+/* Frames are streamed to a file or pipe, either as a Y4M stream (4:4:4 planes,
+which video encoders consume directly) or as concatenated binary PPM images */
+struct dump_data {
+	FILE *file;
+	char *stream_buffer;
+	enum dump_format format;
+	uint8_t *frame;
+	int width;
+	int height;
+	float fps;
+};
+
+static window_t *dump_init(struct video_frontend *fe, struct video_specs *vs);
+static void dump_write_y4m(struct dump_data *data, uint32_t *pixels);
+static void dump_write_ppm(struct dump_data *data, uint32_t *pixels);
+static void dump_update(struct video_frontend *fe, uint32_t *pixels);
+static window_t *dump_set_size(struct video_frontend *fe, int w, int h);
+static void dump_deinit(struct video_frontend *fe);
+
+/* Command-line parameter */
+static char *dump_path = DEFAULT_PATH;
+PARAM(dump_path, string, "dump-video", NULL,
+	"Sets video dump path (Y4M if ending with .y4m, PPM otherwise)")
+
+window_t *dump_init(struct video_frontend *fe, struct video_specs *vs)
+{
+	struct dump_data *data;
+	size_t len = strlen(dump_path);
+	size_t ext_len = strlen(Y4M_EXTENSION);
+	FILE *file;
+
+	/* Open dump file (which may be a named pipe) */
+	file = fopen(dump_path, "wb");
+	if (!file) {
+		LOG_E("Could not open video dump file \"%s\"!\n", dump_path);
+		return NULL;
+	}
+
+	/* Create private data */
+	data = calloc(1, sizeof(struct dump_data));
+	data->file = file;
+	data->width = vs->width;
+	data->height = vs->height;
+	data->fps = vs->fps;
+	data->frame = malloc(vs->width * vs->height * 3);
+	fe->priv_data = data;
+
+	/* Write frames through a large buffer to limit system calls */
+	data->stream_buffer = malloc(STREAM_BUFFER_SIZE);
+	setvbuf(file, data->stream_buffer, _IOFBF, STREAM_BUFFER_SIZE);
+
+	/* Select format from file extension */
+	data->format = DUMP_FORMAT_PPM;
+	if ((len >= ext_len) &&
+		!strcmp(&dump_path[len - ext_len], Y4M_EXTENSION))
+		data->format = DUMP_FORMAT_Y4M;
+
+	/* Write stream header (frame rate being expressed as a fraction) */
+	if (data->format == DUMP_FORMAT_Y4M)
+		fprintf(file, "YUV4MPEG2 W%u H%u F%u:%u Ip A1:1 C444\n",
+			data->width,
+			data->height,
+			(unsigned int)lround(data->fps * FPS_DENOMINATOR),
+			FPS_DENOMINATOR);
+
+	/* Return success (no window is returned) */
+	return (window_t *)1;
+}
+
+void dump_write_y4m(struct dump_data *data, uint32_t *pixels)
+{
+	int num_pixels = data->width * data->height;
+	uint8_t *y = data->frame;
+	uint8_t *u = &y[num_pixels];
+	uint8_t *v = &u[num_pixels];
+	int r;
+	int g;
+	int b;
+	int i;
+
+	/* Convert pixels to limited-range BT.601 planes */
+	for (i = 0; i < num_pixels; i++) {
+		r = (pixels[i] >> 16) & 0xFF;
+		g = (pixels[i] >> 8) & 0xFF;
+		b = pixels[i] & 0xFF;
+		y[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+		u[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+		v[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+	}
+
+	/* Write frame header and planes */
+	fputs("FRAME\n", data->file);
+	fwrite(data->frame, 3, num_pixels, data->file);
+}
+
+void dump_write_ppm(struct dump_data *data, uint32_t *pixels)
+{
+	int num_pixels = data->width * data->height;
+	uint8_t *rgb = data->frame;
+	int i;
+
+	/* Convert pixels to packed RGB triplets */
+	for (i = 0; i < num_pixels; i++) {
+		*rgb++ = pixels[i] >> 16;
+		*rgb++ = pixels[i] >> 8;
+		*rgb++ = pixels[i];
+	}
+
+	/* Write image header and pixels */
+	fprintf(data->file, "P6\n%u %u\n255\n", data->width, data->height);
+	fwrite(data->frame, 3, num_pixels, data->file);
+}
+
+void dump_update(struct video_frontend *fe, uint32_t *pixels)
+{
+	struct dump_data *data = fe->priv_data;
+
+	/* Write frame in selected format */
+	switch (data->format) {
+	case DUMP_FORMAT_Y4M:
+		dump_write_y4m(data, pixels);
+		break;
+	case DUMP_FORMAT_PPM:
+	default:
+		dump_write_ppm(data, pixels);
+		break;
+	}
+}
+
+window_t *dump_set_size(struct video_frontend *fe, int w, int h)
+{
+	struct dump_data *data = fe->priv_data;
+
+	/* Y4M streams cannot change dimensions, so warn about it */
+	if (data->format == DUMP_FORMAT_Y4M)
+		LOG_W("Video size changed within Y4M dump stream!\n");
+
+	/* Save dimensions and re-allocate frame */
+	data->width = w;
+	data->height = h;
+	free(data->frame);
+	data->frame = malloc(w * h * 3);
+
+	return (window_t *)1;
+}
+
+void dump_deinit(struct video_frontend *fe)
+{
+	struct dump_data *data = fe->priv_data;
+
+	/* Flush remaining frames and close file */
+	fclose(data->file);
+
+	free(data->stream_buffer);
+	free(data->frame);
+	free(data);
+}
+
+VIDEO_START(dump)
+	.init = dump_init,
+	.update = dump_update,
+	.set_size = dump_set_size,
+	.deinit = dump_deinit
+VIDEO_END
+
@@ -0,0 +1,15 @@
+#include <stdint.h>
+#include <util.h>
+#include <video.h>
+
+static void null_update(struct video_frontend *fe, uint32_t *pixels);
+
+void null_update(struct video_frontend *UNUSED(fe), uint32_t *UNUSED(pixels))
+{
+	/* Drop frame (which was still fully converted) */
+}
+
+VIDEO_START(null)
+	.update = null_update
+VIDEO_END
+
@@ -25,7 +25,6 @@ struct gl {
 	int width;
 	int height;
 	int scale;
-	uint8_t *pixels;
 	GLuint vbo;
 	GLuint program;
 	GLuint vertex_shader;
@@ -42,13 +41,11 @@ struct vertex {
 
 static window_t *gl_init(struct video_frontend *fe, struct video_specs *vs);
 static void gl_deinit(struct video_frontend *fe);
-static void gl_update(struct video_frontend *fe);
+static void gl_update(struct video_frontend *fe, uint32_t *pixels);
 static window_t *gl_set_size(struct video_frontend *fe, int w, int h);
-static struct color gl_get_p(struct video_frontend *fe, int x, int y);
-static void gl_set_p(struct video_frontend *fe, int x, int y, struct color c);
 static bool init_shaders(struct video_frontend *fe);
 static void init_buffers(struct video_frontend *fe);
-static void init_pixels(struct video_frontend *fe);
+static void init_texture(struct video_frontend *fe);
 
 struct vertex vertices[] = {
 	{ { MIN_POS, MAX_POS }, { MIN_UV, MIN_UV } },
@@ -133,14 +130,11 @@ void init_buffers(struct video_frontend *fe)
 		(GLvoid *)offsetof(struct vertex, uv));
 }
 
-void init_pixels(struct video_frontend *fe)
+void init_texture(struct video_frontend *fe)
 {
 	struct gl *gl = fe->priv_data;
 	int location;
 
-	/* Initialize pixels */
-	gl->pixels = calloc(gl->width * gl->height * 3, sizeof(uint8_t));
-
 	/* Generate and bind texture */
 	glGenTextures(1, &gl->texture);
 	glActiveTexture(GL_TEXTURE0);
@@ -156,16 +150,16 @@ void init_pixels(struct video_frontend *fe)
 	location = glGetUniformLocation(gl->program, "texture");
 	glUniform1i(location, 0);
 
-	/* Fill texture data */
+	/* Allocate texture data (filled on each update) */
 	glTexImage2D(GL_TEXTURE_2D,
 		0,
 		GL_RGB,
 		gl->width,
 		gl->height,
 		0,
-		GL_RGB,
-		GL_UNSIGNED_BYTE,
-		gl->pixels);
+		GL_BGRA,
+		GL_UNSIGNED_INT_8_8_8_8_REV,
+		NULL);
 }
 
 window_t *gl_init(struct video_frontend *fe, struct video_specs *vs)
@@ -221,14 +215,14 @@ window_t *gl_init(struct video_frontend *fe, struct video_specs *vs)
 		return NULL;
 	}
 
-	/* Initialize buffers and pixels */
+	/* Initialize buffers and texture */
 	init_buffers(fe);
-	init_pixels(fe);
+	init_texture(fe);
 
 	return window;
 }
 
-void gl_update(struct video_frontend *fe)
+void gl_update(struct video_frontend *fe, uint32_t *pixels)
 {
 	struct gl *gl = fe->priv_data;
 
@@ -239,16 +233,16 @@ void gl_update(struct video_frontend *fe)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	/* Update texture data */
+	/* Update texture data (XRGB8888 pixels) */
 	glTexSubImage2D(GL_TEXTURE_2D,
 		0,
 		0,
 		0,
 		gl->width,
 		gl->height,
-		GL_RGB,
-		GL_UNSIGNED_BYTE,
-		gl->pixels);
+		GL_BGRA,
+		GL_UNSIGNED_INT_8_8_8_8_REV,
+		pixels);
 
 	/* Set current program */
 	glUseProgram(gl->program);
@@ -272,50 +266,18 @@ window_t *gl_set_size(struct video_frontend *fe, int w, int h)
 	gl->width = w;
 	gl->height = h;
 
-	/* Free pixels and delete texture */
-	free(gl->pixels);
+	/* Delete and re-initialize texture */
 	glDeleteTextures(1, &gl->texture);
-
-	/* Re-initialize pixels */
-	init_pixels(fe);
+	init_texture(fe);
 
 	return gl->window;
 }
 
-struct color gl_get_p(struct video_frontend *fe, int x, int y)
-{
-	struct gl *gl = fe->priv_data;
-	struct color c;
-
-	/* Compute index of RGB triplet */
-	int index = 3 * (x + y * gl->width);
-
-	/* Fill color and return it */
-	c.r = gl->pixels[index];
-	c.g = gl->pixels[index + 1];
-	c.b = gl->pixels[index + 2];
-	return c;
-}
-
-void gl_set_p(struct video_frontend *fe, int x, int y, struct color c)
-{
-	struct gl *gl = fe->priv_data;
-
-	/* Compute index of RGB triplet */
-	int index = 3 * (x + y * gl->width);
-
-	/* Save pixel */
-	gl->pixels[index] = c.r;
-	gl->pixels[index + 1] = c.g;
-	gl->pixels[index + 2] = c.b;
-}
-
 void gl_deinit(struct video_frontend *fe)
 {
 	struct gl *gl = fe->priv_data;
 
 	/* Free allocated components */
-	free(gl->pixels);
 	glDeleteBuffers(1, &gl->vbo);
 	glDeleteTextures(1, &gl->texture);
 	glDeleteShader(gl->vertex_shader);
@@ -338,8 +300,6 @@ VIDEO_START(opengl)
 	.init = gl_init,
 	.update = gl_update,
 	.set_size = gl_set_size,
-	.get_p = gl_get_p,
-	.set_p = gl_set_p,
 	.deinit = gl_deinit
 VIDEO_END
 
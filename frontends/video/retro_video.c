@@ -8,15 +8,8 @@
 #include <video.h>
 
 #define BPP 32
-#define R_MASK	0x00FF0000
-#define R_SHIFT	16
-#define G_MASK	0x0000FF00
-#define G_SHIFT	8
-#define B_MASK	0x000000FF
-#define B_SHIFT	0
 
 struct retro_data {
-	uint32_t *pixels;
 	int width;
 	int height;
 	double fps;
@@ -28,11 +21,8 @@ void retro_video_fill_timing(struct retro_system_timing *timing);
 void retro_video_fill_geometry(struct retro_game_geometry *geometry);
 
 static window_t *ret_init(struct video_frontend *fe, struct video_specs *vs);
-static void ret_update(struct video_frontend *fe);
+static void ret_update(struct video_frontend *fe, uint32_t *pixels);
 static window_t *ret_set_size(struct video_frontend *fe, int w, int h);
-static struct color ret_get_p(struct video_frontend *fe, int x, int y);
-static void ret_set_p(struct video_frontend *fe, int x, int y, struct color c);
-static void ret_deinit(struct video_frontend *fe);
 
 extern retro_environment_t retro_environment_cb;
 static struct retro_data retro_data;
@@ -67,9 +57,6 @@ window_t *ret_init(struct video_frontend *UNUSED(fe), struct video_specs *vs)
 		return NULL;
 	}
 
-	/* Initialize pixels */
-	retro_data.pixels = calloc(vs->width * vs->height, sizeof(uint32_t));
-
 	/* Save dimensions and FPS */
 	retro_data.width = vs->width;
 	retro_data.height = vs->height;
@@ -79,13 +66,13 @@ window_t *ret_init(struct video_frontend *UNUSED(fe), struct video_specs *vs)
 	return (window_t *)1;
 }
 
-void ret_update(struct video_frontend *UNUSED(fe))
+void ret_update(struct video_frontend *UNUSED(fe), uint32_t *pixels)
 {
 	int pitch;
 
-	/* Refresh screen */
+	/* Refresh screen (handing frame buffer over with no copy) */
 	pitch = retro_data.width * (BPP / 8);
-	retro_data.video_cb(retro_data.pixels,
+	retro_data.video_cb(pixels,
 		retro_data.width,
 		retro_data.height,
 		pitch);
@@ -98,18 +85,12 @@ window_t *ret_set_size(struct video_frontend *UNUSED(fe), int w, int h)
 {
 	struct retro_game_geometry geometry;
 
-	/* Free pixels */
-	free(retro_data.pixels);
-
 	/* Update geometry */
 	retro_data.width = w;
 	retro_data.height = h;
 	geometry.base_width = w;
 	geometry.base_height = h;
 
-	/* Re-initialize pixels */
-	retro_data.pixels = calloc(w * h, sizeof(uint32_t));
-
 	/* Request geometry update */
 	if (!retro_environment_cb(RETRO_ENVIRONMENT_SET_GEOMETRY, &geometry))
 		LOG_E("Could not update geometry!\n");
@@ -118,37 +99,10 @@ window_t *ret_set_size(struct video_frontend *UNUSED(fe), int w, int h)
 	return (window_t *)1;
 }
 
-struct color ret_get_p(struct video_frontend *UNUSED(fe), int x, int y)
-{
-	uint32_t pixel = retro_data.pixels[x + y * retro_data.width];
-	struct color c;
-	c.r = (pixel & R_MASK) >> R_SHIFT;
-	c.g = (pixel & G_MASK) >> G_SHIFT;
-	c.b = (pixel & B_MASK) >> B_SHIFT;
-	return c;
-}
-
-void ret_set_p(struct video_frontend *UNUSED(fe), int x, int y, struct color c)
-{
-	uint32_t pixel = 0;
-	pixel |= c.r << R_SHIFT;
-	pixel |= c.g << G_SHIFT;
-	pixel |= c.b << B_SHIFT;
-	retro_data.pixels[x + y * retro_data.width] = pixel;
-}
-
-void ret_deinit(struct video_frontend *UNUSED(fe))
-{
-	free(retro_data.pixels);
-}
-
 VIDEO_START(retro)
 	.input = "retro",
 	.init = ret_init,
 	.update = ret_update,
-	.set_size = ret_set_size,
-	.get_p = ret_get_p,
-	.set_p = ret_set_p,
-	.deinit = ret_deinit
+	.set_size = ret_set_size
 VIDEO_END
 
@@ -6,23 +6,8 @@
 #include <util.h>
 #include <video.h>
 
-#define BIT_DEPTH	32
-
-#if SDL_BYTEORDER == SDL_BIG_ENDIAN
-#define RMASK		0xFF000000
-#define GMASK		0x00FF0000
-#define BMASK		0x0000FF00
-#define AMASK		0x000000FF
-#else
-#define RMASK		0x000000FF
-#define GMASK		0x0000FF00
-#define BMASK		0x00FF0000
-#define AMASK		0xFF000000
-#endif
-
 struct sdl_data {
 	SDL_Window *window;
-	SDL_Surface *screen;
 	SDL_Renderer *renderer;
 	SDL_Texture *texture;
 	int width;
@@ -31,12 +16,8 @@ struct sdl_data {
 };
 
 static window_t *sdl_init(struct video_frontend *fe, struct video_specs *vs);
-static void sdl_update(struct video_frontend *fe);
-static void sdl_lock(struct video_frontend *fe);
-static void sdl_unlock(struct video_frontend *fe);
+static void sdl_update(struct video_frontend *fe, uint32_t *pixels);
 static window_t *sdl_set_size(struct video_frontend *fe, int w, int h);
-static struct color sdl_get_p(struct video_frontend *fe, int x, int y);
-static void sdl_set_p(struct video_frontend *fe, int x, int y, struct color c);
 static void sdl_deinit(struct video_frontend *fe);
 
 window_t *sdl_init(struct video_frontend *fe, struct video_specs *vs)
@@ -44,7 +25,6 @@ window_t *sdl_init(struct video_frontend *fe, struct video_specs *vs)
 	struct sdl_data *data;
 	SDL_Window *window;
 	SDL_Renderer *renderer;
-	SDL_Surface *screen;
 	SDL_Texture *texture;
 	int w = vs->width * vs->scale;
 	int h = vs->height * vs->scale;
@@ -76,27 +56,12 @@ window_t *sdl_init(struct video_frontend *fe, struct video_specs *vs)
 		return NULL;
 	}
 
-	/* Create screen */
-	screen = SDL_CreateRGBSurface(0,
-		w,
-		h,
-		BIT_DEPTH,
-		RMASK,
-		GMASK,
-		BMASK,
-		AMASK);
-	if (!screen) {
-		LOG_E("Error creating surface: %s\n", SDL_GetError());
-		SDL_VideoQuit();
-		return NULL;
-	}
-
-	/* Create texture based on screen format */
+	/* Create native-resolution texture (scaled by renderer) */
 	texture = SDL_CreateTexture(renderer,
-		screen->format->format,
+		SDL_PIXELFORMAT_RGB888,
 		SDL_TEXTUREACCESS_STREAMING,
-		w,
-		h);
+		vs->width,
+		vs->height);
 	if (!texture) {
 		LOG_E("Error creating texture: %s\n", SDL_GetError());
 		SDL_VideoQuit();
@@ -106,7 +71,6 @@ window_t *sdl_init(struct video_frontend *fe, struct video_specs *vs)
 	/* Create and fill private data */
 	data = calloc(1, sizeof(struct sdl_data));
 	data->window = window;
-	data->screen = screen;
 	data->renderer = renderer;
 	data->texture = texture;
 	data->width = vs->width;
@@ -114,39 +78,23 @@ window_t *sdl_init(struct video_frontend *fe, struct video_specs *vs)
 	data->scale = vs->scale;
 	fe->priv_data = data;
 
-	return screen;
+	return window;
 }
 
-void sdl_update(struct video_frontend *fe)
+void sdl_update(struct video_frontend *fe, uint32_t *pixels)
 {
 	struct sdl_data *data = fe->priv_data;
-	SDL_Surface *screen = data->screen;
 	SDL_Renderer *renderer = data->renderer;
 	SDL_Texture *texture = data->texture;
+	int pitch = data->width * sizeof(uint32_t);
 
-	SDL_UpdateTexture(texture, NULL, screen->pixels, screen->pitch);
+	/* Upload whole frame and present it */
+	SDL_UpdateTexture(texture, NULL, pixels, pitch);
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, NULL, NULL);
 	SDL_RenderPresent(renderer);
 }
 
-void sdl_lock(struct video_frontend *fe)
-{
-	struct sdl_data *data = fe->priv_data;
-	SDL_Surface *screen = data->screen;
-
-	if (SDL_MUSTLOCK(screen) && (SDL_LockSurface(screen) < 0))
-		LOG_W("Couldn't lock surface: %s\n", SDL_GetError());
-}
-
-void sdl_unlock(struct video_frontend *fe)
-{
-	struct sdl_data *data = fe->priv_data;
-	SDL_Surface *screen = data->screen;
-	if (SDL_MUSTLOCK(screen))
-		SDL_UnlockSurface(screen);
-}
-
 window_t *sdl_set_size(struct video_frontend *fe, int w, int h)
 {
 	struct sdl_data *data = fe->priv_data;
@@ -155,95 +103,18 @@ window_t *sdl_set_size(struct video_frontend *fe, int w, int h)
 	data->width = w;
 	data->height = h;
 
-	/* Adapt dimensions based on scale */
-	w *= data->scale;
-	h *= data->scale;
-
-	/* Free existing screen surface and texture */
-	SDL_FreeSurface(data->screen);
-	SDL_DestroyTexture(data->texture);
-
-	/* Update window size */
-	SDL_SetWindowSize(data->window, w, h);
-
-	/* Re-create screen surface */
-	data->screen = SDL_CreateRGBSurface(0,
-		w,
-		h,
-		BIT_DEPTH,
-		RMASK,
-		GMASK,
-		BMASK,
-		AMASK);
+	/* Update window size based on scale */
+	SDL_SetWindowSize(data->window, w * data->scale, h * data->scale);
 
 	/* Re-create texture */
+	SDL_DestroyTexture(data->texture);
 	data->texture = SDL_CreateTexture(data->renderer,
-		data->screen->format->format,
+		SDL_PIXELFORMAT_RGB888,
 		SDL_TEXTUREACCESS_STREAMING,
 		w,
 		h);
 
-	return data->screen;
-}
-
-struct color sdl_get_p(struct video_frontend *fe, int x, int y)
-{
-	struct sdl_data *data = fe->priv_data;
-	SDL_Surface *screen = data->screen;
-	int bpp = screen->format->BytesPerPixel;
-	uint8_t *p;
-	uint32_t pixel;
-	struct color color;
-
-	/* Apply scaling factor to coordinates and get pixel pointer */
-	x *= data->scale;
-	y *= data->scale;
-	p = (uint8_t *)screen->pixels + y * screen->pitch + x * bpp;
-
-	/* Read pixel */
-	memcpy(&pixel, p, bpp);
-
-	/* Get RGB components */
-	SDL_GetRGB(pixel, screen->format, &color.r, &color.g, &color.b);
-	return color;
-}
-
-void sdl_set_p(struct video_frontend *fe, int x, int y, struct color c)
-{
-	struct sdl_data *data = fe->priv_data;
-	SDL_Surface *screen = data->screen;
-	uint32_t pixel;
-	int bpp = screen->format->BytesPerPixel;
-	uint8_t *p1;
-	uint8_t *p2;
-	int i;
-	int j;
-
-	/* Map color */
-	pixel = SDL_MapRGB(screen->format, c.r, c.g, c.b);
-
-	/* Apply scaling factor to coordinates */
-	x *= data->scale;
-	y *= data->scale;
-
-	/* Set pixel contents */
-	p1 = (uint8_t *)screen->pixels + y * screen->pitch + x * bpp;
-	memcpy(p1, &pixel, bpp);
-
-	/* Write remaining square of pixels depending on scaling factor */
-	for (i = x; i < x + data->scale; i++)
-		for (j = y; j < y + data->scale; j++) {
-			/* Skip source pixel */
-			if ((i == x) && (j == y))
-				continue;
-
-			/* Compute pixel pointer */
-			p2 = (uint8_t *)screen->pixels + j * screen->pitch +
-				i * bpp;
-
-			/* Copy previous pixel contents */
-			memcpy(p2, p1, bpp);
-		}
+	return data->window;
 }
 
 void sdl_deinit(struct video_frontend *fe)
@@ -253,7 +124,6 @@ void sdl_deinit(struct video_frontend *fe)
 	/* Free SDL resources */
 	SDL_DestroyTexture(data->texture);
 	SDL_DestroyRenderer(data->renderer);
-	SDL_FreeSurface(data->screen);
 
 	/* Free subsystem and private data */
 	SDL_QuitSubSystem(SDL_INIT_VIDEO);
@@ -264,10 +134,6 @@ VIDEO_START(sdl)
 	.input = "sdl",
 	.init = sdl_init,
 	.update = sdl_update,
-	.lock = sdl_lock,
-	.unlock = sdl_unlock,
 	.set_size = sdl_set_size,
-	.get_p = sdl_get_p,
-	.set_p = sdl_set_p,
 	.deinit = sdl_deinit
 VIDEO_END
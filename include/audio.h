@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <list.h>
+#include <state.h>
+#include <util.h>
 
 #define AUDIO_START(_name) \
 	static struct audio_frontend _audio_frontend = { \
@@ -19,13 +21,18 @@
 		list_remove(&audio_frontends, &_audio_frontend); \
 	}
 
+#define SYNTH_PHASE_BITS	5
+#define SYNTH_NUM_PHASES	(1 << SYNTH_PHASE_BITS)
+#define SYNTH_WIDTH		16
+
 typedef void audio_priv_data_t;
 
 enum audio_format {
 	AUDIO_FORMAT_U8,
 	AUDIO_FORMAT_S8,
 	AUDIO_FORMAT_U16,
-	AUDIO_FORMAT_S16
+	AUDIO_FORMAT_S16,
+	AUDIO_FORMAT_DELTA
 };
 
 struct audio_specs {
@@ -34,23 +41,104 @@ struct audio_specs {
 	int channels;
 };
 
+/* Frontends able to report how full their queue is (1.0 meaning their target
+latency is queued) let audio pace emulation and get their output rate slightly
+adjusted so that the queue stays around its target level */
 struct audio_frontend {
 	char *name;
 	audio_priv_data_t *priv_data;
 	bool (*init)(struct audio_frontend *fe, int sampling_rate);
-	void (*enqueue)(struct audio_frontend *fe, int16_t left, int16_t right);
+	void (*enqueue)(struct audio_frontend *fe, int16_t *buffer, int count);
+	float (*get_fill)(struct audio_frontend *fe);
 	void (*start)(struct audio_frontend *fe);
 	void (*stop)(struct audio_frontend *fe);
 	void (*deinit)(struct audio_frontend *fe);
 };
 
+/* Block samples are summed by groups (bringing input rate down to a few times
+the output rate) and appended to a per-channel history which is filtered by a
+windowed-sinc kernel at every output position (the kernel phase matching the
+fractional part of the position) */
+struct resample_data {
+	enum audio_format format;
+	int num_channels;
+	int num_taps;
+	float *kernel;
+	int decimation;
+	int decimation_count;
+	int decimation_sum[2];
+	float *history[2];
+	int history_count;
+	double ratio;
+	uint64_t step;
+	uint64_t pos;
+	float (*dot)(float *a, float *b, int n);
+};
+
+/* Chips using the delta format only report amplitude changes (along with the
+master cycle at which they occur), which get spread over a band-limited step
+and integrated into output samples directly at the frontend rate */
+struct synth_data {
+	int16_t kernel[SYNTH_NUM_PHASES][SYNTH_WIDTH];
+	int32_t *buffer;
+	int size;
+	uint64_t factor;
+	uint64_t cycle;
+	uint64_t offset;
+	int sum;
+};
+
+/* Audio state of a machine (see machine_set_context) */
+struct audio_context {
+	struct audio_frontend *frontend;
+	struct resample_data resample_data;
+	struct synth_data synth_data;
+	int rate;
+	double rate_adjust;
+	uint8_t *block;
+	int block_size;
+	int block_count;
+	int sample_size;
+	int16_t *output;
+	uint64_t hash;
+	bool muted;
+};
+
 bool audio_init();
 void audio_enqueue(void *buffer, int count);
+void audio_add_delta(int delta);
+void audio_flush();
+void audio_reset();
+bool audio_sync();
 void audio_start();
 void audio_stop();
+void audio_set_mute(bool mute);
+uint64_t audio_hash();
+void audio_serialize(struct state *state);
+void audio_deserialize(struct state *state);
 void audio_deinit();
 
 extern struct list_link *audio_frontends;
+extern THREAD_LOCAL struct audio_context *audio_ctx;
+
+/* Chips write samples (in their own format) to a block which gets resampled
+as a whole once full or once a frame is complete, and handed to the frontend
+as a contiguous buffer of interleaved 16-bit stereo samples. A request may
+not exceed a block (which holds a fraction of a second of samples). */
+static inline void *audio_get_buffer(int count)
+{
+	struct audio_context *ctx = audio_ctx;
+	void *buffer;
+
+	/* Flush block first if it cannot hold requested samples */
+	if (ctx->block_count + count > ctx->block_size)
+		audio_flush();
+
+	/* Reserve samples within block */
+	buffer = &ctx->block[ctx->block_count * ctx->sample_size];
+	ctx->block_count += count;
+	return buffer;
+}
 
 #endif
 
@@ -3,30 +3,87 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <state.h>
+#include <util.h>
+
+/* Scheduling keys hold the master cycle at which a clock is due in their upper
+bits and the clock index in their lower bits, so that clocks due at the same
+cycle tick in registration order */
+#define CLOCK_INDEX_BITS	8
+#define MAX_CLOCKS		(1 << CLOCK_INDEX_BITS)
 
 typedef void clock_data_t;
 typedef void (*clock_tick_t)(clock_data_t *data);
 
 struct clock {
 	float rate;
-	float div;
-	float num_remaining_cycles;
+	uint64_t div;
+	int64_t num_remaining_cycles;
 	bool enabled;
 	clock_data_t *data;
 	clock_tick_t tick;
+	uint64_t key;
+	int queue_pos;
 };
 
 void clock_add(struct clock *clock);
 void clock_reset();
-void clock_tick_all(bool handle_delay);
+void clock_tick_all();
+uint64_t clock_run(uint64_t num_cycles);
+void clock_stop();
+void clock_sync();
+double clock_get_rate();
+void clock_serialize(struct state *state);
+void clock_deserialize(struct state *state);
+void clock_set_enabled(struct clock *clock, bool enabled);
+void clock_schedule(struct clock *clock, int num_cycles);
+void clock_schedule_at(struct clock *clock, uint64_t cycle);
 void clock_remove_all();
 
-extern struct clock *current_clock;
+/* Clock state of a machine (see machine_set_context) */
+struct clock_context {
+	struct clock **clocks;
+	int num_clocks;
+	struct clock **queue;
+	int queue_size;
+	double machine_clock_rate;
+	double mach_delay;
+	uint64_t current_cycle;
+	uint64_t sync_cycle;
+	uint64_t sync_time;
+	bool sync_started;
+	unsigned int num_syncs;
+	unsigned int num_missed_deadlines;
+	bool stop_requested;
+	struct clock *current_clock;
+};
+
+extern THREAD_LOCAL struct clock_context *clock_ctx;
+
+static inline uint64_t clock_get_due(struct clock *clock)
+{
+	/* Extract due master cycle from scheduling key */
+	return clock->key >> CLOCK_INDEX_BITS;
+}
+
+static inline bool clock_elapsed(struct clock *clock, uint64_t cycle)
+{
+	struct clock_context *ctx = clock_ctx;
+	uint64_t index = MAX_CLOCKS - 1;
+
+	/* Check if a tick of the clock due at a given cycle would have run
+	before the current tick (following scheduling key order) */
+	return ((cycle << CLOCK_INDEX_BITS) | (clock->key & index)) <
+		((ctx->current_cycle << CLOCK_INDEX_BITS) |
+		(ctx->current_clock->key & index));
+}
 
 static inline void clock_consume(int num_cycles)
 {
-	/* Increase number of remaining clock cycles by desired amount */
-	current_clock->num_remaining_cycles += num_cycles * current_clock->div;
+	struct clock *clock = clock_ctx->current_clock;
+
+	/* Push next clock tick forward by desired amount of master cycles */
+	clock->key += (num_cycles * clock->div) << CLOCK_INDEX_BITS;
 }
 
 #endif
@@ -4,6 +4,8 @@
 #include <stdbool.h>
 #include <list.h>
 #include <resource.h>
+#include <state.h>
+#include <util.h>
 
 #define CONTROLLER_START(_name) \
 	static struct controller _controller = { \
@@ -28,6 +30,10 @@ struct controller {
 	char *name;
 	bool (*init)(struct controller_instance *instance);
 	void (*reset)(struct controller_instance *instance);
+	void (*serialize)(struct controller_instance *instance,
+		struct state *state);
+	void (*deserialize)(struct controller_instance *instance,
+		struct state *state);
 	void (*deinit)(struct controller_instance *instance);
 };
 
@@ -41,11 +47,19 @@ struct controller_instance {
 	struct controller *controller;
 };
 
+/* Controller state of a machine (see machine_set_context) */
+struct controller_context {
+	struct list_link *instances;
+};
+
 bool controller_add(struct controller_instance *instance);
 void controller_reset_all();
+void controller_serialize_all(struct state *state);
+void controller_deserialize_all(struct state *state);
 void controller_remove_all();
 
 extern struct list_link *controllers;
+extern THREAD_LOCAL struct controller_context *controller_ctx;
 
 #endif
 
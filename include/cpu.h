@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include <list.h>
+#include <state.h>
+#include <util.h>
 
 #define CPU_START(_name) \
 	static struct cpu _cpu = { \
@@ -29,6 +31,9 @@ struct cpu {
 	void (*reset)(struct cpu_instance *instance);
 	void (*interrupt)(struct cpu_instance *instance, int irq);
 	void (*halt)(struct cpu_instance *instance, bool halt);
+	void (*serialize)(struct cpu_instance *instance, struct state *state);
+	void (*deserialize)(struct cpu_instance *instance,
+		struct state *state);
 	void (*deinit)(struct cpu_instance *instance);
 };
 
@@ -42,13 +47,21 @@ struct cpu_instance {
 	struct cpu *cpu;
 };
 
+/* CPU state of a machine (see machine_set_context) */
+struct cpu_context {
+	struct list_link *instances;
+};
+
 bool cpu_add(struct cpu_instance *instance);
 void cpu_reset_all();
 void cpu_interrupt(int irq);
 void cpu_halt(bool halt);
+void cpu_serialize_all(struct state *state);
+void cpu_deserialize_all(struct state *state);
 void cpu_remove_all();
 
 extern struct list_link *cpus;
+extern THREAD_LOCAL struct cpu_context *cpu_ctx;
 
 #endif
 
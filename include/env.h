@@ -2,6 +2,7 @@
 #define _ENV_H
 
 char *env_get_data_path();
+void env_set_data_path(char *path);
 char *env_get_system_path();
 char *env_get_config_path();
 char *env_get_save_path();
@@ -1,13 +1,23 @@
 #ifndef _EVENT_H
 #define _EVENT_H
 
+#include <list.h>
+#include <util.h>
+
 typedef void event_data_t;
 typedef void (*event_callback_t) (event_data_t *data);
 
+/* Event state of a machine (see machine_set_context) */
+struct event_context {
+	struct list_link *events;
+};
+
 void event_fire(char *name);
 void event_add(char *name, event_callback_t cb, event_data_t *data);
 void event_remove(char *name, event_callback_t cb);
 void event_remove_all();
 
+extern THREAD_LOCAL struct event_context *event_ctx;
+
 #endif
 
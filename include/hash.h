@@ -0,0 +1,10 @@
+#ifndef _HASH_H
+#define _HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash_data(const void *data, size_t size, uint64_t seed);
+
+#endif
+
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <list.h>
+#include <util.h>
 #include <video.h>
 
 #define INPUT_START(_name) \
@@ -337,6 +338,12 @@ struct input_frontend {
 	void (*deinit)(struct input_frontend *fe);
 };
 
+/* Input state of a machine (see machine_set_context) */
+struct input_context {
+	struct input_frontend *frontend;
+	struct list_link *configs;
+};
+
 bool input_init(char *name, window_t *window);
 void input_set_window(window_t *window);
 void input_update();
@@ -346,6 +353,7 @@ void input_unregister(struct input_config *config);
 void input_deinit();
 
 extern struct list_link *input_frontends;
+extern THREAD_LOCAL struct input_context *input_ctx;
 
 #endif
 
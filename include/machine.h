@@ -2,7 +2,9 @@
 #define _MACHINE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <list.h>
+#include <state.h>
 
 #define MACHINE_START(_name, _description) \
 	static struct machine _machine = { \
@@ -21,6 +23,8 @@
 
 typedef void machine_priv_data_t;
 
+struct machine_context;
+
 struct machine {
 	char *name;
 	char *description;
@@ -28,13 +32,23 @@ struct machine {
 	bool running;
 	bool (*init)(struct machine *machine);
 	void (*reset)(struct machine *machine);
+	void (*serialize)(struct machine *machine, struct state *state);
+	void (*deserialize)(struct machine *machine, struct state *state);
 	void (*deinit)(struct machine *machine);
 };
 
 bool machine_init();
+struct machine_context *machine_create(char *name, char *data_path);
+struct machine_context *machine_get_context();
+void machine_set_context(struct machine_context *ctx);
 void machine_reset();
-void machine_run();
+bool machine_run();
 void machine_step();
+void machine_run_frame();
+void machine_run_cycles(uint64_t num_cycles);
+size_t machine_get_state_size();
+bool machine_save_state(void *data, size_t size);
+bool machine_load_state(const void *data, size_t size);
 void machine_deinit();
 
 extern struct list_link *machines;
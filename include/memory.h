@@ -6,6 +6,7 @@
 #include <list.h>
 #include <log.h>
 #include <resource.h>
+#include <util.h>
 
 #define KB(x) (x * 1024)
 #define MB(x) (x * 1024 * 1024)
@@ -13,6 +14,11 @@
 #define MEM_SIZE(area) \
 	(area->data.mem.end - area->data.mem.start + 1)
 
+/* Buses are split in pages which are pre-resolved to a region operation */
+#define MEM_PAGE_BITS	8
+#define MEM_PAGE_SIZE	(1 << MEM_PAGE_BITS)
+#define MEM_PAGE_MASK	(MEM_PAGE_SIZE - 1)
+
 #define DECLARE_MEMORY_READ_OP(ext, type) \
 	typedef type (*read##ext##_t)(region_data_t *, address_t);
 #define DECLARE_MEMORY_WRITE_OP(ext, type) \
@@ -60,6 +66,39 @@ struct region {
 	region_data_t *data;
 };
 
+union mop {
+	readb_t readb;
+	readw_t readw;
+	readl_t readl;
+	writeb_t writeb;
+	writew_t writew;
+	writel_t writel;
+};
+
+/* A page maps all its addresses to a single region operation (the region
+address being computed as (address - base) & mask), or holds one entry per
+address if needed (sub). Unmapped or shared addresses have no operation.
+Pages backed by RAM/ROM regions also point to host memory (mem), allowing
+accesses to bypass region operations entirely. */
+struct page {
+	union mop op;
+	region_data_t *data;
+	uint8_t *mem;
+	address_t base;
+	address_t mask;
+	struct page *sub;
+};
+
+struct bus {
+	unsigned int num_pages;
+	struct page *readb;
+	struct page *readw;
+	struct page *readl;
+	struct page *writeb;
+	struct page *writew;
+	struct page *writel;
+};
+
 struct dma_ops {
 	dma_readb_t readb;
 	dma_readw_t readw;
@@ -78,137 +117,147 @@ struct dma_channel {
 void memory_region_add(struct region *region);
 void memory_region_remove(struct region *region);
 void memory_region_remove_all();
+uint8_t *memory_get_host(int bus_id, address_t address);
+
+uint8_t memory_readb_slow(int bus_id, address_t address);
+uint16_t memory_readw_slow(int bus_id, address_t address);
+uint32_t memory_readl_slow(int bus_id, address_t address);
+void memory_writeb_slow(int bus_id, uint8_t b, address_t address);
+void memory_writew_slow(int bus_id, uint16_t w, address_t address);
+void memory_writel_slow(int bus_id, uint32_t l, address_t address);
 
 void dma_channel_add(struct dma_channel *channel);
 void dma_channel_remove(struct dma_channel *channel);
 void dma_channel_remove_all();
 
-extern struct region **regions;
-extern int num_regions;
-extern struct dma_channel **dma_channels;
-extern int num_dma_channels;
+/* Memory state of a machine (see machine_set_context) */
+struct memory_context {
+	struct region **regions;
+	int num_regions;
+	struct bus *buses;
+	int num_buses;
+	struct dma_channel **dma_channels;
+	int num_dma_channels;
+};
+
+extern THREAD_LOCAL struct memory_context *memory_ctx;
 extern struct mops rom_mops;
 extern struct mops ram_mops;
 
+static inline uint8_t host_readb(uint8_t *mem)
+{
+	return *mem;
+}
+
+static inline uint16_t host_readw(uint8_t *mem)
+{
+	return (*(mem + 1) << 8) | *mem;
+}
+
+static inline uint32_t host_readl(uint8_t *mem)
+{
+	return (*(mem + 3) << 24) |
+		(*(mem + 2) << 16) |
+		(*(mem + 1) << 8) |
+		*mem;
+}
+
+static inline void host_writeb(uint8_t *mem, uint8_t b)
+{
+	*mem = b;
+}
+
+static inline void host_writew(uint8_t *mem, uint16_t w)
+{
+	*mem++ = w;
+	*mem = w >> 8;
+}
+
+static inline void host_writel(uint8_t *mem, uint32_t l)
+{
+	*mem++ = l;
+	*mem++ = l >> 8;
+	*mem++ = l >> 16;
+	*mem = l >> 24;
+}
+
 #define DEFINE_MEMORY_READ(ext, type) \
 	static inline type memory_read##ext(int bus_id, address_t address) \
 	{ \
-		struct region *r; \
-		struct resource *mirror; \
-		address_t size; \
-		address_t a; \
-		int i; \
-		int j; \
+		struct memory_context *ctx = memory_ctx; \
+		struct page *p; \
 	\
-		/* Parse regions */ \
-		for (i = 0; i < num_regions; i++) { \
-			r = regions[i]; \
+		/* Parse regions if address is outside of page table */ \
+		if ((bus_id >= ctx->num_buses) || \
+			((address >> MEM_PAGE_BITS) >= \
+			ctx->buses[bus_id].num_pages)) \
+			return memory_read##ext##_slow(bus_id, address); \
 	\
-			/* Skip if region if operation is not supported */ \
-			if (!r->mops->read##ext) \
-				continue; \
-	\
-			/* Call operation if address is within area */ \
-			if ((bus_id == r->area->data.mem.bus_id) && \
-				(address >= r->area->data.mem.start) && \
-				(address <= r->area->data.mem.end)) { \
-				a = address - r->area->data.mem.start; \
-				return r->mops->read##ext(r->data, a); \
-			} \
+		/* Get page (or address entry if page is not uniform) */ \
+		p = &ctx->buses[bus_id].read##ext[address >> MEM_PAGE_BITS]; \
+		if (p->sub) \
+			p = &p->sub[address & MEM_PAGE_MASK]; \
 	\
-			/* Get region size */ \
-			size = MEM_SIZE(r->area); \
+		/* Read host memory directly if page is backed by RAM/ROM */ \
+		if (p->mem) \
+			return host_read##ext(p->mem + \
+				((address - p->base) & p->mask)); \
 	\
-			/* Call operation if address is within a mirror */ \
-			for (j = 0; j < r->area->num_children; j++) { \
-				mirror = &r->area->children[j]; \
-				if ((bus_id == mirror->data.mem.bus_id) && \
-					(address >= mirror->data.mem.start) && \
-					(address <= mirror->data.mem.end)) { \
-					a = address - mirror->data.mem.start; \
-					a %= size; \
-					return r->mops->read##ext(r->data, a); \
-				} \
-			} \
-		} \
+		/* Call operation with adapted address if page is mapped */ \
+		if (p->op.read##ext) \
+			return p->op.read##ext(p->data, \
+				(address - p->base) & p->mask); \
 	\
-		/* Return 0 in case of read failure */ \
-		LOG_W("Region not found in %s(%u, 0x%08x)!\n", \
-			__func__, \
-			bus_id, \
-			address); \
-		return 0; \
+		return memory_read##ext##_slow(bus_id, address); \
 	}
 
 #define DEFINE_MEMORY_WRITE(ext, type) \
 	static inline void memory_write##ext(int bus_id, type data, \
 		address_t addr) \
 	{ \
-		struct region *r; \
-		struct resource *mirror; \
-		address_t size; \
-		address_t a; \
-		int num; \
-		int i; \
-		int j; \
-	\
-		/* Parse regions */ \
-		num = 0; \
-		for (i = 0; i < num_regions; i++) { \
-			r = regions[i]; \
-	\
-			/* Skip if region if operation is not supported */ \
-			if (!r->mops->write##ext) \
-				continue; \
-	\
-			/* Adapt address and call write operation if needed */ \
-			if ((bus_id == r->area->data.mem.bus_id) && \
-				(addr >= r->area->data.mem.start) && \
-				(addr <= r->area->data.mem.end)) { \
-				a = addr - r->area->data.mem.start; \
-				r->mops->write##ext(r->data, data, a); \
-				num++; \
-			} \
+		struct memory_context *ctx = memory_ctx; \
+		struct page *p; \
 	\
-			/* Get region size */ \
-			size = MEM_SIZE(r->area); \
+		/* Parse regions if address is outside of page table */ \
+		if ((bus_id >= ctx->num_buses) || ((addr >> MEM_PAGE_BITS) >= \
+			ctx->buses[bus_id].num_pages)) { \
+			memory_write##ext##_slow(bus_id, data, addr); \
+			return; \
+		} \
 	\
-			/* Parse mirrors */ \
-			for (j = 0; j < r->area->num_children; j++) { \
-				mirror = &r->area->children[j]; \
+		/* Get page (or address entry if page is not uniform) */ \
+		p = &ctx->buses[bus_id].write##ext[addr >> MEM_PAGE_BITS]; \
+		if (p->sub) \
+			p = &p->sub[addr & MEM_PAGE_MASK]; \
 	\
-				/* Skip if address is not within mirror */ \
-				if ((bus_id != mirror->data.mem.bus_id) || \
-					!((addr >= mirror->data.mem.start) && \
-					(addr <= mirror->data.mem.end))) \
-					continue; \
+		/* Write host memory directly if page is backed by RAM */ \
+		if (p->mem) { \
+			host_write##ext(p->mem + ((addr - p->base) & p->mask), \
+				data); \
+			return; \
+		} \
 	\
-				/* Adapt address and call write operation */ \
-				a = (addr - mirror->data.mem.start) % size; \
-				r->mops->write##ext(r->data, data, a); \
-				num++; \
-			} \
+		/* Call operation with adapted address if page is mapped */ \
+		if (p->op.write##ext) { \
+			p->op.write##ext(p->data, \
+				data, \
+				(addr - p->base) & p->mask); \
+			return; \
 		} \
 	\
-		/* Warn on write failure */ \
-		if (num == 0) \
-			LOG_W("Region not found in %s(%u, 0x%08x, 0x%0*x)!\n", \
-				__func__, \
-				bus_id, \
-				addr, \
-				sizeof(type) * 2, \
-				data); \
+		memory_write##ext##_slow(bus_id, data, addr); \
 	}
 
 #define DEFINE_DMA_READ(ext, type) \
 	static inline type dma_read##ext(int channel) \
 	{ \
+		struct memory_context *ctx = memory_ctx; \
 		struct dma_channel *ch; \
 		int i; \
 	\
 		/* Find matching DMA channel and call read operation */ \
-		for (i = 0; i < num_dma_channels; i++) { \
-			ch = dma_channels[i]; \
+		for (i = 0; i < ctx->num_dma_channels; i++) { \
+			ch = ctx->dma_channels[i]; \
 			if ((ch->res->data.dma.channel == channel) && \
 				ch->ops->read##ext) \
 				return ch->ops->read##ext(ch->data); \
@@ -224,12 +273,13 @@ extern struct mops ram_mops;
 #define DEFINE_DMA_WRITE(ext, type) \
 	static inline void dma_write##ext(int channel, type data) \
 	{ \
+		struct memory_context *ctx = memory_ctx; \
 		struct dma_channel *ch; \
 		int i; \
 	\
 		/* Find matching DMA channel and call write operation */ \
-		for (i = 0; i < num_dma_channels; i++) { \
-			ch = dma_channels[i]; \
+		for (i = 0; i < ctx->num_dma_channels; i++) { \
+			ch = ctx->dma_channels[i]; \
 			if ((ch->res->data.dma.channel == channel) && \
 				ch->ops->write##ext) { \
 				ch->ops->write##ext(ch->data, data); \
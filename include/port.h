@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <list.h>
 #include <resource.h>
+#include <util.h>
 
 #define PORT_SIZE(area) \
 	(area->data.port.end - area->data.port.start + 1)
@@ -25,11 +26,20 @@ struct port_region {
 	port_data_t *data;
 };
 
+/* Port state of a machine (see machine_set_context) */
+struct port_context {
+	struct list_link *regions;
+	struct list_link **read_map;
+	struct list_link **write_map;
+};
+
 bool port_region_add(struct port_region *region);
 void port_region_remove(struct port_region *region);
 void port_region_remove_all();
 uint8_t port_read(port_t port);
 void port_write(uint8_t b, port_t port);
 
+extern THREAD_LOCAL struct port_context *port_ctx;
+
 #endif
 
@@ -0,0 +1,21 @@
+#ifndef _REGRESS_H
+#define _REGRESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum regress_status {
+	REGRESS_CONTINUE,
+	REGRESS_DONE,
+	REGRESS_DIVERGED
+};
+
+struct regress;
+
+struct regress *regress_init(char *log_path, char *golden_path);
+enum regress_status regress_frame(struct regress *regress, uint64_t video_hash,
+	uint64_t audio_hash);
+void regress_deinit(struct regress *regress);
+
+#endif
+
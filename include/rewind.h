@@ -0,0 +1,16 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct rewind;
+
+struct rewind *rewind_init(size_t state_size, size_t buffer_size);
+void rewind_push(struct rewind *rewind, const uint8_t *state);
+bool rewind_pop(struct rewind *rewind, uint8_t *state);
+void rewind_deinit(struct rewind *rewind);
+
+#endif
+
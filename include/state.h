@@ -0,0 +1,39 @@
+#ifndef _STATE_H
+#define _STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define STATE_VERSION	1
+
+#define STATE_SAVE(state, var) \
+	state_save(state, &(var), sizeof(var))
+#define STATE_LOAD(state, var) \
+	state_load(state, &(var), sizeof(var))
+
+struct state {
+	uint8_t *data;
+	size_t size;
+	size_t pos;
+};
+
+static inline void state_save(struct state *state, const void *data,
+	size_t size)
+{
+	/* Copy data to state buffer (only account for it if measuring) */
+	if (state->data && (state->pos + size <= state->size))
+		memcpy(&state->data[state->pos], data, size);
+	state->pos += size;
+}
+
+static inline void state_load(struct state *state, void *data, size_t size)
+{
+	/* Copy data from state buffer */
+	if (state->pos + size <= state->size)
+		memcpy(data, &state->data[state->pos], size);
+	state->pos += size;
+}
+
+#endif
+
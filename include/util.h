@@ -4,5 +4,12 @@
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 #define UNUSED(x) UNUSED_ ## x __attribute__((__unused__))
 
+/* Thread-local storage (using the initial-exec model where supported so that
+accesses stay cheap when built as a shared library) */
+#ifdef __ELF__
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+#else
+#define THREAD_LOCAL __thread
 #endif
 
+#endif
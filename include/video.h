@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <list.h>
+#include <util.h>
 
 #define VIDEO_START(_name) \
 	static struct video_frontend _video_frontend = { \
@@ -27,6 +28,7 @@ struct video_specs {
 	int height;
 	float fps;
 	int scale;
+	int num_colors;
 };
 
 struct color {
@@ -40,27 +42,59 @@ struct video_frontend {
 	char *input;
 	video_priv_data_t *priv_data;
 	window_t *(*init)(struct video_frontend *fe, struct video_specs *vs);
-	void (*update)(struct video_frontend *fe);
-	void (*lock)(struct video_frontend *fe);
-	void (*unlock)(struct video_frontend *fe);
+	void (*update)(struct video_frontend *fe, uint32_t *pixels);
 	window_t *(*set_size)(struct video_frontend *fe, int w, int h);
-	struct color (*get_p)(struct video_frontend *fe, int x, int y);
-	void (*set_p)(struct video_frontend *fe, int x, int y, struct color c);
 	void (*deinit)(struct video_frontend *fe);
 };
 
+/* Video state of a machine (see machine_set_context) */
+struct video_context {
+	struct video_frontend *frontend;
+	uint8_t *indices;
+	uint32_t *pixels;
+	uint32_t *palette;
+	uint16_t *line_palettes;
+	int width;
+	int height;
+	int num_colors;
+	bool updated;
+	bool skip;
+};
+
 bool video_init(struct video_specs *vs);
 void video_update();
 bool video_updated();
-void video_lock();
-void video_unlock();
 void video_get_size(int *w, int *h);
 void video_set_size(int w, int h);
-struct color video_get_pixel(int x, int y);
-void video_set_pixel(int x, int y, struct color color);
+void video_set_color(int index, struct color color);
+uint64_t video_hash();
+bool video_get_skip();
+void video_set_skip(bool skip);
 void video_deinit();
 
 extern struct list_link *video_frontends;
+extern THREAD_LOCAL struct video_context *video_ctx;
+
+/* Frames are rendered into a native-resolution indexed frame buffer (with
+no padding), each line selecting an offset within the palette LUT filled by
+video_set_color. Indices are converted once per presented frame to XRGB8888
+pixels, which frontends consume as a whole. */
+static inline uint32_t video_map_color(struct color color)
+{
+	return (color.r << 16) | (color.g << 8) | color.b;
+}
+
+static inline uint8_t *video_get_line(int y)
+{
+	struct video_context *ctx = video_ctx;
+
+	return &ctx->indices[y * ctx->width];
+}
+
+static inline void video_set_line_palette(int y, uint16_t offset)
+{
+	video_ctx->line_palettes[y] = offset;
+}
 
 #endif
 
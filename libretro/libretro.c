@@ -16,12 +16,26 @@
 
 /* Retro frontends functions */
 void retro_audio_fill_timing(struct retro_system_timing *timing);
+void retro_audio_flush();
 void retro_video_fill_timing(struct retro_system_timing *timing);
 void retro_video_fill_geometry(struct retro_game_geometry *geometry);
 bool retro_video_updated();
 
+static bool select_context();
+
 retro_environment_t retro_environment_cb;
-static bool machine_initialized;
+static struct machine_context *context;
+
+bool select_context()
+{
+	/* Return already if machine was not initialized */
+	if (!context)
+		return false;
+
+	/* Select machine context (frontend may call from any thread) */
+	machine_set_context(context);
+	return true;
+}
 
 void retro_init(void)
 {
@@ -100,14 +114,19 @@ void retro_set_environment(retro_environment_t cb)
 void retro_reset(void)
 {
 	/* Reset machine */
-	machine_reset();
+	if (select_context())
+		machine_reset();
 }
 
 void retro_run(void)
 {
-	/* Run until screen is updated */
-	while (!video_updated())
-		machine_step();
+	/* Return already if machine was not initialized */
+	if (!select_context())
+		return;
+
+	/* Run until screen is updated and push frame samples */
+	machine_run_frame();
+	retro_audio_flush();
 }
 
 bool retro_load_game(const struct retro_game_info *info)
@@ -115,14 +134,12 @@ bool retro_load_game(const struct retro_game_info *info)
 	/* Set data path */
 	cmdline_set_param(NULL, NULL, (char *)info->path);
 
-	/* Initialize machine */
+	/* Initialize machine and save its context */
 	if (!machine_init()) {
 		LOG_E("Failed to initialize machine!\n");
 		return false;
 	}
-	
-	/* Flag machine as initialized */
-	machine_initialized = true;
+	context = machine_get_context();
 
 	/* Start audio processing */
 	audio_start();
@@ -133,7 +150,7 @@ bool retro_load_game(const struct retro_game_info *info)
 void retro_unload_game(void)
 {
 	/* Return already if machine was not initialized */
-	if (!machine_initialized)
+	if (!select_context())
 		return;
 
 	/* Stop audio processing */
@@ -141,7 +158,7 @@ void retro_unload_game(void)
 
 	/* Deinitialize machine */
 	machine_deinit();
-	machine_initialized = false;
+	context = NULL;
 }
 
 unsigned int retro_get_region(void)
@@ -160,17 +177,29 @@ bool retro_load_game_special(unsigned int type,
 
 size_t retro_serialize_size(void)
 {
-	return 0;
+	/* Return already if machine was not initialized */
+	if (!select_context())
+		return 0;
+
+	return machine_get_state_size();
 }
 
-bool retro_serialize(void *data_, size_t size)
+bool retro_serialize(void *data, size_t size)
 {
-	return false;
+	/* Return already if machine was not initialized */
+	if (!select_context())
+		return false;
+
+	return machine_save_state(data, size);
 }
 
-bool retro_unserialize(const void *data_, size_t size)
+bool retro_unserialize(const void *data, size_t size)
 {
-	return false;
+	/* Return already if machine was not initialized */
+	if (!select_context())
+		return false;
+
+	return machine_load_state(data, size);
 }
 
 void *retro_get_memory_data(unsigned int id)
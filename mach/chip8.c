@@ -21,6 +21,8 @@
 
 static bool chip8_init(struct machine *machine);
 static void chip8_reset(struct machine *machine);
+static void chip8_serialize(struct machine *machine, struct state *state);
+static void chip8_deserialize(struct machine *machine, struct state *state);
 static void chip8_deinit(struct machine *machine);
 
 struct chip8_data {
@@ -111,6 +113,22 @@ void chip8_reset(struct machine *machine)
 		LOG_E("Could not read ROM!\n");
 }
 
+void chip8_serialize(struct machine *machine, struct state *state)
+{
+	struct chip8_data *data = machine->priv_data;
+
+	/* Save machine memory */
+	STATE_SAVE(state, data->ram);
+}
+
+void chip8_deserialize(struct machine *machine, struct state *state)
+{
+	struct chip8_data *data = machine->priv_data;
+
+	/* Restore machine memory */
+	STATE_LOAD(state, data->ram);
+}
+
 void chip8_deinit(struct machine *machine)
 {
 	struct chip8_data *data = machine->priv_data;
@@ -121,6 +139,8 @@ void chip8_deinit(struct machine *machine)
 MACHINE_START(chip8, "CHIP-8")
 	.init = chip8_init,
 	.reset = chip8_reset,
+	.serialize = chip8_serialize,
+	.deserialize = chip8_deserialize,
 	.deinit = chip8_deinit
 MACHINE_END
 
@@ -80,6 +80,8 @@ struct gb_data {
 };
 
 static bool gb_init();
+static void gb_serialize(struct machine *machine, struct state *state);
+static void gb_deserialize(struct machine *machine, struct state *state);
 static void gb_deinit();
 
 /* VRAM area */
@@ -251,6 +253,30 @@ bool gb_init(struct machine *machine)
 	return true;
 }
 
+void gb_serialize(struct machine *machine, struct state *state)
+{
+	struct gb_data *gb_data = machine->priv_data;
+
+	/* Save machine memory */
+	STATE_SAVE(state, gb_data->vram);
+	STATE_SAVE(state, gb_data->wram);
+	STATE_SAVE(state, gb_data->hram);
+	STATE_SAVE(state, gb_data->oam);
+	STATE_SAVE(state, gb_data->wave);
+}
+
+void gb_deserialize(struct machine *machine, struct state *state)
+{
+	struct gb_data *gb_data = machine->priv_data;
+
+	/* Restore machine memory */
+	STATE_LOAD(state, gb_data->vram);
+	STATE_LOAD(state, gb_data->wram);
+	STATE_LOAD(state, gb_data->hram);
+	STATE_LOAD(state, gb_data->oam);
+	STATE_LOAD(state, gb_data->wave);
+}
+
 void gb_deinit(struct machine *machine)
 {
 	free(machine->priv_data);
@@ -258,6 +284,8 @@ void gb_deinit(struct machine *machine)
 
 MACHINE_START(gb, "Nintendo Game Boy")
 	.init = gb_init,
+	.serialize = gb_serialize,
+	.deserialize = gb_deserialize,
 	.deinit = gb_deinit
 MACHINE_END
 
@@ -71,6 +71,8 @@ struct nes_data {
 };
 
 static bool nes_init();
+static void nes_serialize(struct machine *machine, struct state *state);
+static void nes_deserialize(struct machine *machine, struct state *state);
 static void nes_deinit();
 
 /* WRAM area */
@@ -174,6 +176,7 @@ static struct controller_instance ppu_instance = {
 
 bool nes_init(struct machine *machine)
 {
+	struct controller_instance mapper_instance = nes_mapper_instance;
 	struct nes_data *nes_data;
 
 	/* Create machine data structure */
@@ -186,12 +189,12 @@ bool nes_init(struct machine *machine)
 	memory_region_add(&nes_data->wram_region);
 
 	/* NES cart controls VRAM address lines so let the mapper handle it */
-	nes_mapper_instance.mach_data = nes_data->vram;
+	mapper_instance.mach_data = nes_data->vram;
 
 	/* Add controllers and CPU */
 	if (!controller_add(&apu_instance) ||
 		!controller_add(&sprite_dma_instance) ||
-		!controller_add(&nes_mapper_instance) ||
+		!controller_add(&mapper_instance) ||
 		!controller_add(&ppu_instance) ||
 		!controller_add(&nes_controller_instance) ||
 		!cpu_add(&rp2a03_instance)) {
@@ -205,6 +208,24 @@ bool nes_init(struct machine *machine)
 	return true;
 }
 
+void nes_serialize(struct machine *machine, struct state *state)
+{
+	struct nes_data *nes_data = machine->priv_data;
+
+	/* Save machine memory */
+	STATE_SAVE(state, nes_data->wram);
+	STATE_SAVE(state, nes_data->vram);
+}
+
+void nes_deserialize(struct machine *machine, struct state *state)
+{
+	struct nes_data *nes_data = machine->priv_data;
+
+	/* Restore machine memory */
+	STATE_LOAD(state, nes_data->wram);
+	STATE_LOAD(state, nes_data->vram);
+}
+
 void nes_deinit(struct machine *machine)
 {
 	free(machine->priv_data);
@@ -212,6 +233,8 @@ void nes_deinit(struct machine *machine)
 
 MACHINE_START(nes, "Nintendo Entertainment System")
 	.init = nes_init,
+	.serialize = nes_serialize,
+	.deserialize = nes_deserialize,
 	.deinit = nes_deinit
 MACHINE_END
 
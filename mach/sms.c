@@ -56,6 +56,8 @@ struct sms_data {
 };
 
 static bool sms_init(struct machine *machine);
+static void sms_serialize(struct machine *machine, struct state *state);
+static void sms_deserialize(struct machine *machine, struct state *state);
 static void sms_deinit(struct machine *machine);
 
 /* Z80A CPU */
@@ -163,6 +165,22 @@ bool sms_init(struct machine *machine)
 	return true;
 }
 
+void sms_serialize(struct machine *machine, struct state *state)
+{
+	struct sms_data *sms_data = machine->priv_data;
+
+	/* Save machine memory */
+	STATE_SAVE(state, sms_data->ram);
+}
+
+void sms_deserialize(struct machine *machine, struct state *state)
+{
+	struct sms_data *sms_data = machine->priv_data;
+
+	/* Restore machine memory */
+	STATE_LOAD(state, sms_data->ram);
+}
+
 void sms_deinit(struct machine *machine)
 {
 	free(machine->priv_data);
@@ -170,6 +188,8 @@ void sms_deinit(struct machine *machine)
 
 MACHINE_START(sms, "Sega Master System")
 	.init = sms_init,
+	.serialize = sms_serialize,
+	.deserialize = sms_deserialize,
 	.deinit = sms_deinit
 MACHINE_END
 
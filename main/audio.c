@@ -1,24 +1,55 @@
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include <audio.h>
+#include <clock.h>
 #include <cmdline.h>
+#include <hash.h>
 #include <list.h>
 #include <log.h>
 
 #define DEFAULT_SAMPLING_RATE 48000
-
-struct resample_data {
-	enum audio_format format;
-	int num_channels;
-	float mul;
-	float step;
-	int count;
-	int left;
-	int right;
-};
-
-static int16_t audio_get_sample(void **buffer);
+#define MIN_SAMPLING_RATE	8000
+#define MAX_SAMPLING_RATE	192000
+#define BLOCK_RATE		50
+#define FRAC_BITS		32
+#define DOT_LANES		16
+#define RESAMPLE_PHASE_BITS	5
+#define RESAMPLE_NUM_PHASES	(1 << RESAMPLE_PHASE_BITS)
+#define RESAMPLE_ZEROS		8
+#define RESAMPLE_CUTOFF		0.9
+#define RESAMPLE_TAP_ALIGN	DOT_LANES
+#define RESAMPLE_MAX_RATIO	4.0
+#define SYNTH_KERNEL_BITS	15
+#define SYNTH_CUTOFF		0.4
+#define SYNTH_BASS_SHIFT	9
+#define RATE_CONTROL_DELTA	0.005
+#define SYNC_POLL_TIME		1000000
+
+static int audio_get_sample_size(enum audio_format format);
+static int16_t audio_get_sample(enum audio_format format, void **buffer);
+static int16_t audio_clamp(int v);
+static void audio_free(struct audio_context *ctx);
+static void audio_control_rate(struct audio_context *ctx);
+static void audio_output(struct audio_context *ctx, int count);
+static float dot_scalar(float *a, float *b, int n);
+#if defined(__x86_64__) || defined(__i386__)
+static float dot_sse2(float *a, float *b, int n);
+static float dot_avx2(float *a, float *b, int n);
+#endif
+static void resample_init(struct audio_context *ctx, float freq);
+static void resample_build_kernel(struct resample_data *rd, double ratio);
+static void resample_flush(struct audio_context *ctx);
+static bool synth_init(struct audio_context *ctx);
+static void synth_build_kernel(struct synth_data *sd);
+static uint64_t synth_get_pos(struct synth_data *sd);
+static void synth_flush(struct audio_context *ctx);
 
 /* Command-line parameter */
 static char *audio_fe_name;
@@ -27,15 +58,28 @@ static int sampling_rate = DEFAULT_SAMPLING_RATE;
 PARAM(sampling_rate, int, "sampling-rate", NULL, "Sets audio sampling rate")
 
 struct list_link *audio_frontends;
-static struct audio_frontend *frontend;
-static struct resample_data resample_data;
+THREAD_LOCAL struct audio_context *audio_ctx;
+
+int audio_get_sample_size(enum audio_format format)
+{
+	/* Get size based on format */
+	switch (format) {
+	case AUDIO_FORMAT_U8:
+	case AUDIO_FORMAT_S8:
+		return sizeof(uint8_t);
+	case AUDIO_FORMAT_U16:
+	case AUDIO_FORMAT_S16:
+	default:
+		return sizeof(uint16_t);
+	}
+}
 
-int16_t audio_get_sample(void **buffer)
+int16_t audio_get_sample(enum audio_format format, void **buffer)
 {
 	int16_t v = 0;
 
 	/* Get value based on format */
-	switch (resample_data.format) {
+	switch (format) {
 	case AUDIO_FORMAT_U8:
 		v = *((uint8_t *)*buffer);
 		v -= UCHAR_MAX / 2;
@@ -56,6 +100,8 @@ int16_t audio_get_sample(void **buffer)
 		v = *((int16_t *)*buffer);
 		*buffer += sizeof(int16_t);
 		break;
+	default:
+		break;
 	}
 
 	/* Return value */
@@ -64,14 +110,27 @@ int16_t audio_get_sample(void **buffer)
 
 bool audio_init(struct audio_specs *specs)
 {
+	struct audio_context *ctx = audio_ctx;
+	struct resample_data *rd = &ctx->resample_data;
 	struct list_link *link = audio_frontends;
 	struct audio_frontend *fe;
+	int rate = sampling_rate;
 
-	if (frontend) {
+	if (ctx->frontend) {
 		LOG_E("Audio frontend already initialized!\n");
 		return false;
 	}
 
+	/* Allocate sample block (even with no frontend as chips always write
+	to it) unless chip only reports deltas */
+	ctx->block_count = 0;
+	if (specs->format != AUDIO_FORMAT_DELTA) {
+		ctx->sample_size = audio_get_sample_size(specs->format) *
+			specs->channels;
+		ctx->block_size = specs->freq / BLOCK_RATE + 1;
+		ctx->block = calloc(ctx->block_size, ctx->sample_size);
+	}
+
 	/* Validate audio option */
 	if (!audio_fe_name) {
 		LOG_W("No audio frontend selected!\n");
@@ -79,17 +138,11 @@ bool audio_init(struct audio_specs *specs)
 	}
 
 	/* Validate audio sampling rate */
-	switch (sampling_rate) {
-	case 11025:
-	case 22050:
-	case 44100:
-	case 48000:
-		break;
-	default:
-		LOG_W("%u Hz sampling rate not supported.\n", sampling_rate);
-		LOG_W("Please select 11025, 22050, 44100, or 48000 Hz.\n");
-		sampling_rate = DEFAULT_SAMPLING_RATE;
-		break;
+	if ((rate < MIN_SAMPLING_RATE) || (rate > MAX_SAMPLING_RATE)) {
+		LOG_W("%u Hz sampling rate not supported.\n", rate);
+		LOG_W("Please select a rate between %u and %u Hz.\n",
+			MIN_SAMPLING_RATE, MAX_SAMPLING_RATE);
+		rate = DEFAULT_SAMPLING_RATE;
 	}
 
 	/* Find audio frontend */
@@ -98,21 +151,28 @@ bool audio_init(struct audio_specs *specs)
 		if (strcmp(audio_fe_name, fe->name))
 			continue;
 
+		/* Work on a copy so that machines can share frontends */
+		ctx->frontend = malloc(sizeof(struct audio_frontend));
+		*ctx->frontend = *fe;
+
 		/* Initialize frontend */
-		if (fe->init && !fe->init(fe, sampling_rate))
+		if (fe->init && !fe->init(ctx->frontend, rate)) {
+			free(ctx->frontend);
+			ctx->frontend = NULL;
+			audio_free(ctx);
 			return false;
+		}
 
-		/* Save frontend */
-		frontend = fe;
+		/* Synthesize samples directly if chip reports deltas */
+		ctx->rate = rate;
+		ctx->rate_adjust = 1.0;
+		if (specs->format == AUDIO_FORMAT_DELTA)
+			return synth_init(ctx);
 
 		/* Initialize resampling data */
-		resample_data.format = specs->format;
-		resample_data.num_channels = specs->channels;
-		resample_data.mul = sampling_rate / specs->freq;
-		resample_data.step = 0.0f;
-		resample_data.count = 0;
-		resample_data.left = 0;
-		resample_data.right = 0;
+		rd->format = specs->format;
+		rd->num_channels = specs->channels;
+		resample_init(ctx, specs->freq);
 
 		/* Return success */
 		return true;
@@ -120,81 +180,638 @@ bool audio_init(struct audio_specs *specs)
 
 	/* Warn as audio frontend was not found */
 	LOG_E("Audio frontend \"%s\" not recognized!\n", audio_fe_name);
+	audio_free(ctx);
 	return false;
 }
 
-void audio_enqueue(void *buffer, int length)
+void audio_free(struct audio_context *ctx)
 {
-	bool stereo = (resample_data.num_channels == 2);
-	bool reset;
-	float prev_step;
-	int16_t left;
-	int16_t right;
+	free(ctx->block);
+	free(ctx->output);
+	free(ctx->synth_data.buffer);
+	free(ctx->resample_data.kernel);
+	free(ctx->resample_data.history[0]);
+	free(ctx->resample_data.history[1]);
+	ctx->block = NULL;
+	ctx->output = NULL;
+	ctx->synth_data.buffer = NULL;
+	ctx->resample_data.kernel = NULL;
+	ctx->resample_data.history[0] = NULL;
+	ctx->resample_data.history[1] = NULL;
+	ctx->block_size = 0;
+	ctx->block_count = 0;
+	ctx->synth_data.size = 0;
+}
+
+int16_t audio_clamp(int v)
+{
+	/* Saturate value to 16-bit sample range */
+	if (v > INT16_MAX)
+		return INT16_MAX;
+	if (v < INT16_MIN)
+		return INT16_MIN;
+	return v;
+}
+
+/* All dot products accumulate taps into 16 lanes (lane i summing taps i, i + 16,
+i + 32 and so on, each product being rounded before it is added) and add lanes
+up pairwise in the same order, keeping resampled output identical on any host
+(which frame hashing relies upon) */
+__attribute__((optimize("fp-contract=off")))
+float dot_scalar(float *a, float *b, int n)
+{
+	float sum[DOT_LANES] = { 0.0f };
+	float product;
 	int i;
+	int j;
+
+	/* Multiply-accumulate taps into lanes (keeping products apart so that
+	they are not fused with additions) */
+	for (i = 0; i < n; i += DOT_LANES)
+		for (j = 0; j < DOT_LANES; j++) {
+			product = a[i + j] * b[i + j];
+			sum[j] += product;
+		}
 
-	/* Return if needed */
-	if (!frontend || !frontend->enqueue)
-		return;
+	/* Add up lanes */
+	for (i = DOT_LANES / 2; i > 0; i /= 2)
+		for (j = 0; j < i; j++)
+			sum[j] += sum[j + i];
+	return sum[0];
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+float dot_sse2(float *a, float *b, int n)
+{
+	__m128 sum0 = _mm_setzero_ps();
+	__m128 sum1 = _mm_setzero_ps();
+	__m128 sum2 = _mm_setzero_ps();
+	__m128 sum3 = _mm_setzero_ps();
+	int i;
+
+	/* Multiply-accumulate taps into lanes (4 per vector) */
+	for (i = 0; i < n; i += DOT_LANES) {
+		sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(&a[i]),
+			_mm_loadu_ps(&b[i])));
+		sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(&a[i + 4]),
+			_mm_loadu_ps(&b[i + 4])));
+		sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(&a[i + 8]),
+			_mm_loadu_ps(&b[i + 8])));
+		sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(&a[i + 12]),
+			_mm_loadu_ps(&b[i + 12])));
+	}
+
+	/* Add up lanes */
+	sum0 = _mm_add_ps(_mm_add_ps(sum0, sum2), _mm_add_ps(sum1, sum3));
+	sum0 = _mm_add_ps(sum0, _mm_movehl_ps(sum0, sum0));
+	sum0 = _mm_add_ss(sum0, _mm_shuffle_ps(sum0, sum0, 1));
+	return _mm_cvtss_f32(sum0);
+}
+
+__attribute__((target("avx2")))
+float dot_avx2(float *a, float *b, int n)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+	__m128 sum;
+	int i;
+
+	/* Multiply-accumulate taps into lanes (8 per vector, without fusing
+	operations so that products get rounded as in other paths) */
+	for (i = 0; i < n; i += DOT_LANES) {
+		sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(&a[i]),
+			_mm256_loadu_ps(&b[i])));
+		sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(
+			_mm256_loadu_ps(&a[i + 8]), _mm256_loadu_ps(&b[i + 8])));
+	}
+
+	/* Add up lanes */
+	sum0 = _mm256_add_ps(sum0, sum1);
+	sum = _mm_add_ps(_mm256_castps256_ps128(sum0),
+		_mm256_extractf128_ps(sum0, 1));
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	return _mm_cvtss_f32(sum);
+}
+#endif
 
-	/* Parse all input buffer samples */
-	for (i = 0; i < length; i++) {
-		/* Get left (or mono) value */
-		resample_data.left += audio_get_sample(&buffer);
+void resample_init(struct audio_context *ctx, float freq)
+{
+	struct resample_data *rd = &ctx->resample_data;
+	double ratio = freq / ctx->rate;
+	int c;
+
+	/* Sum input samples by groups first when input rate is much higher
+	than output rate (such as chips running at their clock rate), keeping
+	kernel short as it then only spans a few input samples per output one */
+	rd->decimation = ceil(ratio / RESAMPLE_MAX_RATIO);
+	rd->decimation_count = 0;
+	rd->decimation_sum[0] = 0;
+	rd->decimation_sum[1] = 0;
+	ratio /= rd->decimation;
+
+	/* Build kernel and set step (in decimated samples per output sample) */
+	resample_build_kernel(rd, ratio);
+	rd->ratio = ratio;
+	rd->step = ratio * ((uint64_t)1 << FRAC_BITS);
+	rd->pos = 0;
+
+	/* Allocate history (holding a decimated block on top of a kernel
+	span) */
+	rd->history_count = 0;
+	for (c = 0; c < rd->num_channels; c++)
+		rd->history[c] = calloc(rd->num_taps + ctx->block_size /
+			rd->decimation + 1, sizeof(float));
+
+	/* Allocate output buffer (large enough for resampled block, even with
+	output rate raised by rate control) */
+	ctx->output = calloc(2 * ((int)(ctx->block_size *
+		(1.0 + RATE_CONTROL_DELTA) / ratio / rd->decimation) + 2),
+		sizeof(int16_t));
+
+	/* Select fastest dot product supported by host */
+	rd->dot = dot_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		rd->dot = dot_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		rd->dot = dot_sse2;
+#endif
+}
+
+void resample_build_kernel(struct resample_data *rd, double ratio)
+{
+	double scale = (ratio > 1.0) ? ratio : 1.0;
+	double cutoff = RESAMPLE_CUTOFF / 2 / scale;
+	double half;
+	double sum;
+	double t;
+	double x;
+	double h;
+	float *kernel;
+	int i;
+	int p;
+
+	/* Span a fixed number of zero crossings at the lower of both rates,
+	rounding taps up so that dot products run on whole vectors */
+	rd->num_taps = ceil(2 * RESAMPLE_ZEROS * scale);
+	rd->num_taps += RESAMPLE_TAP_ALIGN - 1;
+	rd->num_taps -= rd->num_taps % RESAMPLE_TAP_ALIGN;
+	half = rd->num_taps / 2;
+	rd->kernel = calloc(RESAMPLE_NUM_PHASES * rd->num_taps, sizeof(float));
+
+	/* Sample Blackman-windowed sinc (low-pass below Nyquist frequency of
+	the lower rate) at every phase, each phase delaying the kernel by a
+	fraction of an input sample and being normalized to unity gain (taking
+	decimation sums into account) */
+	for (p = 0; p < RESAMPLE_NUM_PHASES; p++) {
+		kernel = &rd->kernel[p * rd->num_taps];
+		sum = 0.0;
+		for (i = 0; i < rd->num_taps; i++) {
+			t = i - (half - 1) - (double)p / RESAMPLE_NUM_PHASES;
+			x = M_PI * 2 * cutoff * t;
+			h = (x != 0.0) ? sin(x) / x : 1.0;
+			h *= 0.42 + 0.5 * cos(M_PI * t / half) +
+				0.08 * cos(2 * M_PI * t / half);
+			kernel[i] = h;
+			sum += h;
+		}
+		sum *= rd->decimation;
+		for (i = 0; i < rd->num_taps; i++)
+			kernel[i] /= sum;
+	}
+}
 
-		/* Get right value if needed */
+void resample_flush(struct audio_context *ctx)
+{
+	struct resample_data *rd = &ctx->resample_data;
+	bool stereo = (rd->num_channels == 2);
+	void *buffer = ctx->block;
+	int16_t *output = ctx->output;
+	float *kernel;
+	int count = ctx->block_count;
+	int c;
+	int i;
+
+	/* Append block to history (one channel after another), summing
+	samples by groups of decimation size */
+	for (i = 0; i < count; i++) {
+		rd->decimation_sum[0] += audio_get_sample(rd->format, &buffer);
 		if (stereo)
-			resample_data.right += audio_get_sample(&buffer);
-
-		/* Increment resample data count */
-		resample_data.count++;
-
-		/* Compute next step until output is no longer generated */
-		reset = false;
-		prev_step = resample_data.step;
-		resample_data.step = prev_step + resample_data.mul;
-		while ((int)prev_step != (int)resample_data.step) {
-			/* Compute final left/right (or mono) samples */
-			left = resample_data.left / resample_data.count;
-			right = !stereo ?
-				left :
-				resample_data.right / resample_data.count;
-
-			/* Push left/right pair to frontend */
-			frontend->enqueue(frontend, left, right);
-
-			/* Update step and request state reset */
-			resample_data.step -= 1.0f;
-			reset = true;
+			rd->decimation_sum[1] += audio_get_sample(rd->format,
+				&buffer);
+		if (++rd->decimation_count < rd->decimation)
+			continue;
+		for (c = 0; c < rd->num_channels; c++) {
+			rd->history[c][rd->history_count] =
+				rd->decimation_sum[c];
+			rd->decimation_sum[c] = 0;
 		}
+		rd->history_count++;
+		rd->decimation_count = 0;
+	}
+
+	/* Filter history at every output position it fully covers */
+	while ((int)(rd->pos >> FRAC_BITS) + rd->num_taps <=
+		rd->history_count) {
+		i = rd->pos >> FRAC_BITS;
+		kernel = &rd->kernel[rd->num_taps *
+			((rd->pos >> (FRAC_BITS - RESAMPLE_PHASE_BITS)) &
+			(RESAMPLE_NUM_PHASES - 1))];
+		output[0] = audio_clamp(lrintf(rd->dot(&rd->history[0][i],
+			kernel, rd->num_taps)));
+		output[1] = !stereo ? output[0] :
+			audio_clamp(lrintf(rd->dot(&rd->history[1][i],
+			kernel, rd->num_taps)));
+		output += 2;
+		rd->pos += rd->step;
+	}
+
+	/* Drop history samples which are no longer needed */
+	i = rd->pos >> FRAC_BITS;
+	for (c = 0; c < rd->num_channels; c++)
+		memmove(rd->history[c], &rd->history[c][i],
+			(rd->history_count - i) * sizeof(float));
+	rd->history_count -= i;
+	rd->pos -= (uint64_t)i << FRAC_BITS;
+
+	/* Hand output to frontend */
+	count = (output - ctx->output) / 2;
+	if (count > 0)
+		audio_output(ctx, count);
+}
 
-		/* Reset state if required */
-		if (reset) {
-			resample_data.count = 0;
-			resample_data.left = 0;
-			resample_data.right = 0;
+bool synth_init(struct audio_context *ctx)
+{
+	struct synth_data *sd = &ctx->synth_data;
+
+	/* Allocate delta buffer (holding a block along with kernel tails) and
+	output buffer */
+	sd->size = ctx->rate / BLOCK_RATE + SYNTH_WIDTH;
+	sd->buffer = calloc(sd->size, sizeof(int32_t));
+	ctx->output = calloc(2 * sd->size, sizeof(int16_t));
+	sd->sum = 0;
+
+	/* Build band-limited step kernel */
+	synth_build_kernel(sd);
+	return true;
+}
+
+void synth_build_kernel(struct synth_data *sd)
+{
+	double step[SYNTH_WIDTH * SYNTH_NUM_PHASES + 1];
+	double half = SYNTH_WIDTH / 2;
+	double sum = 0.0;
+	double t;
+	double x;
+	double h;
+	int total;
+	int a;
+	int b;
+	int i;
+	int p;
+
+	/* Integrate Blackman-windowed sinc (low-pass impulse response) over
+	kernel span, sampling resulting band-limited step at every phase */
+	step[0] = 0.0;
+	for (i = 1; i <= SYNTH_WIDTH * SYNTH_NUM_PHASES; i++) {
+		t = (i - 0.5) / SYNTH_NUM_PHASES - half;
+		x = M_PI * 2 * SYNTH_CUTOFF * t;
+		h = 2 * SYNTH_CUTOFF * ((x != 0.0) ? sin(x) / x : 1.0);
+		h *= 0.42 + 0.5 * cos(M_PI * t / half) +
+			0.08 * cos(2 * M_PI * t / half);
+		sum += h / SYNTH_NUM_PHASES;
+		step[i] = sum;
+	}
+
+	/* Each tap holds step difference between two samples, later phases
+	delaying the step (rows are adjusted at their center to add up to unity
+	exactly, so that integrated steps never drift) */
+	for (p = 0; p < SYNTH_NUM_PHASES; p++) {
+		total = 0;
+		for (i = 0; i < SYNTH_WIDTH; i++) {
+			a = i * SYNTH_NUM_PHASES - p;
+			b = (i + 1) * SYNTH_NUM_PHASES - p;
+			h = (step[b] - step[(a > 0) ? a : 0]) / sum;
+			sd->kernel[p][i] = lround(h * (1 << SYNTH_KERNEL_BITS));
+			total += sd->kernel[p][i];
 		}
+		total = (1 << SYNTH_KERNEL_BITS) - total;
+		sd->kernel[p][SYNTH_WIDTH / 2] += total;
 	}
 }
 
+uint64_t synth_get_pos(struct synth_data *sd)
+{
+	uint64_t cycle = clock_ctx->current_cycle;
+
+	/* Convert current master cycle to fixed-point buffer position */
+	if (cycle < sd->cycle)
+		return sd->offset;
+	return (cycle - sd->cycle) * sd->factor + sd->offset;
+}
+
+void synth_flush(struct audio_context *ctx)
+{
+	struct audio_frontend *frontend = ctx->frontend;
+	struct synth_data *sd = &ctx->synth_data;
+	int16_t *output;
+	uint64_t pos;
+	int count;
+	int n;
+	int s;
+	int i;
+
+	/* Get number of samples completed so far and anchor buffer start to
+	current cycle (keeping sample fraction) */
+	pos = synth_get_pos(sd);
+	count = pos >> FRAC_BITS;
+	sd->cycle = clock_ctx->current_cycle;
+	sd->offset = pos & (((uint64_t)1 << FRAC_BITS) - 1);
+
+	/* Generate samples (in several chunks if buffer is exceeded) */
+	while (count > 0) {
+		n = sd->size - SYNTH_WIDTH;
+		if (n > count)
+			n = count;
+
+		/* Integrate deltas into samples, slowly removing DC offset */
+		output = ctx->output;
+		for (i = 0; i < n; i++) {
+			sd->sum += sd->buffer[i];
+			s = audio_clamp(sd->sum);
+			sd->sum -= sd->sum >> SYNTH_BASS_SHIFT;
+			*output++ = s;
+			*output++ = s;
+		}
+
+		/* Move kernel tails to buffer start and clear the rest */
+		memmove(sd->buffer, &sd->buffer[n],
+			SYNTH_WIDTH * sizeof(int32_t));
+		memset(&sd->buffer[SYNTH_WIDTH], 0, n * sizeof(int32_t));
+		count -= n;
+
+		/* Hand output to frontend */
+		if (frontend->enqueue && !ctx->muted)
+			audio_output(ctx, n);
+	}
+}
+
+void audio_output(struct audio_context *ctx, int count)
+{
+	/* Hand samples to frontend */
+	ctx->frontend->enqueue(ctx->frontend, ctx->output, count);
+}
+
+void audio_enqueue(void *buffer, int count)
+{
+	struct audio_context *ctx = audio_ctx;
+	uint8_t *b = buffer;
+	int n;
+
+	/* Copy buffer to sample blocks (flushing them as they fill up) */
+	while (count > 0) {
+		n = ctx->block_size - ctx->block_count;
+		if (n == 0) {
+			audio_flush();
+			continue;
+		}
+		if (n > count)
+			n = count;
+		memcpy(audio_get_buffer(n), b, n * ctx->sample_size);
+		b += n * ctx->sample_size;
+		count -= n;
+	}
+}
+
+void audio_flush()
+{
+	struct audio_context *ctx = audio_ctx;
+	struct audio_frontend *frontend = ctx->frontend;
+
+	/* Accumulate block into hash unless its samples are dropped (hashing
+	chip samples rather than output ones, which depend on host and rate
+	control) */
+	if (!ctx->muted && (ctx->block_count > 0))
+		ctx->hash = hash_data(ctx->block,
+			ctx->block_count * ctx->sample_size, ctx->hash);
+
+	/* Generate samples from deltas if chip reports them, or resample block
+	unless its samples are dropped */
+	if (ctx->synth_data.buffer)
+		synth_flush(ctx);
+	else if (frontend && frontend->enqueue && !ctx->muted &&
+		(ctx->block_count > 0))
+		resample_flush(ctx);
+
+	/* Empty block */
+	ctx->block_count = 0;
+
+	/* Adjust output rate for next samples */
+	if (frontend && frontend->get_fill)
+		audio_control_rate(ctx);
+}
+
+void audio_control_rate(struct audio_context *ctx)
+{
+	struct audio_frontend *frontend = ctx->frontend;
+	struct resample_data *rd = &ctx->resample_data;
+	struct synth_data *sd = &ctx->synth_data;
+	double deviation;
+
+	/* Get deviation from target queue level (limited to a full queue
+	either way) */
+	deviation = 1.0 - frontend->get_fill(frontend);
+	if (deviation > 1.0)
+		deviation = 1.0;
+	if (deviation < -1.0)
+		deviation = -1.0;
+
+	/* Produce slightly more samples when queue runs low and slightly fewer
+	when it fills up, staying well below audible pitch changes */
+	ctx->rate_adjust = 1.0 + RATE_CONTROL_DELTA * deviation;
+
+	/* Update steps (synthesis being anchored to current cycle by flush) */
+	if (rd->kernel)
+		rd->step = rd->ratio / ctx->rate_adjust *
+			((uint64_t)1 << FRAC_BITS);
+	if (sd->buffer)
+		sd->factor = ctx->rate * ctx->rate_adjust / clock_get_rate() *
+			((uint64_t)1 << FRAC_BITS);
+}
+
+void audio_add_delta(int delta)
+{
+	struct synth_data *sd = &audio_ctx->synth_data;
+	int64_t stamp[2];
+	int16_t *kernel;
+	int32_t *buffer;
+	uint64_t pos;
+	int sum = 0;
+	int v;
+	int i;
+
+	/* Accumulate change and its cycle into hash unless it is dropped */
+	if (!audio_ctx->muted) {
+		stamp[0] = clock_ctx->current_cycle;
+		stamp[1] = delta;
+		audio_ctx->hash = hash_data(stamp, sizeof(stamp),
+			audio_ctx->hash);
+	}
+
+	/* Return if no samples are synthesized */
+	if (!sd->buffer)
+		return;
+
+	/* Make room for step by flushing buffer if needed */
+	pos = synth_get_pos(sd);
+	if ((pos >> FRAC_BITS) + SYNTH_WIDTH > (uint64_t)sd->size) {
+		audio_flush();
+		pos = synth_get_pos(sd);
+	}
+
+	/* Get kernel matching sample fraction and buffer position */
+	kernel = sd->kernel[(pos >> (FRAC_BITS - SYNTH_PHASE_BITS)) &
+		(SYNTH_NUM_PHASES - 1)];
+	buffer = &sd->buffer[pos >> FRAC_BITS];
+
+	/* Spread change over band-limited step, putting rounding error at its
+	center so that the step adds up to the change exactly */
+	for (i = 0; i < SYNTH_WIDTH; i++) {
+		v = (delta * kernel[i]) >> SYNTH_KERNEL_BITS;
+		buffer[i] += v;
+		sum += v;
+	}
+	buffer[SYNTH_WIDTH / 2] += delta - sum;
+}
+
+void audio_reset()
+{
+	struct audio_context *ctx = audio_ctx;
+	struct synth_data *sd = &ctx->synth_data;
+
+	/* Drop pending samples */
+	ctx->block_count = 0;
+
+	/* Derive synthesis step from master clock rate (which is only settled
+	once all chips are initialized) and restart from current cycle */
+	if (sd->buffer) {
+		sd->factor = ctx->rate * ctx->rate_adjust / clock_get_rate() *
+			((uint64_t)1 << FRAC_BITS);
+		sd->cycle = clock_ctx->current_cycle;
+	}
+}
+
+bool audio_sync()
+{
+	struct audio_context *ctx = audio_ctx;
+	struct audio_frontend *frontend = ctx->frontend;
+	struct timespec ts;
+
+	/* Leave syncing to clock if frontend cannot pace emulation */
+	if (!frontend || !frontend->get_fill || ctx->muted)
+		return false;
+
+	/* Wait for device to play queued samples down to target level */
+	ts.tv_sec = 0;
+	ts.tv_nsec = SYNC_POLL_TIME;
+	while (frontend->get_fill(frontend) > 1.0f)
+		nanosleep(&ts, NULL);
+
+	/* Have clock take a new reference if it syncs again later on */
+	clock_ctx->sync_started = false;
+	return true;
+}
+
 void audio_start()
 {
+	struct audio_frontend *frontend = audio_ctx->frontend;
+
 	if (frontend && frontend->start)
 		frontend->start(frontend);
 }
 
 void audio_stop()
 {
+	struct audio_frontend *frontend = audio_ctx->frontend;
+
 	if (frontend && frontend->stop)
 		frontend->stop(frontend);
 }
 
+void audio_set_mute(bool mute)
+{
+	/* Hand samples written so far according to current state (dropping
+	samples written while muted) */
+	audio_flush();
+	audio_ctx->muted = mute;
+}
+
+uint64_t audio_hash()
+{
+	uint64_t hash = audio_ctx->hash;
+
+	/* Return hash of chip samples (or changes) produced since last call */
+	audio_ctx->hash = 0;
+	return hash;
+}
+
+void audio_serialize(struct state *state)
+{
+	struct synth_data *sd = &audio_ctx->synth_data;
+	int32_t tail[SYNTH_WIDTH] = { 0 };
+
+	/* Hand pending samples to frontend unless state is only being measured
+	(filter history only shapes output continuity and is left out of
+	states) */
+	if (state->data)
+		audio_flush();
+
+	/* Save synthesis integrator along with kernel tails of steps added so
+	far, which later samples build upon (saving a fixed size even if no
+	samples are synthesized) */
+	if (sd->buffer)
+		memcpy(tail, sd->buffer, sizeof(tail));
+	STATE_SAVE(state, sd->sum);
+	STATE_SAVE(state, sd->offset);
+	STATE_SAVE(state, tail);
+}
+
+void audio_deserialize(struct state *state)
+{
+	struct synth_data *sd = &audio_ctx->synth_data;
+	int32_t tail[SYNTH_WIDTH];
+
+	/* Drop pending samples */
+	audio_ctx->block_count = 0;
+
+	/* Restore synthesis integrator and kernel tails, restarting synthesis
+	from restored cycle */
+	STATE_LOAD(state, sd->sum);
+	STATE_LOAD(state, sd->offset);
+	STATE_LOAD(state, tail);
+	if (sd->buffer) {
+		memset(sd->buffer, 0, sd->size * sizeof(int32_t));
+		memcpy(sd->buffer, tail, sizeof(tail));
+	}
+	sd->cycle = clock_ctx->current_cycle;
+}
+
 void audio_deinit()
 {
+	struct audio_frontend *frontend = audio_ctx->frontend;
+
+	/* Free sample block and output buffer */
+	audio_free(audio_ctx);
+
 	if (!frontend)
 		return;
 
 	if (frontend->deinit)
 		frontend->deinit(frontend);
-	frontend = NULL;
+	free(frontend);
+	audio_ctx->frontend = NULL;
 }
 
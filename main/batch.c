@@ -0,0 +1,370 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <clock.h>
+#include <cmdline.h>
+#include <env.h>
+#include <hash.h>
+#include <log.h>
+#include <machine.h>
+#include <util.h>
+#include <video.h>
+
+#define DEFAULT_NUM_FRAMES	600
+#define MAX_LINE_LENGTH		4096
+#define FRAME_TIMEOUT		1
+#define SLICES_PER_SECOND	60
+
+enum job_status {
+	JOB_PENDING,
+	JOB_OK,
+	JOB_STALLED,
+	JOB_ERROR
+};
+
+struct job {
+	char *machine;
+	char *path;
+	enum job_status status;
+	unsigned int num_frames;
+	uint64_t frame_hash;
+	uint64_t hash;
+	double fps;
+};
+
+/* Job indexes are popped from the tail by the owning worker and stolen from
+the head by idle ones */
+struct deque {
+	pthread_mutex_t mutex;
+	int *jobs;
+	int head;
+	int tail;
+};
+
+struct worker {
+	pthread_t thread;
+	int index;
+	struct deque deque;
+};
+
+static bool load_jobs(char *list);
+static double get_time();
+static bool take_job(struct worker *worker, int *index);
+static void run_job(struct job *job);
+static void *work(void *data);
+static int print_results(double elapsed);
+static window_t *batch_init(struct video_frontend *fe, struct video_specs *vs);
+static void batch_update(struct video_frontend *fe, uint32_t *pixels);
+
+/* Command-line parameters */
+static bool help;
+PARAM(help, bool, "help", NULL, "Display this help and exit")
+static int num_threads;
+PARAM(num_threads, int, "jobs", NULL, "Sets number of worker threads")
+static int num_frames = DEFAULT_NUM_FRAMES;
+PARAM(num_frames, int, "frames", NULL, "Sets number of frames to run per ROM")
+
+static struct job *jobs;
+static int num_jobs;
+static struct worker *workers;
+
+/* Job being run by current worker (updated by video frontend) */
+static THREAD_LOCAL struct job *current_job;
+
+bool load_jobs(char *list)
+{
+	char line[MAX_LINE_LENGTH];
+	struct job *job;
+	char *machine;
+	char *path;
+	FILE *f;
+
+	/* Open job list (using standard input if requested) */
+	f = strcmp(list, "-") ? fopen(list, "r") : stdin;
+	if (!f) {
+		LOG_E("Could not open \"%s\"!\n", list);
+		return false;
+	}
+
+	/* Parse "machine path" lines, skipping empty lines and comments */
+	while (fgets(line, MAX_LINE_LENGTH, f)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		machine = line + strspn(line, " \t");
+		if ((*machine == '\0') || (*machine == '#'))
+			continue;
+
+		path = machine + strcspn(machine, " \t");
+		if (*path != '\0')
+			*path++ = '\0';
+		path += strspn(path, " \t");
+		if (*path == '\0') {
+			LOG_E("No path specified for \"%s\" job!\n", machine);
+			continue;
+		}
+
+		/* Add job */
+		jobs = realloc(jobs, ++num_jobs * sizeof(struct job));
+		job = &jobs[num_jobs - 1];
+		memset(job, 0, sizeof(struct job));
+		job->machine = strdup(machine);
+		job->path = strdup(path);
+		job->status = JOB_PENDING;
+	}
+
+	if (f != stdin)
+		fclose(f);
+	return true;
+}
+
+double get_time()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+bool take_job(struct worker *worker, int *index)
+{
+	struct deque *deque = &worker->deque;
+	bool found = false;
+	int i;
+
+	/* Pop most recent job from own deque */
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->head < deque->tail) {
+		*index = deque->jobs[--deque->tail];
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	if (found)
+		return true;
+
+	/* Steal oldest job from other workers, starting with next one */
+	for (i = 1; (i < num_threads) && !found; i++) {
+		deque = &workers[(worker->index + i) % num_threads].deque;
+		pthread_mutex_lock(&deque->mutex);
+		if (deque->head < deque->tail) {
+			*index = deque->jobs[deque->head++];
+			found = true;
+		}
+		pthread_mutex_unlock(&deque->mutex);
+	}
+
+	/* No job is left as jobs are never added once workers are started */
+	return found;
+}
+
+void run_job(struct job *job)
+{
+	uint64_t max_cycles;
+	uint64_t num_cycles;
+	double start;
+
+	/* Create isolated machine for calling thread */
+	current_job = job;
+	if (!machine_create(job->machine, job->path)) {
+		job->status = JOB_ERROR;
+		current_job = NULL;
+		return;
+	}
+
+	/* Run requested number of frames (in slices, giving up if machine stops
+	producing frames for too long) */
+	start = get_time();
+	job->hash = 0;
+	max_cycles = clock_get_rate() * FRAME_TIMEOUT;
+	job->status = JOB_OK;
+	while (job->num_frames < (unsigned int)num_frames) {
+		num_cycles = 0;
+		while (!video_updated() && (num_cycles < max_cycles))
+			num_cycles += clock_run(max_cycles / SLICES_PER_SECOND);
+		if (num_cycles >= max_cycles) {
+			job->status = JOB_STALLED;
+			break;
+		}
+	}
+	job->fps = job->num_frames / (get_time() - start);
+
+	/* Release machine */
+	machine_deinit();
+	current_job = NULL;
+}
+
+void *work(void *data)
+{
+	struct worker *worker = data;
+	int index;
+
+	/* Run jobs until all deques are empty */
+	while (take_job(worker, &index))
+		run_job(&jobs[index]);
+
+	return NULL;
+}
+
+int print_results(double elapsed)
+{
+	static char *status_names[] = {
+		"pending",
+		"ok",
+		"stalled",
+		"error"
+	};
+	unsigned int total_frames = 0;
+	int num_failed = 0;
+	struct job *job;
+	int i;
+
+	/* Print one line per job (following list order) */
+	printf("%-8s %-8s %8s %10s %-16s %-16s %s\n",
+		"status",
+		"machine",
+		"frames",
+		"fps",
+		"frame hash",
+		"run hash",
+		"path");
+	for (i = 0; i < num_jobs; i++) {
+		job = &jobs[i];
+		printf("%-8s %-8s %8u %10.1f %016llx %016llx %s\n",
+			status_names[job->status],
+			job->machine,
+			job->num_frames,
+			job->fps,
+			(unsigned long long)job->frame_hash,
+			(unsigned long long)job->hash,
+			job->path);
+		total_frames += job->num_frames;
+		if (job->status != JOB_OK)
+			num_failed++;
+	}
+
+	/* Print summary */
+	printf("%d job(s), %d failed, %u frames in %.2f s (%.1f fps)\n",
+		num_jobs,
+		num_failed,
+		total_frames,
+		elapsed,
+		total_frames / elapsed);
+	return num_failed;
+}
+
+window_t *batch_init(struct video_frontend *UNUSED(fe),
+	struct video_specs *UNUSED(vs))
+{
+	/* There is no actual window */
+	return (window_t *)1;
+}
+
+void batch_update(struct video_frontend *UNUSED(fe), uint32_t *UNUSED(pixels))
+{
+	uint64_t h;
+
+	/* Hash frame (matching hashes logged by emux) and accumulate it into
+	run hash */
+	h = video_hash();
+	current_job->frame_hash = h;
+	current_job->hash = hash_data(&h, sizeof(h), current_job->hash);
+	current_job->num_frames++;
+}
+
+VIDEO_START(batch)
+	.init = batch_init,
+	.update = batch_update
+VIDEO_END
+
+int main(int argc, char *argv[])
+{
+	struct deque *deque;
+	double start;
+	int num_failed;
+	int i;
+
+	/* Only report errors unless requested otherwise */
+	cmdline_set_param("log-level", NULL, "3");
+
+	/* Initialize command line and fill all parameters */
+	cmdline_init(argc, argv);
+
+	/* Check if user requires help */
+	if (help) {
+		cmdline_print_usage(false);
+		return 0;
+	}
+
+	/* Validate that a job list was given (through data path) */
+	if (!env_get_data_path()) {
+		LOG_E("No job list specified!\n");
+		goto err;
+	}
+
+	/* Validate frame count */
+	if (num_frames <= 0) {
+		LOG_E("Frame count should be positive!\n");
+		goto err;
+	}
+
+	/* Render all machines to hashing frontend */
+	cmdline_set_param("video", NULL, "batch");
+
+	/* Load jobs */
+	if (!load_jobs(env_get_data_path()))
+		goto err;
+	if (num_jobs == 0) {
+		LOG_E("No job found!\n");
+		goto err;
+	}
+
+	/* Use one worker per online CPU by default, with no idle worker */
+	if (num_threads <= 0)
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_threads <= 0)
+		num_threads = 1;
+	if (num_threads > num_jobs)
+		num_threads = num_jobs;
+
+	/* Deal jobs to workers */
+	workers = calloc(num_threads, sizeof(struct worker));
+	for (i = 0; i < num_threads; i++) {
+		workers[i].index = i;
+		deque = &workers[i].deque;
+		pthread_mutex_init(&deque->mutex, NULL);
+		deque->jobs = malloc(num_jobs * sizeof(int));
+	}
+	for (i = 0; i < num_jobs; i++) {
+		deque = &workers[i % num_threads].deque;
+		deque->jobs[deque->tail++] = i;
+	}
+
+	/* Start workers and wait for all jobs to complete */
+	start = get_time();
+	for (i = 0; i < num_threads; i++)
+		pthread_create(&workers[i].thread, NULL, work, &workers[i]);
+	for (i = 0; i < num_threads; i++)
+		pthread_join(workers[i].thread, NULL);
+	num_failed = print_results(get_time() - start);
+
+	/* Free workers and jobs */
+	for (i = 0; i < num_threads; i++) {
+		pthread_mutex_destroy(&workers[i].deque.mutex);
+		free(workers[i].deque.jobs);
+	}
+	free(workers);
+	for (i = 0; i < num_jobs; i++) {
+		free(jobs[i].machine);
+		free(jobs[i].path);
+	}
+	free(jobs);
+
+	/* Report failure if any job did not complete */
+	return (num_failed > 0) ? 1 : 0;
+err:
+	cmdline_print_usage(true);
+	return 1;
+}
@@ -1,117 +1,456 @@
+#include <errno.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
-#include <sys/time.h>
+#include <time.h>
 #include <clock.h>
 #include <log.h>
 
 #define NS(s) ((s) * 1000000000)
+#define MAX_MASTER_MULT		4096
+#define DIV_TOLERANCE		1e-6
+#define SPIN_TIME		500000
+#define MAX_LATENESS		100000000
 
-static struct clock **clocks;
-static int num_clocks;
-static float machine_clock_rate;
-static float mach_delay;
-static float current_cycle;
-static float num_remaining_cycles;
-static struct timeval start_time;
-struct clock *current_clock;
+static inline bool clock_before(struct clock *a, struct clock *b);
+static inline void clock_set_due(struct clock *clock, uint64_t cycle);
+static inline void queue_set(int pos, struct clock *clock);
+static void queue_sift_up(int pos);
+static inline void queue_sift_down(int pos);
+static void queue_insert(struct clock *clock);
+static void queue_remove(struct clock *clock);
+static void update_dividers();
+static uint64_t get_time();
 
-void clock_add(struct clock *clock)
+THREAD_LOCAL struct clock_context *clock_ctx;
+
+bool clock_before(struct clock *a, struct clock *b)
+{
+	/* Order clocks by due cycle, falling back to registration order */
+	return a->key < b->key;
+}
+
+void clock_set_due(struct clock *clock, uint64_t cycle)
+{
+	/* Update due master cycle, preserving clock index */
+	clock->key = (cycle << CLOCK_INDEX_BITS) |
+		(clock->key & (MAX_CLOCKS - 1));
+}
+
+void queue_set(int pos, struct clock *clock)
+{
+	/* Place clock in queue and remember its position */
+	clock_ctx->queue[pos] = clock;
+	clock->queue_pos = pos;
+}
+
+void queue_sift_up(int pos)
 {
+	struct clock_context *ctx = clock_ctx;
+	struct clock *clock = ctx->queue[pos];
+	int parent;
+
+	/* Move clock up until its parent is due before it */
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!clock_before(clock, ctx->queue[parent]))
+			break;
+		queue_set(pos, ctx->queue[parent]);
+		pos = parent;
+	}
+	queue_set(pos, clock);
+}
+
+void queue_sift_down(int pos)
+{
+	struct clock_context *ctx = clock_ctx;
+	struct clock *clock = ctx->queue[pos];
+	int child;
+
+	/* Move clock down until both children are due after it */
+	while ((child = 2 * pos + 1) < ctx->queue_size) {
+		if ((child + 1 < ctx->queue_size) &&
+			clock_before(ctx->queue[child + 1], ctx->queue[child]))
+			child++;
+		if (!clock_before(ctx->queue[child], clock))
+			break;
+		queue_set(pos, ctx->queue[child]);
+		pos = child;
+	}
+	queue_set(pos, clock);
+}
+
+void queue_insert(struct clock *clock)
+{
+	/* Append clock to queue and restore heap order */
+	queue_set(clock_ctx->queue_size++, clock);
+	queue_sift_up(clock->queue_pos);
+}
+
+void queue_remove(struct clock *clock)
+{
+	struct clock_context *ctx = clock_ctx;
+	struct clock *last;
+	int pos;
+
+	/* Detach clock from queue */
+	pos = clock->queue_pos;
+	clock->queue_pos = -1;
+	last = ctx->queue[--ctx->queue_size];
+	if (last == clock)
+		return;
+
+	/* Fill hole with last clock and restore heap order */
+	queue_set(pos, last);
+	queue_sift_up(pos);
+	queue_sift_down(last->queue_pos);
+}
+
+void update_dividers()
+{
+	struct clock_context *ctx = clock_ctx;
+	double fastest_rate = 0.0;
+	double ratio;
+	double error;
+	int mult;
 	int i;
 
-	/* Grow clocks array and insert clock */
-	clocks = realloc(clocks, ++num_clocks * sizeof(struct clock *));
-	clocks[num_clocks - 1] = clock;
+	/* Find fastest clock rate */
+	for (i = 0; i < ctx->num_clocks; i++)
+		if (ctx->clocks[i]->rate > fastest_rate)
+			fastest_rate = ctx->clocks[i]->rate;
+
+	/* Find smallest multiple of the fastest rate which can be divided
+	exactly into every clock rate (NES needs twice the PPU rate to express
+	both the CPU and frame sequencer rates with integer dividers) */
+	for (mult = 1; mult <= MAX_MASTER_MULT; mult++) {
+		for (i = 0; i < ctx->num_clocks; i++) {
+			ratio = fastest_rate * mult / ctx->clocks[i]->rate;
+			error = ratio - (uint64_t)(ratio + 0.5);
+			if (error < 0.0)
+				error = -error;
+			if (error > ratio * DIV_TOLERANCE)
+				break;
+		}
+		if (i == ctx->num_clocks)
+			break;
+	}
+
+	/* Fall back to rounded dividers if no exact timebase exists */
+	if (mult > MAX_MASTER_MULT) {
+		LOG_W("No exact timebase found, rounding clock dividers.\n");
+		mult = 1;
+	}
+
+	/* Update machine rate/delay */
+	ctx->machine_clock_rate = fastest_rate * mult;
+	ctx->mach_delay = NS(1) / ctx->machine_clock_rate;
+
+	/* Set integer clock dividers */
+	for (i = 0; i < ctx->num_clocks; i++)
+		ctx->clocks[i]->div =
+			ctx->machine_clock_rate / ctx->clocks[i]->rate + 0.5;
+}
+
+void clock_add(struct clock *clock)
+{
+	struct clock_context *ctx = clock_ctx;
 
-	/* Update machine rate/delay if needed */
-	if (clock->rate > machine_clock_rate) {
-		machine_clock_rate = clock->rate;
-		mach_delay = NS(1) / machine_clock_rate;
+	/* Make sure clock index fits within scheduling keys */
+	if (ctx->num_clocks == MAX_CLOCKS) {
+		LOG_E("Maximum number of clocks reached!\n");
+		return;
 	}
 
-	/* Set clock dividers */
-	for (i = 0; i < num_clocks; i++)
-		clocks[i]->div = machine_clock_rate / clocks[i]->rate;
+	/* Grow clocks array and insert clock */
+	ctx->clocks = realloc(ctx->clocks,
+		++ctx->num_clocks * sizeof(struct clock *));
+	ctx->clocks[ctx->num_clocks - 1] = clock;
+
+	/* Grow queue (clock gets scheduled upon reset) */
+	ctx->queue = realloc(ctx->queue,
+		ctx->num_clocks * sizeof(struct clock *));
+	clock->key = ctx->num_clocks - 1;
+	clock->queue_pos = -1;
+
+	/* Update master timebase and clock dividers */
+	update_dividers();
 }
 
 void clock_reset()
 {
+	struct clock_context *ctx = clock_ctx;
 	int i;
 
-	/* Initialize current cycle and start time */
-	current_cycle = 0.0f;
-	gettimeofday(&start_time, NULL);
+	/* Initialize current cycle and restart syncing on next sync */
+	ctx->current_cycle = 0;
+	ctx->sync_started = false;
 
-	/* Reset all clock remaining cycles */
-	for (i = 0; i < num_clocks; i++)
-		clocks[i]->num_remaining_cycles = 0.0f;
+	/* Reset all clocks and schedule enabled ones */
+	ctx->queue_size = 0;
+	for (i = 0; i < ctx->num_clocks; i++) {
+		ctx->clocks[i]->num_remaining_cycles = 0;
+		clock_set_due(ctx->clocks[i], 0);
+		ctx->clocks[i]->queue_pos = -1;
+		if (ctx->clocks[i]->enabled)
+			queue_insert(ctx->clocks[i]);
+	}
 }
 
-void clock_tick_all(bool handle_delay)
+void clock_tick_all()
 {
-	float num_cycles;
-	float real_delay;
-	float d;
-	struct timeval current_time;
-	int i;
+	struct clock_context *ctx = clock_ctx;
+	struct clock *clock;
+	int n;
+
+	/* Leave if no clock is scheduled */
+	if (ctx->queue_size == 0)
+		return;
+
+	/* Advance time to earliest due clock */
+	if (clock_get_due(ctx->queue[0]) > ctx->current_cycle)
+		ctx->current_cycle = clock_get_due(ctx->queue[0]);
+
+	/* Tick clocks due at current cycle (bounded by queue size so that a
+	clock not consuming any cycle cannot stall the machine here) */
+	for (n = ctx->queue_size; (n > 0) && (ctx->queue_size > 0); n--) {
+		clock = ctx->queue[0];
+		if (clock_get_due(clock) > ctx->current_cycle)
+			break;
+
+		/* Tick clock */
+		ctx->current_clock = clock;
+		clock->tick(clock->data);
+
+		/* Reschedule clock if it is still enabled */
+		if (clock->queue_pos >= 0)
+			queue_sift_down(clock->queue_pos);
+	}
+}
 
-	/* Initialize number of cycles to skip */
-	num_cycles = machine_clock_rate;
+uint64_t clock_run(uint64_t num_cycles)
+{
+	struct clock_context *ctx = clock_ctx;
+	uint64_t start_cycle = ctx->current_cycle;
+	struct clock *clock;
+	uint64_t end_cycle;
+	uint64_t due_cycle;
 
-	/* Tick clocks */
-	for (i = 0; i < num_clocks; i++) {
-		/* Set current clock */
-		current_clock = clocks[i];
+	/* Compute end cycle, saturating on overflow */
+	end_cycle = ctx->current_cycle + num_cycles;
+	if (end_cycle < ctx->current_cycle)
+		end_cycle = UINT64_MAX;
 
-		/* Skip clock if disabled */
-		if (!current_clock->enabled)
-			continue;
+	/* Tick clocks until end cycle is reached or stop is requested */
+	ctx->stop_requested = false;
+	while (!ctx->stop_requested) {
+		/* Jump to end cycle if next clock is not due before it */
+		if ((ctx->queue_size == 0) ||
+			(clock_get_due(ctx->queue[0]) >= end_cycle)) {
+			ctx->current_cycle = end_cycle;
+			break;
+		}
 
-		/* Decrease clock cycles */
-		current_clock->num_remaining_cycles -= num_remaining_cycles;
+		/* Advance time to earliest due clock */
+		clock = ctx->queue[0];
+		due_cycle = clock_get_due(clock);
+		if (due_cycle > ctx->current_cycle)
+			ctx->current_cycle = due_cycle;
 
-		/* Tick clock if necessary */
-		if (current_clock->num_remaining_cycles <= 0.0f)
-			current_clock->tick(current_clock->data);
+		/* Tick clock */
+		ctx->current_clock = clock;
+		clock->tick(clock->data);
 
-		/* Save next number of remaining cycles if needed */
-		if ((current_clock->num_remaining_cycles < num_cycles) &&
-			current_clock->enabled)
-			num_cycles = current_clock->num_remaining_cycles;
+		/* Reschedule clock if it is still enabled */
+		if (clock->queue_pos >= 0)
+			queue_sift_down(clock->queue_pos);
 	}
 
-	/* Update current cycle and number of remaining cycles */
-	current_cycle += num_cycles;
-	num_remaining_cycles = num_cycles;
+	/* Return number of elapsed cycles */
+	return ctx->current_cycle - start_cycle;
+}
+
+void clock_stop()
+{
+	/* Request clock_run() to return after current tick */
+	clock_ctx->stop_requested = true;
+}
+
+uint64_t get_time()
+{
+	struct timespec ts;
+
+	/* Get monotonic time (in ns) */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return NS((uint64_t)ts.tv_sec) + ts.tv_nsec;
+}
 
-	/* Only sleep if delay handling is needed */
-	if (handle_delay) {
-		/* Get actual delay (in ns) */
-		gettimeofday(&current_time, NULL);
-		real_delay = NS(current_time.tv_sec - start_time.tv_sec) +
-			(current_time.tv_usec - start_time.tv_usec) * 1000;
+void clock_sync()
+{
+	struct clock_context *ctx = clock_ctx;
+	struct timespec ts;
+	uint64_t deadline;
+	uint64_t now;
+
+	/* Get current time */
+	now = get_time();
+
+	/* Take current time and cycle as reference upon first sync */
+	if (!ctx->sync_started) {
+		ctx->sync_time = now;
+		ctx->sync_cycle = ctx->current_cycle;
+		ctx->sync_started = true;
+		return;
+	}
 
-		/* Sleep to match machine delay if needed */
-		if (current_cycle * mach_delay > real_delay) {
-			d = (current_cycle * mach_delay - real_delay) / 1000;
-			usleep(d);
+	/* Compute real time at which current cycle is due */
+	deadline = ctx->sync_time +
+		(ctx->current_cycle - ctx->sync_cycle) * ctx->mach_delay;
+	ctx->num_syncs++;
+
+	/* Report missed deadline and restart syncing if way too late */
+	if (now > deadline) {
+		ctx->num_missed_deadlines++;
+		LOG_D("Missed sync deadline by %u us.\n",
+			(unsigned int)((now - deadline) / 1000));
+		if (now - deadline > MAX_LATENESS) {
+			ctx->sync_time = now;
+			ctx->sync_cycle = ctx->current_cycle;
 		}
+		return;
+	}
+
+	/* Sleep until shortly before deadline */
+	if (deadline - now > SPIN_TIME) {
+#ifdef TIMER_ABSTIME
+		ts.tv_sec = (deadline - SPIN_TIME) / NS(1);
+		ts.tv_nsec = (deadline - SPIN_TIME) % NS(1);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+			NULL) == EINTR);
+#else
+		ts.tv_sec = (deadline - SPIN_TIME - now) / NS(1);
+		ts.tv_nsec = (deadline - SPIN_TIME - now) % NS(1);
+		nanosleep(&ts, NULL);
+#endif
+	}
+
+	/* Spin for remaining time */
+	while (get_time() < deadline);
+}
+
+double clock_get_rate()
+{
+	/* Return master clock rate */
+	return clock_ctx->machine_clock_rate;
+}
+
+void clock_set_enabled(struct clock *clock, bool enabled)
+{
+	struct clock_context *ctx = clock_ctx;
+
+	clock->enabled = enabled;
+
+	/* Schedule clock, resuming from its frozen remaining cycles */
+	if (enabled && (clock->queue_pos < 0)) {
+		if (clock->num_remaining_cycles < 0)
+			clock->num_remaining_cycles = 0;
+		clock_set_due(clock,
+			ctx->current_cycle + clock->num_remaining_cycles);
+		queue_insert(clock);
+		return;
 	}
 
-	/* Reset current cycle and start time if needed */
-	if (current_cycle >= machine_clock_rate) {
-		if (handle_delay)
-			gettimeofday(&start_time, NULL);
-		current_cycle -= machine_clock_rate;
+	/* Unschedule clock, freezing its remaining cycles */
+	if (!enabled && (clock->queue_pos >= 0)) {
+		clock->num_remaining_cycles =
+			(int64_t)(clock_get_due(clock) - ctx->current_cycle);
+		queue_remove(clock);
 	}
 }
 
+void clock_schedule(struct clock *clock, int num_cycles)
+{
+	struct clock_context *ctx = clock_ctx;
+
+	/* Only update remaining cycles if clock is not scheduled */
+	if (clock->queue_pos < 0) {
+		clock->num_remaining_cycles = num_cycles * clock->div;
+		return;
+	}
+
+	/* Set next tick and restore queue order */
+	clock_set_due(clock, ctx->current_cycle + num_cycles * clock->div);
+	queue_sift_up(clock->queue_pos);
+	queue_sift_down(clock->queue_pos);
+}
+
+void clock_schedule_at(struct clock *clock, uint64_t cycle)
+{
+	/* Only update remaining cycles if clock is not scheduled */
+	if (clock->queue_pos < 0) {
+		clock->num_remaining_cycles = cycle - clock_ctx->current_cycle;
+		return;
+	}
+
+	/* Set next tick and restore queue order */
+	clock_set_due(clock, cycle);
+	queue_sift_up(clock->queue_pos);
+	queue_sift_down(clock->queue_pos);
+}
+
+void clock_serialize(struct state *state)
+{
+	struct clock_context *ctx = clock_ctx;
+	int i;
+
+	/* Save current cycle and clock schedules */
+	STATE_SAVE(state, ctx->current_cycle);
+	for (i = 0; i < ctx->num_clocks; i++) {
+		STATE_SAVE(state, ctx->clocks[i]->enabled);
+		STATE_SAVE(state, ctx->clocks[i]->key);
+		STATE_SAVE(state, ctx->clocks[i]->num_remaining_cycles);
+	}
+}
+
+void clock_deserialize(struct state *state)
+{
+	struct clock_context *ctx = clock_ctx;
+	uint64_t prev_cycle = ctx->current_cycle;
+	int i;
+
+	/* Restore current cycle and clock schedules, rebuilding queue */
+	STATE_LOAD(state, ctx->current_cycle);
+	ctx->queue_size = 0;
+	for (i = 0; i < ctx->num_clocks; i++) {
+		STATE_LOAD(state, ctx->clocks[i]->enabled);
+		STATE_LOAD(state, ctx->clocks[i]->key);
+		STATE_LOAD(state, ctx->clocks[i]->num_remaining_cycles);
+		ctx->clocks[i]->queue_pos = -1;
+		if (ctx->clocks[i]->enabled)
+			queue_insert(ctx->clocks[i]);
+	}
+
+	/* Move sync reference along so that pacing ignores the jump */
+	ctx->sync_cycle += ctx->current_cycle - prev_cycle;
+}
+
 void clock_remove_all()
 {
-	free(clocks);
-	clocks = NULL;
-	num_clocks = 0;
+	struct clock_context *ctx = clock_ctx;
+
+	/* Report missed sync deadlines if any */
+	if (ctx->num_missed_deadlines > 0)
+		LOG_I("Missed %u of %u sync deadlines.\n",
+			ctx->num_missed_deadlines,
+			ctx->num_syncs);
+	ctx->num_missed_deadlines = 0;
+	ctx->num_syncs = 0;
+
+	free(ctx->clocks);
+	free(ctx->queue);
+	ctx->clocks = NULL;
+	ctx->queue = NULL;
+	ctx->num_clocks = 0;
+	ctx->queue_size = 0;
 }
 
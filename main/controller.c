@@ -6,21 +6,25 @@
 #include <log.h>
 
 struct list_link *controllers;
-static struct list_link *controller_instances;
+THREAD_LOCAL struct controller_context *controller_ctx;
 
 bool controller_add(struct controller_instance *instance)
 {
 	struct list_link *link = controllers;
+	struct controller_instance *copy;
 	struct controller *c;
 
 	while ((c = list_get_next(&link)))
 		if (!strcmp(instance->controller_name, c->name)) {
-			instance->controller = c;
-			if ((c->init && c->init(instance)) || !c->init) {
-				list_insert(&controller_instances,
-					instance);
+			/* Work on a copy (machines may share instances) */
+			copy = malloc(sizeof(struct controller_instance));
+			*copy = *instance;
+			copy->controller = c;
+			if ((c->init && c->init(copy)) || !c->init) {
+				list_insert(&controller_ctx->instances, copy);
 				return true;
 			}
+			free(copy);
 			return false;
 		}
 
@@ -31,7 +35,7 @@ bool controller_add(struct controller_instance *instance)
 
 void controller_reset_all()
 {
-	struct list_link *link = controller_instances;
+	struct list_link *link = controller_ctx->instances;
 	struct controller_instance *instance;
 
 	while ((instance = list_get_next(&link)))
@@ -39,15 +43,37 @@ void controller_reset_all()
 			instance->controller->reset(instance);
 }
 
-void controller_remove_all()
+void controller_serialize_all(struct state *state)
+{
+	struct list_link *link = controller_ctx->instances;
+	struct controller_instance *instance;
+
+	while ((instance = list_get_next(&link)))
+		if (instance->controller->serialize)
+			instance->controller->serialize(instance, state);
+}
+
+void controller_deserialize_all(struct state *state)
 {
-	struct list_link *link = controller_instances;
+	struct list_link *link = controller_ctx->instances;
 	struct controller_instance *instance;
 
 	while ((instance = list_get_next(&link)))
+		if (instance->controller->deserialize)
+			instance->controller->deserialize(instance, state);
+}
+
+void controller_remove_all()
+{
+	struct list_link *link = controller_ctx->instances;
+	struct controller_instance *instance;
+
+	while ((instance = list_get_next(&link))) {
 		if (instance->controller->deinit)
 			instance->controller->deinit(instance);
+		free(instance);
+	}
 
-	list_remove_all(&controller_instances);
+	list_remove_all(&controller_ctx->instances);
 }
 
@@ -6,20 +6,25 @@
 #include <log.h>
 
 struct list_link *cpus;
-static struct list_link *cpu_instances;
+THREAD_LOCAL struct cpu_context *cpu_ctx;
 
 bool cpu_add(struct cpu_instance *instance)
 {
 	struct list_link *link = cpus;
+	struct cpu_instance *copy;
 	struct cpu *cpu;
 
 	while ((cpu = list_get_next(&link)))
 		if (!strcmp(instance->cpu_name, cpu->name)) {
-			instance->cpu = cpu;
-			if ((cpu->init && cpu->init(instance)) || !cpu->init) {
-				list_insert(&cpu_instances, instance);
+			/* Work on a copy (machines may share instances) */
+			copy = malloc(sizeof(struct cpu_instance));
+			*copy = *instance;
+			copy->cpu = cpu;
+			if ((cpu->init && cpu->init(copy)) || !cpu->init) {
+				list_insert(&cpu_ctx->instances, copy);
 				return true;
 			}
+			free(copy);
 			return false;
 		}
 
@@ -30,7 +35,7 @@ bool cpu_add(struct cpu_instance *instance)
 
 void cpu_reset_all()
 {
-	struct list_link *link = cpu_instances;
+	struct list_link *link = cpu_ctx->instances;
 	struct cpu_instance *instance;
 
 	while ((instance = list_get_next(&link)))
@@ -41,7 +46,7 @@ void cpu_reset_all()
 void cpu_interrupt(int irq)
 {
 	struct cpu_instance *instance;
-	struct list_link *link = cpu_instances;
+	struct list_link *link = cpu_ctx->instances;
 
 	/* Interrupt first CPU only */
 	instance = list_get_next(&link);
@@ -52,7 +57,7 @@ void cpu_interrupt(int irq)
 void cpu_halt(bool halt)
 {
 	struct cpu_instance *instance;
-	struct list_link *link = cpu_instances;
+	struct list_link *link = cpu_ctx->instances;
 
 	/* Halt first CPU only */
 	instance = list_get_next(&link);
@@ -60,15 +65,37 @@ void cpu_halt(bool halt)
 		instance->cpu->halt(instance, halt);
 }
 
-void cpu_remove_all()
+void cpu_serialize_all(struct state *state)
+{
+	struct list_link *link = cpu_ctx->instances;
+	struct cpu_instance *instance;
+
+	while ((instance = list_get_next(&link)))
+		if (instance->cpu->serialize)
+			instance->cpu->serialize(instance, state);
+}
+
+void cpu_deserialize_all(struct state *state)
 {
-	struct list_link *link = cpu_instances;
+	struct list_link *link = cpu_ctx->instances;
 	struct cpu_instance *instance;
 
 	while ((instance = list_get_next(&link)))
+		if (instance->cpu->deserialize)
+			instance->cpu->deserialize(instance, state);
+}
+
+void cpu_remove_all()
+{
+	struct list_link *link = cpu_ctx->instances;
+	struct cpu_instance *instance;
+
+	while ((instance = list_get_next(&link))) {
 		if (instance->cpu->deinit)
 			instance->cpu->deinit(instance);
+		free(instance);
+	}
 
-	list_remove_all(&cpu_instances);
+	list_remove_all(&cpu_ctx->instances);
 }
 
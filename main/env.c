@@ -1,4 +1,6 @@
 #include <cmdline.h>
+#include <env.h>
+#include <util.h>
 
 /* Command-line parameters */
 static char *data_path;
@@ -10,9 +12,17 @@ PARAM(config_path, string, "config-dir", NULL, "Path to config directory")
 static char *save_path = "";
 PARAM(save_path, string, "save-dir", NULL, "Path to save directory")
 
+/* Data path overriding command line for machines created on this thread */
+static THREAD_LOCAL char *thread_data_path;
+
 char *env_get_data_path()
 {
-	return data_path;
+	return thread_data_path ? thread_data_path : data_path;
+}
+
+void env_set_data_path(char *path)
+{
+	thread_data_path = path;
 }
 
 char *env_get_system_path()
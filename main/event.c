@@ -14,7 +14,7 @@ struct event {
 	struct list_link *listeners;
 };
 
-static struct list_link *events;
+THREAD_LOCAL struct event_context *event_ctx;
 
 void event_fire(char *name)
 {
@@ -23,7 +23,7 @@ void event_fire(char *name)
 	struct listener *listener;
 
 	/* Parse events and find match if any */
-	link = events;
+	link = event_ctx->events;
 	while ((event = list_get_next(&link)))
 		if (!strcmp(event->name, name))
 			break;
@@ -43,7 +43,7 @@ void event_add(char *name, event_callback_t cb, event_data_t *data)
 	struct listener *listener;
 
 	/* Try finding matching event in event list */
-	link = events;
+	link = event_ctx->events;
 	while ((event = list_get_next(&link)))
 		if (!strcmp(event->name, name))
 			break;
@@ -53,7 +53,7 @@ void event_add(char *name, event_callback_t cb, event_data_t *data)
 		event = malloc(sizeof(struct event));
 		event->name = name;
 		event->listeners = NULL;
-		list_insert(&events, event);
+		list_insert(&event_ctx->events, event);
 	}
 
 	/* Parse event listeners */
@@ -85,7 +85,7 @@ void event_remove(char *name, event_callback_t cb)
 	struct listener *listener;
 
 	/* Try finding matching event in event list */
-	link = events;
+	link = event_ctx->events;
 	while ((event = list_get_next(&link)))
 		if (!strcmp(event->name, name))
 			break;
@@ -122,7 +122,7 @@ void event_remove_all()
 	struct listener *listener;
 
 	/* Parse event list */
-	event_link = events;
+	event_link = event_ctx->events;
 	while ((event = list_get_next(&event_link))) {
 		/* Free listeners */
 		listener_link = event->listeners;
@@ -137,6 +137,6 @@ void event_remove_all()
 	}
 
 	/* Remove links from event list */
-	list_remove_all(&events);
+	list_remove_all(&event_ctx->events);
 }
 
@@ -0,0 +1,111 @@
+#include <string.h>
+#include <hash.h>
+
+#define PRIME1	0x9E3779B185EBCA87ULL
+#define PRIME2	0xC2B2AE3D27D4EB4FULL
+#define PRIME3	0x165667B19E3779F9ULL
+#define PRIME4	0x85EBCA77C2B2AE63ULL
+#define PRIME5	0x27D4EB2F165667C5ULL
+#define STRIPE_SIZE	32
+
+static inline uint64_t rotl(uint64_t v, int n);
+static inline uint64_t read64(const uint8_t *p);
+static inline uint32_t read32(const uint8_t *p);
+static inline uint64_t hash_round(uint64_t acc, uint64_t v);
+static inline uint64_t merge(uint64_t h, uint64_t acc);
+
+uint64_t rotl(uint64_t v, int n)
+{
+	return (v << n) | (v >> (64 - n));
+}
+
+uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(uint64_t));
+	return v;
+}
+
+uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(uint32_t));
+	return v;
+}
+
+uint64_t hash_round(uint64_t acc, uint64_t v)
+{
+	acc += v * PRIME2;
+	return rotl(acc, 31) * PRIME1;
+}
+
+uint64_t merge(uint64_t h, uint64_t acc)
+{
+	h ^= hash_round(0, acc);
+	return h * PRIME1 + PRIME4;
+}
+
+/* Data is hashed following the XXH64 algorithm: 32-byte stripes are consumed
+by four independent accumulators (keeping multiplications pipelined), which are
+then merged and mixed with remaining bytes. Values are read in host byte order,
+so hashes of multi-byte data are only comparable between hosts sharing it. */
+uint64_t hash_data(const void *data, size_t size, uint64_t seed)
+{
+	const uint8_t *p = data;
+	const uint8_t *end = p + size;
+	uint64_t acc[4];
+	uint64_t h;
+
+	if (size >= STRIPE_SIZE) {
+		/* Consume whole stripes */
+		acc[0] = seed + PRIME1 + PRIME2;
+		acc[1] = seed + PRIME2;
+		acc[2] = seed;
+		acc[3] = seed - PRIME1;
+		do {
+			acc[0] = hash_round(acc[0], read64(p));
+			acc[1] = hash_round(acc[1], read64(p + 8));
+			acc[2] = hash_round(acc[2], read64(p + 16));
+			acc[3] = hash_round(acc[3], read64(p + 24));
+			p += STRIPE_SIZE;
+		} while (p + STRIPE_SIZE <= end);
+
+		/* Merge accumulators */
+		h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) +
+			rotl(acc[3], 18);
+		h = merge(h, acc[0]);
+		h = merge(h, acc[1]);
+		h = merge(h, acc[2]);
+		h = merge(h, acc[3]);
+	} else {
+		h = seed + PRIME5;
+	}
+	h += size;
+
+	/* Mix remaining bytes (8, 4, then 1 at a time) */
+	while (p + 8 <= end) {
+		h ^= hash_round(0, read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= read32(p) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= *p++ * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+	}
+
+	/* Avalanche final value */
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
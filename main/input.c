@@ -34,8 +34,7 @@ static void input_save(struct input_config *config);
 #endif
 
 struct list_link *input_frontends;
-static struct input_frontend *frontend;
-static struct list_link *configs;
+THREAD_LOCAL struct input_context *input_ctx;
 
 void get_key_code_name(int code, char *output)
 {
@@ -488,23 +487,33 @@ bool input_init(char *name, window_t *window)
 	struct list_link *link = input_frontends;
 	struct input_frontend *fe;
 
-	if (frontend) {
+	if (input_ctx->frontend) {
 		LOG_E("Input frontend already initialized!\n");
 		return false;
 	}
 
+	/* Leave already if video frontend has no associated input */
+	if (!name)
+		return true;
+
 	/* Find input frontend */
 	while ((fe = list_get_next(&link))) {
 		/* Skip if name does not match */
 		if (strcmp(name, fe->name))
 			continue;
 
+		/* Work on a copy so that machines can share frontends */
+		input_ctx->frontend = malloc(sizeof(struct input_frontend));
+		*input_ctx->frontend = *fe;
+
 		/* Initialize frontend */
-		if (fe->init && !fe->init(fe, window))
+		if (fe->init && !fe->init(input_ctx->frontend, window)) {
+			free(input_ctx->frontend);
+			input_ctx->frontend = NULL;
 			return false;
+		}
 
-		/* Save frontend and return success */
-		frontend = fe;
+		/* Return success */
 		return true;
 	}
 
@@ -515,6 +524,8 @@ bool input_init(char *name, window_t *window)
 
 void input_set_window(window_t *window)
 {
+	struct input_frontend *frontend = input_ctx->frontend;
+
 	if (frontend && frontend->set_w)
 		frontend->set_w(frontend, window);
 }
@@ -712,13 +723,15 @@ err:
 
 void input_update()
 {
+	struct input_frontend *frontend = input_ctx->frontend;
+
 	if (frontend && frontend->update)
 		frontend->update(frontend);
 }
 
 void input_report(struct input_event *event)
 {
-	struct list_link *link = configs;
+	struct list_link *link = input_ctx->configs;
 	struct input_config *config;
 	struct input_desc *desc;
 	int i;
@@ -745,6 +758,7 @@ void input_report(struct input_event *event)
 
 void input_register(struct input_config *config, bool restore)
 {
+	struct input_frontend *frontend = input_ctx->frontend;
 	struct input_desc *descs;
 	int i;
 
@@ -783,28 +797,33 @@ void input_register(struct input_config *config, bool restore)
 		frontend->load(frontend, config);
 
 	/* Append configuration */
-	list_insert(&configs, config);
+	list_insert(&input_ctx->configs, config);
 }
 
 void input_unregister(struct input_config *config)
 {
+	struct input_frontend *frontend = input_ctx->frontend;
+
 	if (frontend) {
 		/* Unregister config from frontend */
 		if (frontend->unload)
 			frontend->unload(frontend, config);
 
 		/* Remove config */
-		list_remove(&configs, config);
+		list_remove(&input_ctx->configs, config);
 	}
 }
 
 void input_deinit()
 {
+	struct input_frontend *frontend = input_ctx->frontend;
+
 	if (!frontend)
 		return;
 
 	if (frontend->deinit)
 		frontend->deinit(frontend);
-	frontend = NULL;
+	free(frontend);
+	input_ctx->frontend = NULL;
 }
 
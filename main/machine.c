@@ -9,18 +9,61 @@
 #include <cmdline.h>
 #include <controller.h>
 #include <cpu.h>
+#include <env.h>
 #include <event.h>
 #include <input.h>
 #include <log.h>
 #include <machine.h>
 #include <memory.h>
 #include <port.h>
+#include <regress.h>
+#include <rewind.h>
 #include <util.h>
 #include <video.h>
 
+#define MIN_SYNC_RATE 50
+#define REWIND_EVENT_ID 2
+#define STATE_MAGIC "EMUX"
+
+struct state_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t size;
+	char machine[16];
+};
+
+/* A machine context holds the whole state of an emulated machine, allowing
+several machines to coexist within a process (each thread working on the
+context it last selected) */
+struct machine_context {
+	struct machine machine;
+	struct input_config input_config;
+	size_t state_size;
+	struct rewind *rewind;
+	uint8_t *rewind_state;
+	bool rewinding;
+	struct regress *regress;
+	bool diverged;
+	uint8_t *run_ahead_state;
+	struct audio_context audio;
+	struct clock_context clock;
+	struct controller_context controller;
+	struct cpu_context cpu;
+	struct event_context event;
+	struct input_context input;
+	struct memory_context memory;
+	struct port_context port;
+	struct video_context video;
+};
+
 static void machine_cleanup();
 static void machine_event(int id, enum input_type type, input_data_t *data);
 static void quit();
+static void machine_frame();
+static uint64_t machine_run_ahead();
+static void machine_serialize(struct state *state);
+static void machine_deserialize(struct state *state);
+static size_t machine_measure_state();
 #ifdef EMSCRIPTEN
 static void emscripten_run();
 #endif
@@ -31,14 +74,23 @@ static bool no_sync;
 PARAM(no_sync, bool, "no-sync", NULL, "Disables emulation syncing")
 static unsigned int cycles;
 PARAM(cycles, int, "cycles", NULL, "Sets number of machine cycles to emulate")
+static int rewind_size;
+PARAM(rewind_size, int, "rewind-size", NULL, "Sets rewind buffer size (in MB)")
+static int run_ahead;
+PARAM(run_ahead, int, "run-ahead", NULL, "Sets number of frames to run ahead")
+static char *hash_log_path;
+PARAM(hash_log_path, string, "hash-log", NULL, "Logs frame hashes to a file")
+static char *golden_path;
+PARAM(golden_path, string, "hash-check", NULL,
+	"Compares frame hashes with a golden file")
 
 struct list_link *machines;
-static struct machine *machine;
-static struct input_config input_config;
+static THREAD_LOCAL struct machine_context *machine_ctx;
 
 static struct input_desc input_descs[] = {
 	{ NULL, DEVICE_NONE, GENERIC_QUIT },
-	{ NULL, DEVICE_KEYBOARD, KEY_ESCAPE }
+	{ NULL, DEVICE_KEYBOARD, KEY_ESCAPE },
+	{ NULL, DEVICE_KEYBOARD, KEY_BACKSPACE }
 };
 
 void machine_cleanup()
@@ -53,11 +105,77 @@ void machine_cleanup()
 	controller_remove_all();
 }
 
-void machine_event(int UNUSED(id), enum input_type UNUSED(type),
-	input_data_t *UNUSED(data))
+void machine_event(int id, enum input_type type, input_data_t *data)
 {
+	struct machine_context *ctx = data;
+
+	/* Rewind while key is held */
+	if (id == REWIND_EVENT_ID) {
+		ctx->rewinding = (type == EVENT_BUTTON_DOWN);
+		return;
+	}
+
 	/* Request machine to stop running */
-	machine->running = false;
+	ctx->machine.running = false;
+}
+
+void machine_frame()
+{
+	struct machine_context *ctx = machine_ctx;
+	enum regress_status status;
+
+	/* Check frame hashes if requested, stopping machine once golden file
+	is exhausted or at first divergence */
+	if (ctx->regress) {
+		status = regress_frame(ctx->regress, video_hash(),
+			audio_hash());
+		if (status != REGRESS_CONTINUE) {
+			ctx->diverged = (status == REGRESS_DIVERGED);
+			ctx->machine.running = false;
+			return;
+		}
+	}
+
+	/* Leave already if rewind is disabled */
+	if (!ctx->rewind)
+		return;
+
+	/* Restore previous state if rewinding, or capture current one */
+	if (ctx->rewinding) {
+		if (rewind_pop(ctx->rewind, ctx->rewind_state))
+			machine_load_state(ctx->rewind_state, ctx->state_size);
+		return;
+	}
+	machine_save_state(ctx->rewind_state, ctx->state_size);
+	rewind_push(ctx->rewind, ctx->rewind_state);
+}
+
+uint64_t machine_run_ahead()
+{
+	struct machine_context *ctx = machine_ctx;
+	uint64_t num_cycles = 0;
+	int i;
+
+	/* Run actual frame without presenting it */
+	video_set_skip(true);
+	while (!video_updated())
+		num_cycles += clock_run(UINT64_MAX);
+
+	/* Save state and run ahead silently, only presenting last frame */
+	machine_save_state(ctx->run_ahead_state, ctx->state_size);
+	audio_set_mute(true);
+	for (i = 1; i <= run_ahead; i++) {
+		video_set_skip(i < run_ahead);
+		while (!video_updated())
+			clock_run(UINT64_MAX);
+	}
+	audio_set_mute(false);
+
+	/* Go back to actual frame */
+	machine_load_state(ctx->run_ahead_state, ctx->state_size);
+
+	/* Return actual number of elapsed cycles */
+	return num_cycles;
 }
 
 void quit()
@@ -66,7 +184,7 @@ void quit()
 	audio_stop();
 
 	/* Unregister quit events */
-	input_unregister(&input_config);
+	input_unregister(&machine_ctx->input_config);
 
 	/* Deinitialize machine */
 	machine_deinit();
@@ -76,112 +194,353 @@ void quit()
 void emscripten_run()
 {
 	/* Run until screen is updated */
-	while (!video_updated())
-		machine_step();
+	machine_run_frame();
 
 	/* Stop machine if frame count is reached */
 	if ((frames > 0) && (--frames == 0))
-		machine->running = false;
+		machine_ctx->machine.running = false;
 
 	/* Quit once user has requested it (or if frame count is reached) */
-	if (!machine->running)
+	if (!machine_ctx->machine.running)
 		quit();
 }
 #endif
 
 bool machine_init()
+{
+	struct machine_context *ctx;
+
+	/* Create machine selected from command line */
+	ctx = machine_create(machine_name, NULL);
+	if (!ctx)
+		return false;
+
+	/* Initialize frame hash checking if requested */
+	if (hash_log_path || golden_path) {
+		ctx->regress = regress_init(hash_log_path, golden_path);
+		if (!ctx->regress) {
+			machine_deinit();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct machine_context *machine_create(char *name, char *data_path)
 {
 	struct list_link *link = machines;
+	struct machine_context *ctx;
+	struct machine *machine;
 	struct machine *m;
+	bool ret;
 
 	/* Validate machine option */
-	if (!machine_name) {
+	if (!name) {
 		LOG_E("No machine selected!\n");
-		return false;
+		return NULL;
 	}
 
 	while ((m = list_get_next(&link)))
-		if (!strcmp(machine_name, m->name))
-			machine = m;
+		if (!strcmp(name, m->name))
+			break;
 
 	/* Exit if machine has not been found */
-	if (!machine) {
-		LOG_E("Machine \"%s\" not recognized!\n", machine_name);
-		return false;
+	if (!m) {
+		LOG_E("Machine \"%s\" not recognized!\n", name);
+		return NULL;
 	}
 
+	/* Create context holding a copy of the machine and select it */
+	ctx = calloc(1, sizeof(struct machine_context));
+	ctx->machine = *m;
+	machine = &ctx->machine;
+	machine_set_context(ctx);
+
 	/* Display machine name and description */
 	LOG_I("Machine: %s (%s)\n", machine->name, machine->description);
 
-	if (machine->init && !machine->init(machine)) {
+	/* Initialize machine, overriding data path if requested */
+	env_set_data_path(data_path);
+	ret = !machine->init || machine->init(machine);
+	env_set_data_path(NULL);
+	if (!ret) {
 		machine_cleanup();
-		return false;
+		machine_set_context(NULL);
+		free(ctx);
+		return NULL;
 	}
 
 	/* Register for quit events */
-	input_config.descs = input_descs;
-	input_config.num_descs = ARRAY_SIZE(input_descs);
-	input_config.callback = machine_event;
-	input_config.data = NULL;
-	input_register(&input_config, false);
+	ctx->input_config.descs = input_descs;
+	ctx->input_config.num_descs = ARRAY_SIZE(input_descs);
+	ctx->input_config.callback = machine_event;
+	ctx->input_config.data = ctx;
+	input_register(&ctx->input_config, false);
 
 	/* Reset machine */
 	machine_reset();
 
-	return true;
+	/* Measure state once (its layout being fixed for the machine) */
+	ctx->state_size = machine_measure_state();
+
+	/* Initialize rewind buffer if requested */
+	if (rewind_size > 0) {
+		ctx->rewind = rewind_init(ctx->state_size,
+			MB((size_t)rewind_size));
+		if (ctx->rewind)
+			ctx->rewind_state = malloc(ctx->state_size);
+	}
+
+	/* Allocate run-ahead state if requested */
+	if (run_ahead > 0)
+		ctx->run_ahead_state = malloc(ctx->state_size);
+
+	return ctx;
+}
+
+struct machine_context *machine_get_context()
+{
+	return machine_ctx;
+}
+
+void machine_set_context(struct machine_context *ctx)
+{
+	/* Point all sub-systems to machine state for calling thread */
+	machine_ctx = ctx;
+	audio_ctx = ctx ? &ctx->audio : NULL;
+	clock_ctx = ctx ? &ctx->clock : NULL;
+	controller_ctx = ctx ? &ctx->controller : NULL;
+	cpu_ctx = ctx ? &ctx->cpu : NULL;
+	event_ctx = ctx ? &ctx->event : NULL;
+	input_ctx = ctx ? &ctx->input : NULL;
+	memory_ctx = ctx ? &ctx->memory : NULL;
+	port_ctx = ctx ? &ctx->port : NULL;
+	video_ctx = ctx ? &ctx->video : NULL;
 }
 
 void machine_reset()
 {
+	struct machine *machine = &machine_ctx->machine;
+
 	/* Call machine-specific reset if available */
-	if (machine && machine->reset)
+	if (machine->reset)
 		machine->reset(machine);
 
-	/* Reset CPUs, controllers, and clock system */
+	/* Reset CPUs, controllers, clock system, and audio */
 	cpu_reset_all();
 	controller_reset_all();
 	clock_reset();
+	audio_reset();
 
 	LOG_I("Machine reset.\n");
 }
 
-void machine_run()
+bool machine_run()
 {
+	struct machine_context *ctx = machine_ctx;
+#ifndef EMSCRIPTEN
+	unsigned int num_remaining_cycles = cycles;
+	uint64_t num_cycles;
+	bool diverged;
+#endif
+
 	/* Start audio processing */
 	audio_start();
 
 	/* Set running flag */
-	machine->running = true;
+	ctx->machine.running = true;
 
 #ifndef EMSCRIPTEN
 	/* Run until user quits */
-	while (machine->running) {
-		/* Tick registered clocks */
-		clock_tick_all(!no_sync);
+	while (ctx->machine.running) {
+		if (ctx->run_ahead_state) {
+			/* Run whole frame ahead and handle rewind */
+			num_cycles = machine_run_ahead();
+			machine_frame();
+		} else {
+			/* Run until next frame, sync period or cycle count */
+			num_cycles = clock_get_rate() / MIN_SYNC_RATE;
+			if ((num_remaining_cycles > 0) &&
+				(num_remaining_cycles < num_cycles))
+				num_cycles = num_remaining_cycles;
+			num_cycles = clock_run(num_cycles);
+
+			/* Handle rewind at frame boundaries */
+			if (video_updated())
+				machine_frame();
+		}
 
 		/* Stop machine if cycle count is reached */
-		if ((cycles > 0) && (--cycles == 0))
-			machine->running = false;
+		if (num_remaining_cycles > 0) {
+			if (num_cycles >= num_remaining_cycles)
+				ctx->machine.running = false;
+			else
+				num_remaining_cycles -= num_cycles;
+		}
+
+		/* Sync with audio device if possible, or with real time */
+		if (!no_sync && !audio_sync())
+			clock_sync();
 	}
 
-	/* Clean up resources */
+	/* Clean up resources (reporting divergence from golden file) */
+	diverged = ctx->diverged;
 	quit();
+	return !diverged;
 #else
 	/* Set emscripten loop */
 	emscripten_set_main_loop(emscripten_run, 0, 0);
+	return true;
 #endif
 }
 
 void machine_step()
 {
 	/* Step one machine cycle with no delay handling */
-	clock_tick_all(false);
+	clock_tick_all();
+}
+
+void machine_run_frame()
+{
+	/* Run ahead if requested */
+	if (machine_ctx->run_ahead_state) {
+		machine_run_ahead();
+		return;
+	}
+
+	/* Run with no delay handling until video gets updated */
+	while (!video_updated())
+		clock_run(UINT64_MAX);
+}
+
+void machine_run_cycles(uint64_t num_cycles)
+{
+	/* Run desired number of master cycles, going through frames */
+	while (num_cycles > 0)
+		num_cycles -= clock_run(num_cycles);
+}
+
+void machine_serialize(struct state *state)
+{
+	struct machine *machine = &machine_ctx->machine;
+
+	/* Save machine, CPU, controller, clock, and audio states */
+	if (machine->serialize)
+		machine->serialize(machine, state);
+	cpu_serialize_all(state);
+	controller_serialize_all(state);
+	clock_serialize(state);
+	audio_serialize(state);
+}
+
+void machine_deserialize(struct state *state)
+{
+	struct machine *machine = &machine_ctx->machine;
+
+	/* Restore machine, CPU, controller, clock, and audio states */
+	if (machine->deserialize)
+		machine->deserialize(machine, state);
+	cpu_deserialize_all(state);
+	controller_deserialize_all(state);
+	clock_deserialize(state);
+	audio_deserialize(state);
+}
+
+size_t machine_measure_state()
+{
+	struct state state;
+
+	/* Measure state by serializing it without any buffer */
+	state.data = NULL;
+	state.size = 0;
+	state.pos = sizeof(struct state_header);
+	machine_serialize(&state);
+	return state.pos;
+}
+
+size_t machine_get_state_size()
+{
+	return machine_ctx->state_size;
+}
+
+bool machine_save_state(void *data, size_t size)
+{
+	struct machine *machine = &machine_ctx->machine;
+	struct state_header header;
+	struct state state;
+	size_t state_size = machine_ctx->state_size;
+
+	/* Make sure state fits in buffer */
+	if (size < state_size)
+		return false;
+
+	/* Fill state header */
+	memset(&header, 0, sizeof(struct state_header));
+	memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+	header.version = STATE_VERSION;
+	header.size = state_size;
+	strncpy(header.machine, machine->name, sizeof(header.machine) - 1);
+
+	/* Save header followed by all component states */
+	state.data = data;
+	state.size = state_size;
+	state.pos = 0;
+	STATE_SAVE(&state, header);
+	machine_serialize(&state);
+	return true;
+}
+
+bool machine_load_state(const void *data, size_t size)
+{
+	struct machine *machine = &machine_ctx->machine;
+	struct state_header header;
+	struct state state;
+	size_t state_size = machine_ctx->state_size;
+
+	/* Make sure buffer holds at least a header */
+	if (size < sizeof(struct state_header))
+		return false;
+
+	/* Read and validate state header */
+	state.data = (uint8_t *)data;
+	state.size = size;
+	state.pos = 0;
+	STATE_LOAD(&state, header);
+	if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) ||
+		(header.version != STATE_VERSION) ||
+		strncmp(header.machine, machine->name,
+			sizeof(header.machine) - 1) ||
+		(header.size != state_size) ||
+		(size < state_size)) {
+		LOG_E("Incompatible machine state!\n");
+		return false;
+	}
+
+	/* Restore all component states */
+	machine_deserialize(&state);
+	return true;
 }
 
 void machine_deinit()
 {
+	struct machine_context *ctx = machine_ctx;
+
+	/* Free run-ahead state, rewind buffer, and hash checking if needed */
+	free(ctx->run_ahead_state);
+	if (ctx->rewind) {
+		rewind_deinit(ctx->rewind);
+		free(ctx->rewind_state);
+	}
+	if (ctx->regress)
+		regress_deinit(ctx->regress);
+
 	machine_cleanup();
-	if (machine->deinit)
-		machine->deinit(machine);
+	if (ctx->machine.deinit)
+		ctx->machine.deinit(&ctx->machine);
+
+	/* Release context */
+	machine_set_context(NULL);
+	free(ctx);
 }
 
@@ -40,10 +40,9 @@ int main(int argc, char *argv[])
 	if (!machine_init())
 		goto err;
 
-	/* Run machine until user quits */
-	machine_run();
-
-	return 0;
+	/* Run machine until user quits (failing if frames diverge from golden
+	file) */
+	return machine_run() ? 0 : 1;
 err:
 	cmdline_print_usage(true);
 	return 1;
@@ -6,6 +6,19 @@
 #include <memory.h>
 #include <util.h>
 
+#define MOP_IS_READ(type) \
+	(type <= MOP_READL)
+
+enum mop_type {
+	MOP_READB,
+	MOP_READW,
+	MOP_READL,
+	MOP_WRITEB,
+	MOP_WRITEW,
+	MOP_WRITEL,
+	NUM_MOP_TYPES
+};
+
 static uint8_t rom_readb(uint8_t *rom, address_t address);
 static uint16_t rom_readw(uint8_t *rom, address_t address);
 static uint32_t rom_readl(uint8_t *rom, address_t address);
@@ -15,11 +28,138 @@ static uint32_t ram_readl(uint8_t *ram, address_t address);
 static void ram_writeb(uint8_t *ram, uint8_t b, address_t address);
 static void ram_writew(uint8_t *ram, uint16_t w, address_t address);
 static void ram_writel(uint8_t *ram, uint32_t l, address_t address);
+static bool mop_get(struct mops *mops, enum mop_type type, union mop *op);
+static struct page **bus_get_pages(struct bus *bus, enum mop_type type);
+static void bus_grow(int bus_id, address_t end);
+static void bus_update(int bus_id, address_t start, address_t end);
+static bool page_map(struct page *p, struct region *r, struct resource *piece,
+	address_t start, address_t end);
+static int page_resolve(struct page *p, int bus_id, enum mop_type type,
+	address_t start, address_t end);
+static void page_build(struct page *p, int bus_id, enum mop_type type,
+	address_t start);
+static void region_update(struct region *region);
 
-struct region **regions;
-int num_regions;
-struct dma_channel **dma_channels;
-int num_dma_channels;
+THREAD_LOCAL struct memory_context *memory_ctx;
+
+#define DEFINE_MEMORY_READ_SLOW(ext, type) \
+	type memory_read##ext##_slow(int bus_id, address_t address) \
+	{ \
+		struct memory_context *ctx = memory_ctx; \
+		struct region *r; \
+		struct resource *mirror; \
+		address_t size; \
+		address_t a; \
+		int i; \
+		int j; \
+	\
+		/* Parse regions */ \
+		for (i = 0; i < ctx->num_regions; i++) { \
+			r = ctx->regions[i]; \
+	\
+			/* Skip if region if operation is not supported */ \
+			if (!r->mops->read##ext) \
+				continue; \
+	\
+			/* Call operation if address is within area */ \
+			if ((bus_id == r->area->data.mem.bus_id) && \
+				(address >= r->area->data.mem.start) && \
+				(address <= r->area->data.mem.end)) { \
+				a = address - r->area->data.mem.start; \
+				return r->mops->read##ext(r->data, a); \
+			} \
+	\
+			/* Get region size */ \
+			size = MEM_SIZE(r->area); \
+	\
+			/* Call operation if address is within a mirror */ \
+			for (j = 0; j < r->area->num_children; j++) { \
+				mirror = &r->area->children[j]; \
+				if ((bus_id == mirror->data.mem.bus_id) && \
+					(address >= mirror->data.mem.start) && \
+					(address <= mirror->data.mem.end)) { \
+					a = address - mirror->data.mem.start; \
+					a %= size; \
+					return r->mops->read##ext(r->data, a); \
+				} \
+			} \
+		} \
+	\
+		/* Return 0 in case of read failure */ \
+		LOG_W("Region not found in %s(%u, 0x%08x)!\n", \
+			__func__, \
+			bus_id, \
+			address); \
+		return 0; \
+	}
+
+#define DEFINE_MEMORY_WRITE_SLOW(ext, type) \
+	void memory_write##ext##_slow(int bus_id, type data, address_t addr) \
+	{ \
+		struct memory_context *ctx = memory_ctx; \
+		struct region *r; \
+		struct resource *mirror; \
+		address_t size; \
+		address_t a; \
+		int num; \
+		int i; \
+		int j; \
+	\
+		/* Parse regions */ \
+		num = 0; \
+		for (i = 0; i < ctx->num_regions; i++) { \
+			r = ctx->regions[i]; \
+	\
+			/* Skip if region if operation is not supported */ \
+			if (!r->mops->write##ext) \
+				continue; \
+	\
+			/* Adapt address and call write operation if needed */ \
+			if ((bus_id == r->area->data.mem.bus_id) && \
+				(addr >= r->area->data.mem.start) && \
+				(addr <= r->area->data.mem.end)) { \
+				a = addr - r->area->data.mem.start; \
+				r->mops->write##ext(r->data, data, a); \
+				num++; \
+			} \
+	\
+			/* Get region size */ \
+			size = MEM_SIZE(r->area); \
+	\
+			/* Parse mirrors */ \
+			for (j = 0; j < r->area->num_children; j++) { \
+				mirror = &r->area->children[j]; \
+	\
+				/* Skip if address is not within mirror */ \
+				if ((bus_id != mirror->data.mem.bus_id) || \
+					!((addr >= mirror->data.mem.start) && \
+					(addr <= mirror->data.mem.end))) \
+					continue; \
+	\
+				/* Adapt address and call write operation */ \
+				a = (addr - mirror->data.mem.start) % size; \
+				r->mops->write##ext(r->data, data, a); \
+				num++; \
+			} \
+		} \
+	\
+		/* Warn on write failure */ \
+		if (num == 0) \
+			LOG_W("Region not found in %s(%u, 0x%08x, 0x%0*x)!\n", \
+				__func__, \
+				bus_id, \
+				addr, \
+				sizeof(type) * 2, \
+				data); \
+	}
+
+/* Define memory read/write functions used when pages cannot be used */
+DEFINE_MEMORY_READ_SLOW(b, uint8_t)
+DEFINE_MEMORY_READ_SLOW(w, uint16_t)
+DEFINE_MEMORY_READ_SLOW(l, uint32_t)
+DEFINE_MEMORY_WRITE_SLOW(b, uint8_t)
+DEFINE_MEMORY_WRITE_SLOW(w, uint16_t)
+DEFINE_MEMORY_WRITE_SLOW(l, uint32_t)
 
 struct mops rom_mops = {
 	.readb = (readb_t)rom_readb,
@@ -38,151 +178,419 @@ struct mops ram_mops = {
 
 uint8_t rom_readb(uint8_t *rom, address_t address)
 {
-	return rom[address];
+	return host_readb(rom + address);
 }
 
 uint16_t rom_readw(uint8_t *rom, address_t address)
 {
-	uint8_t *mem = rom + address;
-	return (*(mem + 1) << 8) | *mem;
+	return host_readw(rom + address);
 }
 
-uint32_t rom_readl(uint8_t *ram, address_t address)
+uint32_t rom_readl(uint8_t *rom, address_t address)
 {
-	uint8_t *mem = ram + address;
-	return (*(mem + 3) << 24) |
-		(*(mem + 2) << 16) |
-		(*(mem + 1) << 8) |
-		*mem;
+	return host_readl(rom + address);
 }
 
 uint8_t ram_readb(uint8_t *ram, address_t address)
 {
-	return ram[address];
+	return host_readb(ram + address);
 }
 
 uint16_t ram_readw(uint8_t *ram, address_t address)
 {
-	uint8_t *mem = ram + address;
-	return (*(mem + 1) << 8) | *mem;
+	return host_readw(ram + address);
 }
 
 uint32_t ram_readl(uint8_t *ram, address_t address)
 {
-	uint8_t *mem = ram + address;
-	return (*(mem + 3) << 24) |
-		(*(mem + 2) << 16) |
-		(*(mem + 1) << 8) |
-		*mem;
+	return host_readl(ram + address);
 }
 
 void ram_writeb(uint8_t *ram, uint8_t b, address_t address)
 {
-	ram[address] = b;
+	host_writeb(ram + address, b);
 }
 
 void ram_writew(uint8_t *ram, uint16_t w, address_t address)
 {
-	uint8_t *mem = ram + address;
-	*mem++ = w;
-	*mem = w >> 8;
+	host_writew(ram + address, w);
 }
 
 void ram_writel(uint8_t *ram, uint32_t l, address_t address)
 {
-	uint8_t *mem = ram + address;
-	*mem++ = l;
-	*mem++ = l >> 8;
-	*mem++ = l >> 16;
-	*mem = l >> 24;
+	host_writel(ram + address, l);
+}
+
+bool mop_get(struct mops *mops, enum mop_type type, union mop *op)
+{
+	/* Get region operation matching type */
+	switch (type) {
+	case MOP_READB:
+		op->readb = mops->readb;
+		break;
+	case MOP_READW:
+		op->readw = mops->readw;
+		break;
+	case MOP_READL:
+		op->readl = mops->readl;
+		break;
+	case MOP_WRITEB:
+		op->writeb = mops->writeb;
+		break;
+	case MOP_WRITEW:
+		op->writew = mops->writew;
+		break;
+	case MOP_WRITEL:
+	default:
+		op->writel = mops->writel;
+		break;
+	}
+
+	/* Return whether operation is supported */
+	return (op->readb != NULL);
+}
+
+struct page **bus_get_pages(struct bus *bus, enum mop_type type)
+{
+	switch (type) {
+	case MOP_READB:
+		return &bus->readb;
+	case MOP_READW:
+		return &bus->readw;
+	case MOP_READL:
+		return &bus->readl;
+	case MOP_WRITEB:
+		return &bus->writeb;
+	case MOP_WRITEW:
+		return &bus->writew;
+	case MOP_WRITEL:
+	default:
+		return &bus->writel;
+	}
+}
+
+void bus_grow(int bus_id, address_t end)
+{
+	struct memory_context *ctx = memory_ctx;
+	struct bus *bus;
+	struct page **pages;
+	unsigned int num_pages;
+	enum mop_type type;
+
+	/* Grow buses array if needed */
+	if (bus_id >= ctx->num_buses) {
+		ctx->buses = realloc(ctx->buses,
+			(bus_id + 1) * sizeof(struct bus));
+		memset(&ctx->buses[ctx->num_buses],
+			0,
+			(bus_id + 1 - ctx->num_buses) * sizeof(struct bus));
+		ctx->num_buses = bus_id + 1;
+	}
+
+	/* Return if bus already holds enough pages */
+	bus = &ctx->buses[bus_id];
+	num_pages = (end >> MEM_PAGE_BITS) + 1;
+	if (num_pages <= bus->num_pages)
+		return;
+
+	/* Grow page tables (new pages are unmapped) */
+	for (type = 0; type < NUM_MOP_TYPES; type++) {
+		pages = bus_get_pages(bus, type);
+		*pages = realloc(*pages, num_pages * sizeof(struct page));
+		memset(&(*pages)[bus->num_pages],
+			0,
+			(num_pages - bus->num_pages) * sizeof(struct page));
+	}
+	bus->num_pages = num_pages;
+}
+
+bool page_map(struct page *p, struct region *r, struct resource *piece,
+	address_t start, address_t end)
+{
+	address_t size;
+	address_t a;
+
+	/* Areas map addresses linearly */
+	if (piece == r->area) {
+		p->base = piece->data.mem.start;
+		p->mask = ~0;
+		return true;
+	}
+
+	/* Mirrors of power-of-two sized areas can be resolved with a mask */
+	size = MEM_SIZE(r->area);
+	if ((size & (size - 1)) == 0) {
+		p->base = piece->data.mem.start;
+		p->mask = size - 1;
+		return true;
+	}
+
+	/* Other mirrors can only be mapped if they do not wrap within range */
+	a = (start - piece->data.mem.start) % size;
+	if (a + (end - start) >= size)
+		return false;
+	p->base = start - a;
+	p->mask = ~0;
+	return true;
+}
+
+int page_resolve(struct page *p, int bus_id, enum mop_type type,
+	address_t start, address_t end)
+{
+	struct memory_context *ctx = memory_ctx;
+	struct region *r;
+	struct resource *piece;
+	union mop op;
+	int num = 0;
+	int i;
+	int j;
+
+	/* Reset page */
+	memset(p, 0, sizeof(struct page));
+
+	/* Parse regions supporting operation (in order of precedence) */
+	for (i = 0; i < ctx->num_regions; i++) {
+		r = ctx->regions[i];
+		if (!mop_get(r->mops, type, &op))
+			continue;
+
+		/* Parse region area and its mirrors */
+		for (j = -1; j < r->area->num_children; j++) {
+			piece = (j < 0) ? r->area : &r->area->children[j];
+
+			/* Skip piece if it does not overlap range */
+			if ((bus_id != piece->data.mem.bus_id) ||
+				(piece->data.mem.end < start) ||
+				(piece->data.mem.start > end))
+				continue;
+
+			/* Map page if first piece covers the whole range */
+			if ((num++ == 0) &&
+				(piece->data.mem.start <= start) &&
+				(piece->data.mem.end >= end) &&
+				page_map(p, r, piece, start, end)) {
+				p->op = op;
+				p->data = r->data;
+
+				/* Access RAM/ROM host memory directly */
+				if ((r->mops == &ram_mops) ||
+					(r->mops == &rom_mops))
+					p->mem = r->data;
+			}
+
+			/* Only the first piece found is used for reads */
+			if (MOP_IS_READ(type))
+				return num;
+		}
+	}
+
+	/* Return number of pieces found */
+	return num;
+}
+
+void page_build(struct page *p, int bus_id, enum mop_type type,
+	address_t start)
+{
+	address_t end = start + MEM_PAGE_MASK;
+	struct page *sub;
+	int num;
+	int i;
+
+	/* Free address entries if needed */
+	free(p->sub);
+
+	/* Leave page unmapped if no region can handle it */
+	num = page_resolve(p, bus_id, type, start, end);
+	if (num == 0)
+		return;
+
+	/* Keep page as is if a single operation handles it */
+	if (p->op.readb && ((num == 1) || MOP_IS_READ(type)))
+		return;
+
+	/* Resolve page address by address (shared writes are left unmapped
+	so that all regions get called from the slow path) */
+	memset(p, 0, sizeof(struct page));
+	sub = calloc(MEM_PAGE_SIZE, sizeof(struct page));
+	for (i = 0; i < MEM_PAGE_SIZE; i++) {
+		num = page_resolve(&sub[i], bus_id, type, start + i, start + i);
+		if (num > 1)
+			memset(&sub[i], 0, sizeof(struct page));
+	}
+	p->sub = sub;
+}
+
+void bus_update(int bus_id, address_t start, address_t end)
+{
+	struct memory_context *ctx = memory_ctx;
+	struct page *pages;
+	enum mop_type type;
+	unsigned int first;
+	unsigned int last;
+	unsigned int i;
+
+	/* Make sure bus can hold range */
+	bus_grow(bus_id, end);
+
+	/* Rebuild all pages overlapping range */
+	first = start >> MEM_PAGE_BITS;
+	last = end >> MEM_PAGE_BITS;
+	for (type = 0; type < NUM_MOP_TYPES; type++) {
+		pages = *bus_get_pages(&ctx->buses[bus_id], type);
+		for (i = first; i <= last; i++)
+			page_build(&pages[i], bus_id, type, i << MEM_PAGE_BITS);
+	}
+}
+
+void region_update(struct region *region)
+{
+	struct resource *piece;
+	int i;
+
+	/* Update pages covered by region area and its mirrors */
+	for (i = -1; i < region->area->num_children; i++) {
+		piece = (i < 0) ? region->area : &region->area->children[i];
+		bus_update(piece->data.mem.bus_id,
+			piece->data.mem.start,
+			piece->data.mem.end);
+	}
 }
 
 void memory_region_add(struct region *region)
 {
+	struct memory_context *ctx = memory_ctx;
 	/* Grow memory regions array */
-	regions = realloc(regions, ++num_regions * sizeof(struct region *));
+	ctx->regions = realloc(ctx->regions,
+		++ctx->num_regions * sizeof(struct region *));
 
 	/* Shift regions */
-	memmove(&regions[1],
-		regions,
-		(num_regions - 1) * sizeof(struct region *));
+	memmove(&ctx->regions[1],
+		ctx->regions,
+		(ctx->num_regions - 1) * sizeof(struct region *));
 
 	/* Insert region before others (it will take precedence on read ops) */
-	regions[0] = region;
+	ctx->regions[0] = region;
+
+	/* Update page tables */
+	region_update(region);
 }
 
 void memory_region_remove(struct region *region)
 {
+	struct memory_context *ctx = memory_ctx;
 	int i;
 
-	/* Remove last region if needed */
-	if ((num_regions > 0) && (region == regions[num_regions - 1])) {
-		regions = realloc(regions,
-			--num_regions * sizeof(struct region *));
-		return;
-	}
-
 	/* Find and remove region */
-	for (i = 0; i < num_regions - 1; i++)
-		if (regions[i] == region) {
-			memmove(&regions[i],
-				&regions[i + 1],
-				(num_regions - i) * sizeof(struct region *));
-			regions = realloc(regions,
-				--num_regions * sizeof(struct region *));
+	for (i = 0; i < ctx->num_regions; i++)
+		if (ctx->regions[i] == region) {
+			memmove(&ctx->regions[i],
+				&ctx->regions[i + 1],
+				(ctx->num_regions - i - 1) *
+					sizeof(struct region *));
+			ctx->regions = realloc(ctx->regions,
+				--ctx->num_regions * sizeof(struct region *));
+
+			/* Update page tables */
+			region_update(region);
+			return;
 		}
 }
 
 void memory_region_remove_all()
 {
+	struct memory_context *ctx = memory_ctx;
+	struct page *pages;
+	enum mop_type type;
+	unsigned int i;
+	int bus_id;
+
+	/* Free all page tables */
+	for (bus_id = 0; bus_id < ctx->num_buses; bus_id++)
+		for (type = 0; type < NUM_MOP_TYPES; type++) {
+			pages = *bus_get_pages(&ctx->buses[bus_id], type);
+			for (i = 0; i < ctx->buses[bus_id].num_pages; i++)
+				free(pages[i].sub);
+			free(pages);
+		}
+	free(ctx->buses);
+	ctx->buses = NULL;
+	ctx->num_buses = 0;
+
 	/* Free all regions */
-	free(regions);
-	regions = NULL;
+	free(ctx->regions);
+	ctx->regions = NULL;
+	ctx->num_regions = 0;
+}
+
+uint8_t *memory_get_host(int bus_id, address_t address)
+{
+	struct memory_context *ctx = memory_ctx;
+	struct page *p;
+
+	/* Only addresses within page table can be resolved */
+	if ((bus_id >= ctx->num_buses) ||
+		((address >> MEM_PAGE_BITS) >= ctx->buses[bus_id].num_pages))
+		return NULL;
+
+	/* Get page (or address entry if page is not uniform) */
+	p = &ctx->buses[bus_id].readb[address >> MEM_PAGE_BITS];
+	if (p->sub)
+		p = &p->sub[address & MEM_PAGE_MASK];
+
+	/* Return host memory if address is backed by RAM/ROM (the pointer
+	stays valid as long as the region is, up to the region end) */
+	if (!p->mem)
+		return NULL;
+	return p->mem + ((address - p->base) & p->mask);
 }
 
 void dma_channel_add(struct dma_channel *channel)
 {
+	struct memory_context *ctx = memory_ctx;
 	/* Grow DMA channels array */
-	dma_channels = realloc(dma_channels,
-		++num_dma_channels * sizeof(struct dma_channel *));
+	ctx->dma_channels = realloc(ctx->dma_channels,
+		++ctx->num_dma_channels * sizeof(struct dma_channel *));
 
 	/* Shift channels */
-	memmove(&dma_channels[1],
-		dma_channels,
-		(num_dma_channels - 1) * sizeof(struct dma_channel *));
+	memmove(&ctx->dma_channels[1],
+		ctx->dma_channels,
+		(ctx->num_dma_channels - 1) * sizeof(struct dma_channel *));
 
 	/* Insert channel before others (it will take precedence on read ops) */
-	dma_channels[0] = channel;
+	ctx->dma_channels[0] = channel;
 }
 
 void dma_channel_remove(struct dma_channel *channel)
 {
+	struct memory_context *ctx = memory_ctx;
 	int i;
 
 	/* Remove last channel if needed */
-	if ((num_dma_channels > 0) && (dma_channels[num_dma_channels - 1])) {
-		dma_channels = realloc(dma_channels,
-			--num_dma_channels * sizeof(struct dma_channel *));
+	if ((ctx->num_dma_channels > 0) &&
+		(ctx->dma_channels[ctx->num_dma_channels - 1])) {
+		ctx->dma_channels = realloc(ctx->dma_channels,
+			--ctx->num_dma_channels * sizeof(struct dma_channel *));
 		return;
 	}
 
 	/* Find and remove channel */
-	for (i = 0; i < num_dma_channels - 1; i++)
-		if (dma_channels[i] == channel) {
-			memmove(&dma_channels[i],
-				dma_channels[i + 1],
-				(num_dma_channels - i) *
+	for (i = 0; i < ctx->num_dma_channels - 1; i++)
+		if (ctx->dma_channels[i] == channel) {
+			memmove(&ctx->dma_channels[i],
+				ctx->dma_channels[i + 1],
+				(ctx->num_dma_channels - i) *
 					sizeof(struct dma_channel *));
-			dma_channels = realloc(dma_channels,
-				--num_dma_channels *
+			ctx->dma_channels = realloc(ctx->dma_channels,
+				--ctx->num_dma_channels *
 					sizeof(struct dma_channel *));
 		}
 }
 
 void dma_channel_remove_all()
 {
+	struct memory_context *ctx = memory_ctx;
 	/* Free all channels */
-	free(dma_channels);
-	dma_channels = NULL;
+	free(ctx->dma_channels);
+	ctx->dma_channels = NULL;
 }
 
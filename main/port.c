@@ -11,9 +11,7 @@ static void insert_region(struct port_region *r, struct resource *a);
 static void remove_region(struct port_region *r, struct resource *a);
 static bool fixup_port(struct port_region *region, port_t *port);
 
-static struct list_link *port_regions;
-static struct list_link **read_map;
-static struct list_link **write_map;
+THREAD_LOCAL struct port_context *port_ctx;
 
 void insert_region(struct port_region *r, struct resource *a)
 {
@@ -24,9 +22,9 @@ void insert_region(struct port_region *r, struct resource *a)
 	/* Insert region into maps */
 	for (i = start; i <= end; i++) {
 		if (r->pops->read)
-			list_insert_before(&read_map[i], r);
+			list_insert_before(&port_ctx->read_map[i], r);
 		if (r->pops->write)
-			list_insert_before(&write_map[i], r);
+			list_insert_before(&port_ctx->write_map[i], r);
 	}
 }
 
@@ -38,8 +36,8 @@ void remove_region(struct port_region *r, struct resource *a)
 
 	/* Remove region from maps */
 	for (i = start; i <= end; i++) {
-		list_remove(&read_map[i], r);
-		list_remove(&write_map[i], r);
+		list_remove(&port_ctx->read_map[i], r);
+		list_remove(&port_ctx->write_map[i], r);
 	}
 }
 
@@ -48,13 +46,15 @@ bool port_region_add(struct port_region *region)
 	int i;
 
 	/* Initialize maps if needed */
-	if (!port_regions) {
-		read_map = calloc(NUM_PORTS, sizeof(struct list_link *));
-		write_map = calloc(NUM_PORTS, sizeof(struct list_link *));
+	if (!port_ctx->regions) {
+		port_ctx->read_map = calloc(NUM_PORTS,
+			sizeof(struct list_link *));
+		port_ctx->write_map = calloc(NUM_PORTS,
+			sizeof(struct list_link *));
 	}
 
 	/* Insert region */
-	list_insert(&port_regions, region);
+	list_insert(&port_ctx->regions, region);
 
 	/* Fill maps for region area and its mirrors */
 	insert_region(region, region->area);
@@ -74,12 +74,12 @@ void port_region_remove(struct port_region *region)
 		remove_region(region, &region->area->children[i]);
 
 	/* Remove region from list */
-	list_remove(&port_regions, region);
+	list_remove(&port_ctx->regions, region);
 }
 
 void port_region_remove_all()
 {
-	struct list_link *link = port_regions;
+	struct list_link *link = port_ctx->regions;
 	struct port_region *region;
 	int i;
 
@@ -91,13 +91,13 @@ void port_region_remove_all()
 	}
 
 	/* Remove all regions */
-	list_remove_all(&port_regions);
+	list_remove_all(&port_ctx->regions);
 
 	/* Free maps */
-	free(read_map);
-	free(write_map);
-	read_map = NULL;
-	write_map = NULL;
+	free(port_ctx->read_map);
+	free(port_ctx->write_map);
+	port_ctx->read_map = NULL;
+	port_ctx->write_map = NULL;
 }
 
 bool fixup_port(struct port_region *region, port_t *port)
@@ -131,7 +131,7 @@ bool fixup_port(struct port_region *region, port_t *port)
 
 uint8_t port_read(port_t port)
 {
-	struct list_link *link = read_map[port];
+	struct list_link *link = port_ctx->read_map[port];
 	struct port_region *region;
 
 	/* Get region */
@@ -153,7 +153,7 @@ uint8_t port_read(port_t port)
 
 void port_write(uint8_t b, port_t port)
 {
-	struct list_link *link = write_map[port];
+	struct list_link *link = port_ctx->write_map[port];
 	struct port_region *region;
 
 	/* Get region */
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <log.h>
+#include <regress.h>
+
+#define MAX_LINE_LENGTH	128
+
+static bool read_golden(struct regress *regress, unsigned int *frame,
+	uint64_t *video_hash, uint64_t *audio_hash);
+
+/* Frame hashes are logged and read as text lines holding the frame number
+along with video and audio hashes, so that golden files can be produced by a
+logging run and compared with plain text tools (audio hashes covering what
+chips produce rather than resampled output, golden files hold across hosts,
+frontends and sampling rates for given emulation options) */
+struct regress {
+	FILE *log;
+	FILE *golden;
+	unsigned int frame;
+};
+
+struct regress *regress_init(char *log_path, char *golden_path)
+{
+	struct regress *regress;
+
+	regress = calloc(1, sizeof(struct regress));
+
+	/* Open hash log if requested */
+	if (log_path) {
+		regress->log = fopen(log_path, "w");
+		if (!regress->log) {
+			LOG_E("Could not open hash log \"%s\"!\n", log_path);
+			regress_deinit(regress);
+			return NULL;
+		}
+	}
+
+	/* Open golden file if requested */
+	if (golden_path) {
+		regress->golden = fopen(golden_path, "r");
+		if (!regress->golden) {
+			LOG_E("Could not open golden file \"%s\"!\n",
+				golden_path);
+			regress_deinit(regress);
+			return NULL;
+		}
+	}
+
+	return regress;
+}
+
+bool read_golden(struct regress *regress, unsigned int *frame,
+	uint64_t *video_hash, uint64_t *audio_hash)
+{
+	char line[MAX_LINE_LENGTH];
+	unsigned long long v;
+	unsigned long long a;
+
+	/* Read next line, skipping malformed ones */
+	while (fgets(line, MAX_LINE_LENGTH, regress->golden)) {
+		if (sscanf(line, "%u %llx %llx", frame, &v, &a) != 3)
+			continue;
+		*video_hash = v;
+		*audio_hash = a;
+		return true;
+	}
+
+	return false;
+}
+
+enum regress_status regress_frame(struct regress *regress, uint64_t video_hash,
+	uint64_t audio_hash)
+{
+	unsigned int golden_frame;
+	uint64_t golden_video_hash;
+	uint64_t golden_audio_hash;
+
+	/* Log frame hashes if needed */
+	regress->frame++;
+	if (regress->log)
+		fprintf(regress->log, "%u %016llx %016llx\n",
+			regress->frame,
+			(unsigned long long)video_hash,
+			(unsigned long long)audio_hash);
+
+	/* Leave already if there is nothing to compare with */
+	if (!regress->golden)
+		return REGRESS_CONTINUE;
+
+	/* Stop once golden file is exhausted */
+	if (!read_golden(regress, &golden_frame, &golden_video_hash,
+		&golden_audio_hash)) {
+		LOG_I("Frames 1 to %u match golden file.\n",
+			regress->frame - 1);
+		return REGRESS_DONE;
+	}
+
+	/* Report first divergence */
+	if (golden_frame != regress->frame) {
+		LOG_E("Golden file is out of sequence at frame %u!\n",
+			regress->frame);
+		return REGRESS_DIVERGED;
+	}
+	if (video_hash != golden_video_hash) {
+		LOG_E("Frame %u video diverges from golden file!\n",
+			regress->frame);
+		LOG_E("Hash is %016llx instead of %016llx.\n",
+			(unsigned long long)video_hash,
+			(unsigned long long)golden_video_hash);
+		return REGRESS_DIVERGED;
+	}
+	if (audio_hash != golden_audio_hash) {
+		LOG_E("Frame %u audio diverges from golden file!\n",
+			regress->frame);
+		LOG_E("Hash is %016llx instead of %016llx.\n",
+			(unsigned long long)audio_hash,
+			(unsigned long long)golden_audio_hash);
+		return REGRESS_DIVERGED;
+	}
+
+	return REGRESS_CONTINUE;
+}
+
+void regress_deinit(struct regress *regress)
+{
+	if (regress->log)
+		fclose(regress->log);
+	if (regress->golden)
+		fclose(regress->golden);
+	free(regress);
+}
+
@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include <log.h>
+#include <rewind.h>
+
+#define MIN_MATCH_RUN	4
+#define RECORD_SIZE(len) ((len) + 2 * sizeof(uint32_t))
+
+static uint8_t *put_varint(uint8_t *p, size_t v);
+static const uint8_t *get_varint(const uint8_t *p, size_t *v);
+static size_t encode(const uint8_t *a, const uint8_t *b, size_t size,
+	uint8_t *out);
+static void decode(const uint8_t *in, uint8_t *state, size_t size);
+static void clear(struct rewind *rewind);
+static void evict(struct rewind *rewind);
+
+/* Snapshots are stored as XOR deltas between consecutive states, encoded as
+a list of (matching byte count, differing byte count, differing bytes) groups.
+Each delta reverts the newest state to the one preceding it, so only the newest
+state is kept in full and the oldest deltas can be dropped freely. Records are
+laid out in a circular buffer with their length both before and after them,
+allowing to walk the buffer from either end. */
+struct rewind {
+	uint8_t *buffer;
+	size_t buffer_size;
+	size_t head;
+	size_t tail;
+	size_t end;
+	bool wrapped;
+	unsigned int num_records;
+	uint8_t *current;
+	bool current_valid;
+	uint8_t *scratch;
+	size_t state_size;
+};
+
+uint8_t *put_varint(uint8_t *p, size_t v)
+{
+	/* Write 7 bits at a time, flagging continuation with bit 7 */
+	while (v >= 0x80) {
+		*p++ = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+	return p;
+}
+
+const uint8_t *get_varint(const uint8_t *p, size_t *v)
+{
+	int shift = 0;
+
+	/* Read 7 bits at a time until continuation flag is clear */
+	*v = 0;
+	do {
+		*v |= (size_t)(*p & 0x7F) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	return p;
+}
+
+size_t encode(const uint8_t *a, const uint8_t *b, size_t size, uint8_t *out)
+{
+	uint8_t *p = out;
+	uint64_t x;
+	uint64_t y;
+	size_t pos = 0;
+	size_t start;
+	size_t num_matching;
+	size_t i;
+
+	while (pos < size) {
+		/* Skip matching bytes (comparing whole words first) */
+		start = pos;
+		while (pos + sizeof(uint64_t) <= size) {
+			memcpy(&x, &a[pos], sizeof(uint64_t));
+			memcpy(&y, &b[pos], sizeof(uint64_t));
+			if (x != y)
+				break;
+			pos += sizeof(uint64_t);
+		}
+		while ((pos < size) && (a[pos] == b[pos]))
+			pos++;
+		num_matching = pos - start;
+
+		/* Gather differing bytes until a long enough match is found */
+		start = pos;
+		while (pos < size) {
+			if (a[pos] != b[pos]) {
+				pos++;
+				continue;
+			}
+			for (i = pos; (i < size) && (a[i] == b[i]); i++)
+				if (i - pos + 1 == MIN_MATCH_RUN)
+					break;
+			if ((i == size) || (a[i] == b[i]))
+				break;
+			pos = i;
+		}
+
+		/* Write group */
+		p = put_varint(p, num_matching);
+		p = put_varint(p, pos - start);
+		for (i = start; i < pos; i++)
+			*p++ = a[i] ^ b[i];
+	}
+
+	return p - out;
+}
+
+void decode(const uint8_t *in, uint8_t *state, size_t size)
+{
+	size_t pos = 0;
+	size_t n;
+
+	/* Apply all groups to state */
+	while (pos < size) {
+		in = get_varint(in, &n);
+		pos += n;
+		in = get_varint(in, &n);
+		while (n-- > 0)
+			state[pos++] ^= *in++;
+	}
+}
+
+void clear(struct rewind *rewind)
+{
+	/* Drop all records */
+	rewind->head = 0;
+	rewind->tail = 0;
+	rewind->end = 0;
+	rewind->wrapped = false;
+	rewind->num_records = 0;
+}
+
+void evict(struct rewind *rewind)
+{
+	uint32_t len;
+
+	/* Drop oldest record */
+	memcpy(&len, &rewind->buffer[rewind->tail], sizeof(uint32_t));
+	rewind->tail += RECORD_SIZE(len);
+	if (--rewind->num_records == 0) {
+		clear(rewind);
+		return;
+	}
+
+	/* Continue from buffer start once end of valid data is reached */
+	if (rewind->wrapped && (rewind->tail == rewind->end)) {
+		rewind->tail = 0;
+		rewind->wrapped = false;
+	}
+}
+
+struct rewind *rewind_init(size_t state_size, size_t buffer_size)
+{
+	struct rewind *rewind;
+
+	/* Allocate buffers (deltas take at most twice the state size) */
+	rewind = calloc(1, sizeof(struct rewind));
+	rewind->state_size = state_size;
+	rewind->buffer_size = buffer_size;
+	rewind->buffer = malloc(buffer_size);
+	rewind->current = malloc(state_size);
+	rewind->scratch = malloc(2 * state_size + 2 * sizeof(size_t));
+	if (!rewind->buffer || !rewind->current || !rewind->scratch) {
+		LOG_E("Could not allocate rewind buffer!\n");
+		rewind_deinit(rewind);
+		return NULL;
+	}
+
+	/* Start with empty history */
+	rewind->current_valid = false;
+	clear(rewind);
+
+	LOG_I("Rewind buffer: %u KB\n", (unsigned int)(buffer_size / 1024));
+	return rewind;
+}
+
+void rewind_push(struct rewind *rewind, const uint8_t *state)
+{
+	uint8_t *p;
+	uint32_t len;
+	size_t size;
+
+	/* Keep first state as is */
+	if (!rewind->current_valid) {
+		memcpy(rewind->current, state, rewind->state_size);
+		rewind->current_valid = true;
+		return;
+	}
+
+	/* Encode delta reverting new state to current one */
+	len = encode(rewind->current,
+		state,
+		rewind->state_size,
+		rewind->scratch);
+	size = RECORD_SIZE(len);
+	memcpy(rewind->current, state, rewind->state_size);
+
+	/* Restart history if record can never fit */
+	if (size > rewind->buffer_size) {
+		clear(rewind);
+		return;
+	}
+
+	/* Make room for record, wrapping around and evicting oldest ones */
+	for (;;) {
+		if (!rewind->wrapped) {
+			if (rewind->head + size <= rewind->buffer_size)
+				break;
+			rewind->end = rewind->head;
+			rewind->head = 0;
+			rewind->wrapped = true;
+		}
+		if (rewind->head + size <= rewind->tail)
+			break;
+		evict(rewind);
+	}
+
+	/* Write record surrounded by its length */
+	p = &rewind->buffer[rewind->head];
+	memcpy(p, &len, sizeof(uint32_t));
+	memcpy(p + sizeof(uint32_t), rewind->scratch, len);
+	memcpy(p + sizeof(uint32_t) + len, &len, sizeof(uint32_t));
+	rewind->head += size;
+	rewind->num_records++;
+}
+
+bool rewind_pop(struct rewind *rewind, uint8_t *state)
+{
+	uint8_t *p;
+	uint32_t len;
+
+	/* Leave already if no state was ever pushed */
+	if (!rewind->current_valid)
+		return false;
+
+	/* Revert newest record (staying on oldest state once exhausted) */
+	if (rewind->num_records > 0) {
+		/* Continue from end of valid data if buffer start is reached */
+		if (rewind->wrapped && (rewind->head == 0)) {
+			rewind->head = rewind->end;
+			rewind->wrapped = false;
+		}
+
+		/* Get record length from its trailer and apply delta */
+		p = &rewind->buffer[rewind->head];
+		memcpy(&len, p - sizeof(uint32_t), sizeof(uint32_t));
+		rewind->head -= RECORD_SIZE(len);
+		decode(&rewind->buffer[rewind->head + sizeof(uint32_t)],
+			rewind->current,
+			rewind->state_size);
+		if (--rewind->num_records == 0)
+			clear(rewind);
+	}
+
+	/* Copy restored state */
+	memcpy(state, rewind->current, rewind->state_size);
+	return true;
+}
+
+void rewind_deinit(struct rewind *rewind)
+{
+	free(rewind->buffer);
+	free(rewind->current);
+	free(rewind->scratch);
+	free(rewind);
+}
+
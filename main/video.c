@@ -1,6 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <audio.h>
+#include <clock.h>
 #include <cmdline.h>
+#include <hash.h>
 #include <input.h>
 #include <list.h>
 #include <log.h>
@@ -13,25 +17,69 @@ static int scale = 1;
 PARAM(scale, int, "scale", NULL, "Applies a screen scale ratio")
 
 struct list_link *video_frontends;
-static struct video_frontend *frontend;
-static int width;
-static int height;
-static bool updated;
+THREAD_LOCAL struct video_context *video_ctx;
+
+static void video_alloc(struct video_context *ctx, int w, int h);
+static void video_free(struct video_context *ctx);
+static void video_convert(struct video_context *ctx);
+
+void video_alloc(struct video_context *ctx, int w, int h)
+{
+	/* Allocate indexed and native frame buffers along with line palette
+	offsets (all lines use first palette entries by default) */
+	ctx->width = w;
+	ctx->height = h;
+	ctx->indices = calloc(w * h, sizeof(uint8_t));
+	ctx->pixels = calloc(w * h, sizeof(uint32_t));
+	ctx->line_palettes = calloc(h, sizeof(uint16_t));
+}
+
+void video_free(struct video_context *ctx)
+{
+	free(ctx->indices);
+	free(ctx->pixels);
+	free(ctx->line_palettes);
+	ctx->indices = NULL;
+	ctx->pixels = NULL;
+	ctx->line_palettes = NULL;
+}
+
+void video_convert(struct video_context *ctx)
+{
+	uint8_t *src = ctx->indices;
+	uint32_t *dst = ctx->pixels;
+	uint32_t *lut;
+	int x;
+	int y;
+
+	/* Map indices through palette LUT (inner loop is kept branch-free so
+	the compiler can unroll and vectorize it) */
+	for (y = 0; y < ctx->height; y++) {
+		lut = &ctx->palette[ctx->line_palettes[y]];
+		for (x = 0; x < ctx->width; x++)
+			dst[x] = lut[src[x]];
+		src += ctx->width;
+		dst += ctx->width;
+	}
+}
 
 bool video_init(struct video_specs *vs)
 {
+	struct video_context *ctx = video_ctx;
 	struct list_link *link = video_frontends;
 	struct video_frontend *fe;
 	window_t *window = NULL;
 
-	if (frontend) {
+	if (ctx->frontend) {
 		LOG_E("Video frontend already initialized!\n");
 		return false;
 	}
 
-	/* Save dimensions */
-	width = vs->width;
-	height = vs->height;
+	/* Save dimensions and allocate frame buffers and palette LUT (even
+	with no frontend as cores always render into them) */
+	video_alloc(ctx, vs->width, vs->height);
+	ctx->palette = calloc(vs->num_colors, sizeof(uint32_t));
+	ctx->num_colors = vs->num_colors;
 
 	/* Validate video option */
 	if (!video_fe_name) {
@@ -42,11 +90,11 @@ bool video_init(struct video_specs *vs)
 	/* Validate scaling factor */
 	if (scale <= 0) {
 		LOG_E("Scaling factor should be positive!\n");
-		return false;
+		goto err;
 	}
 
 	/* Reset updated state */
-	updated = false;
+	ctx->updated = false;
 
 	/* Find video frontend */
 	while ((fe = list_get_next(&link))) {
@@ -54,36 +102,53 @@ bool video_init(struct video_specs *vs)
 		if (strcmp(video_fe_name, fe->name))
 			continue;
 
+		/* Work on a copy so that machines can share frontends */
+		ctx->frontend = malloc(sizeof(struct video_frontend));
+		*ctx->frontend = *fe;
+
 		/* Initialize frontend */
 		if (fe->init) {
 			vs->scale = scale;
-			window = fe->init(fe, vs);
-			if (!window)
-				return false;
+			window = fe->init(ctx->frontend, vs);
+			if (!window) {
+				free(ctx->frontend);
+				ctx->frontend = NULL;
+				goto err;
+			}
 		}
 
-		/* Save frontend */
-		frontend = fe;
-
 		/* Initialize input frontend */
 		return input_init(fe->input, window);
 	}
 
 	/* Warn as video frontend was not found */
 	LOG_E("Video frontend \"%s\" not recognized!\n", video_fe_name);
+err:
+	video_free(ctx);
+	free(ctx->palette);
+	ctx->palette = NULL;
 	return false;
 }
 
 void video_update()
 {
-	/* Set updated state */
-	updated = true;
+	struct video_context *ctx = video_ctx;
 
-	if (!frontend)
+	/* Set updated state and let batch runs return at frame boundary */
+	ctx->updated = true;
+	clock_stop();
+
+	/* Hand audio samples of frame to audio frontend */
+	audio_flush();
+
+	/* Leave frame unpresented if output is skipped */
+	if (!ctx->frontend || ctx->skip)
 		return;
 
-	if (frontend->update)
-		frontend->update(frontend);
+	/* Convert frame and present it */
+	video_convert(ctx);
+	if (ctx->frontend->update)
+		ctx->frontend->update(ctx->frontend, ctx->pixels);
 
 	/* Update input sub-system as well */
 	input_update();
@@ -91,43 +156,34 @@ void video_update()
 
 bool video_updated()
 {
+	struct video_context *ctx = video_ctx;
 	bool ret;
 
 	/* Get current state */
-	ret = updated;
+	ret = ctx->updated;
 
 	/* Reset state if needed */
-	if (updated)
-		updated = false;
+	if (ctx->updated)
+		ctx->updated = false;
 
 	/* Return old state */
 	return ret;
 }
 
-void video_lock()
-{
-	if (frontend && frontend->lock)
-		frontend->lock(frontend);
-}
-
-void video_unlock()
-{
-	if (frontend && frontend->unlock)
-		frontend->unlock(frontend);
-}
-
 void video_get_size(int *w, int *h)
 {
-	*w = width;
-	*h = height;
+	*w = video_ctx->width;
+	*h = video_ctx->height;
 }
 
 void video_set_size(int w, int h)
 {
+	struct video_frontend *frontend = video_ctx->frontend;
 	window_t *window;
 
-	width = w;
-	height = h;
+	/* Re-allocate frame buffers */
+	video_free(video_ctx);
+	video_alloc(video_ctx, w, h);
 
 	if (frontend && frontend->set_size) {
 		window = frontend->set_size(frontend, w, h);
@@ -135,28 +191,54 @@ void video_set_size(int w, int h)
 	}
 }
 
-struct color video_get_pixel(int x, int y)
+void video_set_color(int index, struct color color)
 {
-	struct color default_color = { 0, 0, 0 };
-	if (frontend && frontend->get_p)
-		return frontend->get_p(frontend, x, y);
-	return default_color;
+	/* Update palette LUT entry (taking effect at next frame conversion) */
+	video_ctx->palette[index] = video_map_color(color);
 }
 
-void video_set_pixel(int x, int y, struct color color)
+uint64_t video_hash()
 {
-	if (frontend && frontend->set_p)
-		frontend->set_p(frontend, x, y, color);
+	struct video_context *ctx = video_ctx;
+	uint64_t hash;
+
+	/* Hash native frame buffer along with line palette offsets and palette
+	LUT, which fully determine presented pixels */
+	hash = hash_data(ctx->indices, ctx->width * ctx->height, 0);
+	hash = hash_data(ctx->line_palettes, ctx->height * sizeof(uint16_t),
+		hash);
+	return hash_data(ctx->palette, ctx->num_colors * sizeof(uint32_t),
+		hash);
+}
+
+bool video_get_skip()
+{
+	return video_ctx->skip;
+}
+
+void video_set_skip(bool s)
+{
+	/* Frames rendered while skipping are never presented, so renderers
+	may leave out work which does not affect emulation */
+	video_ctx->skip = s;
 }
 
 void video_deinit()
 {
+	struct video_frontend *frontend = video_ctx->frontend;
+
+	/* Free frame buffers and palette LUT */
+	video_free(video_ctx);
+	free(video_ctx->palette);
+	video_ctx->palette = NULL;
+
 	if (!frontend)
 		return;
 
 	if (frontend->deinit)
 		frontend->deinit(frontend);
 	input_deinit();
-	frontend = NULL;
+	free(frontend);
+	video_ctx->frontend = NULL;
 }
 